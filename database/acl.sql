@@ -1,7 +1,8 @@
 CREATE ROLE mimeographer_webserver;
 
 GRANT SELECT, INSERT, UPDATE
-    ON users, article, session, user_session
+    ON users, article, session, user_session, upload_blob, upload,
+        upload_variant
     TO mimeographer_webserver;
 
 GRANT DELETE ON user_session
@@ -12,3 +13,6 @@ GRANT USAGE ON article_articleid_seq
 
 GRANT USAGE ON users_userid_seq
     TO mimeographer_webserver;
+
+GRANT USAGE ON upload_uploadid_seq
+    TO mimeographer_webserver;
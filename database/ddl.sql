@@ -33,3 +33,36 @@ CREATE TABLE IF NOT EXISTS user_session (
     csrfkey UUID,
     PRIMARY KEY(userid,sessionid)
 );
+
+CREATE TABLE IF NOT EXISTS upload_blob (
+    sha256 CHAR(64) PRIMARY KEY, --hex SHA-256 of the file content
+    path VARCHAR(512) NOT NULL, --relative to uploadDest
+    size BIGINT NOT NULL,
+    refcount INT NOT NULL DEFAULT 1, --uploads sharing the file
+    width INT, --NULL unless it's an image ImagePipeline has read
+    height INT,
+    processed TIMESTAMP, --last change to width, height, or variants
+    created TIMESTAMP NOT NULL DEFAULT NOW()
+);
+
+CREATE TABLE IF NOT EXISTS upload (
+    uploadid SERIAL PRIMARY KEY,
+    path VARCHAR(512) NOT NULL, --relative to uploadDest
+    filename VARCHAR(256) NOT NULL, --name it was uploaded with
+    sha256 CHAR(64) REFERENCES upload_blob(sha256)
+        ON UPDATE CASCADE ON DELETE RESTRICT, --NULL for pre-hash uploads
+    size BIGINT NOT NULL,
+    userid INT REFERENCES users(userid)
+        ON UPDATE CASCADE ON DELETE SET NULL,
+    uploaded TIMESTAMP NOT NULL DEFAULT NOW()
+);
+CREATE INDEX IF NOT EXISTS upload_path ON upload(path);
+
+CREATE TABLE IF NOT EXISTS upload_variant (
+    sha256 CHAR(64) NOT NULL REFERENCES upload_blob(sha256)
+        ON UPDATE CASCADE ON DELETE CASCADE,
+    width INT NOT NULL,
+    height INT NOT NULL,
+    path VARCHAR(512) NOT NULL, --relative to uploadDest
+    PRIMARY KEY(sha256, width)
+);
@@ -15,7 +15,9 @@
  */
 #pragma once
 
+#include <cstddef>
 #include <string>
+#include <vector>
 
 namespace mimeographer
 {
@@ -27,6 +29,58 @@ public:
         staticBase;
     unsigned int dbPort;
 
+    // Let shared caches in front of the server store anonymous pages
+    bool proxyCache = false;
+    unsigned int proxyMaxAge = 60, proxyStaleWhileRevalidate = 300;
+
+    // Response compression and the cache of compressed anonymous pages
+    int compressionLevel = 6;
+    size_t compressionMinSize = 1024, pageCacheBytes = 32 * 1024 * 1024;
+
+    // TLS record encryption is done by the kernel
+    bool ktls = false;
+
+    // In-memory copies of small static and upload files
+    size_t fileCacheBytes = 64 * 1024 * 1024, fileCacheMaxEntry = 256 * 1024;
+
+    // Browser caching of /static and /uploads files
+    unsigned int staticMaxAge = 3600, uploadMaxAge = 31536000;
+    bool uploadImmutable = true;
+
+    // Asynchronous file I/O. fileIOThreads is the size of the thread pool
+    // used when io_uring is disabled or not available
+    bool ioUring = true;
+    unsigned int ioRingEntries = 256, fileIOThreads = 4;
+
+    // Open fds of recently requested static and upload files
+    size_t fdCacheEntries = 1024;
+
+    // Idle handlers kept by each I/O thread, per handler type, for later
+    // requests. Every idle page handler keeps its database connection open,
+    // so handlerPoolConnections caps those across all the threads. Keep it
+    // well under the database server's max_connections
+    size_t handlerPoolSize = 4, handlerPoolConnections = 16;
+
+    // Limits on application/x-www-form-urlencoded request bodies. Requests
+    // over them get a 413
+    size_t formMaxSize = 1024 * 1024, formMaxParams = 1000;
+
+    // Largest upload file accepted, and how much of an upload can be
+    // waiting to be written before the client is made to wait
+    size_t uploadMaxSize = 64 * 1024 * 1024,
+        uploadMaxBuffered = 4 * 1024 * 1024;
+
+    // Uploads each user can have going at once
+    unsigned int uploadsPerUser = 2;
+
+    // Uploads shown on each page of the upload list
+    size_t uploadPageSize = 48;
+
+    // Downscaled copies made of uploaded images, and the threads and JPEG
+    // and WebP quality they're made with. Needs a build with libvips
+    std::vector<unsigned int> imageVariantWidths = { 480, 960, 1920 };
+    unsigned int imageThreads = 2, imageQuality = 80;
+
     Config(const std::string &dbHost, const std::string& dbUser,
         const std::string& dbPass, const std::string &dbName,
         const unsigned int &dbPort, const std::string &uploadDest,
@@ -15,10 +15,13 @@
  */
 #pragma once
 
+#include <cstdint>
 #include <string>
 #include <exception>
 #include <memory>
+#include <unordered_map>
 #include <tuple>
+#include <vector>
 
 #include <boost/optional.hpp>
 
@@ -40,6 +43,9 @@ class DBConn
     FRIEND_TEST(DBConnTest, getUserInfo_email);
     FRIEND_TEST(DBConnTest, getUserInfo_userid);
     FRIEND_TEST(DBConnTest, addUser);
+    FRIEND_TEST(DBConnTest, addUploadBlob);
+    FRIEND_TEST(DBConnTest, uploadIndex);
+    FRIEND_TEST(DBConnTest, imageVariants);
 
     friend class UserSessionTest;
     friend class UserHandlerTest;
@@ -118,6 +124,20 @@ private:
     ////
     UserRecord buildUserRecord(std::unique_ptr<PGresult, PGresultCleaner> dbResult);
 
+    ////
+    /// Join the columns of the first row of a result into a version string
+    /// \param dbResult Query result to collect data from
+    /// \return Column values separated by ':', or boost::none if there are
+    ///     no rows
+    ////
+    boost::optional<std::string> buildVersion(
+        std::unique_ptr<PGresult, PGresultCleaner> dbResult) const;
+
+    ////
+    /// Subquery for the version of the uploaded images an article shows
+    ////
+    static const std::string imagesVersion;
+
 public:
     ////
     /// Exception class for DBConn
@@ -152,16 +172,48 @@ public:
         const unsigned short port=5432);
 
     ////
-    /// Return available articles
+    /// Make sure the connection is still usable, resetting it if it isn't.
+    /// A connection left inside a transaction isn't usable.
+    /// Used before a pooled handler's connection is handed to a new request
+    /// \return false if the connection couldn't be brought back
+    ////
+    bool checkConnection() noexcept;
+
+    ////
+    /// Return available articles, newest first
+    /// \param after Only get articles listed after the one with this ID,
+    ///     for the pages after the first
+    /// \param limit Most articles to get, or 0 for all of them
     ////
     typedef std::vector<std::tuple<int, std::string, std::string>> headline;
-    headline getHeadlines() const;
+    headline getHeadlines(const boost::optional<int> &after = boost::none,
+        const size_t &limit = 0) const;
 
     ////
     /// Return article specified by id
     ////
     std::string getArticle(const std::string &id) const;
 
+    ////
+    /// Return a string that changes whenever the article specified by id
+    /// changes, or ImagePipeline changes an uploaded image it shows, without
+    /// fetching its content
+    /// \param id Article ID
+    /// \return Version string, or boost::none if the article doesn't exist
+    ////
+    boost::optional<std::string> getArticleVersion(const std::string &id) const;
+
+    ////
+    /// Same as getArticleVersion() for the article getLatestArticle() returns
+    ////
+    boost::optional<std::string> getLatestArticleVersion() const;
+
+    ////
+    /// Return a string that changes whenever the list getHeadlines() returns
+    /// changes
+    ////
+    boost::optional<std::string> getArchiveVersion() const;
+
     ////
     /// Retrieve the user info stored from database, if found
     /// \param login User's login to find
@@ -265,6 +317,105 @@ public:
     /// \param name User's full name
     void addUser(const std::string &email, const std::string &newPass,
         const std::string &newSalt, const std::string &name);
+
+    ////
+    /// Count an upload of a stored file, adding the file if it's new
+    /// \param sha256 Hex SHA-256 of the file
+    /// \param path Where to store the file if it's new, relative to
+    ///     uploadDest
+    /// \param size File size
+    /// \return Where the file is stored. This is path unless the file was
+    ///     uploaded before under another name
+    ////
+    std::string addUploadBlob(const std::string &sha256,
+        const std::string &path, const uint64_t &size);
+
+    ////
+    /// Add an upload to the upload index
+    /// \param path Stored file, relative to uploadDest
+    /// \param filename Name the file was uploaded with
+    /// \param sha256 Hex SHA-256 of the file, empty for files stored before
+    ///     uploads were content-addressed
+    /// \param size File size
+    /// \param userId Uploader, if known
+    /// \return ID of the new index entry
+    ////
+    int addUpload(const std::string &path, const std::string &filename,
+        const std::string &sha256, const uint64_t &size,
+        const boost::optional<int> &userId);
+
+    ////
+    /// Add a file found in uploadDest to the upload index unless it's
+    /// already there
+    /// \param path File, relative to uploadDest
+    /// \param sha256 Hex SHA-256 the file is named after, or empty
+    /// \param size File size
+    /// \return true if the file was added
+    ////
+    bool indexExistingUpload(const std::string &path,
+        const std::string &sha256, const uint64_t &size);
+
+    ////
+    /// Page of the upload index, newest first
+    /// Fields:
+    ///     upload ID
+    ///     path relative to uploadDest
+    ///     path of the smallest variant of the image, or empty
+    ////
+    typedef std::vector<std::tuple<int, std::string, std::string>>
+        UploadList;
+
+    ////
+    /// Get a page of the upload index
+    /// \param before Only get uploads with IDs lower than this, for the
+    ///     pages after the first
+    /// \param limit Most uploads to get
+    ////
+    UploadList getUploads(const boost::optional<int> &before,
+        const size_t &limit) const;
+
+    ////
+    /// Save the size of a stored image
+    /// \param sha256 Hex SHA-256 of the image
+    /// \param width Width in pixels
+    /// \param height Height in pixels
+    ////
+    void setUploadDimensions(const std::string &sha256, const int &width,
+        const int &height);
+
+    ////
+    /// Add a downscaled copy of a stored image
+    /// \param sha256 Hex SHA-256 of the original image
+    /// \param width Width of the copy in pixels
+    /// \param height Height of the copy in pixels
+    /// \param path Where the copy is, relative to uploadDest
+    ////
+    void addUploadVariant(const std::string &sha256, const int &width,
+        const int &height, const std::string &path);
+
+    ////
+    /// Size of a stored image and its downscaled copies, narrowest first
+    /// Fields:
+    ///     width of the original
+    ///     height of the original
+    ///     list of copies, each with its width and path relative to
+    ///         uploadDest
+    ////
+    typedef std::tuple<int, int,
+        std::vector<std::tuple<int, std::string>>> ImageVariants;
+
+    ////
+    /// Images found by getImageVariants(), by hex SHA-256
+    ////
+    typedef std::unordered_map<std::string, ImageVariants> ImageVariantMap;
+
+    ////
+    /// Get the sizes of stored images and their downscaled copies
+    /// \param sha256s Hex SHA-256 of each image
+    /// \return The images whose sizes are known
+    ////
+    ImageVariantMap getImageVariants(
+        const std::vector<std::string> &sha256s) const;
 };
 
 }
@@ -15,7 +15,6 @@
  */
 #pragma once
 
-#include <regex>
 #include <string>
 #include <exception>
 
@@ -23,6 +22,7 @@
 #include <proxygen/httpserver/ResponseBuilder.h>
 
 #include "HandlerBase.h"
+#include "HandlerPool.h"
 #include "UserSession.h"
 
 namespace mimeographer 
@@ -44,8 +44,19 @@ private:
     void buildUploadPage();
     void processUpload();
     void processViewUpload();
+
+    ////
+    /// Build the URL of an upload, %-escaping each segment of its path
+    /// \param path Upload path relative to uploadDest
+    ////
+    static std::string uploadUrl(const std::string &path);
     void processLogout();
 
+    void recycle() noexcept override
+    {
+        HandlerPool<EditHandler>::release(this);
+    }
+
 public:
     EditHandler(const Config &config) : HandlerBase(config) {}
 
@@ -0,0 +1,135 @@
+/*
+ * Copyright 2017-present Keith Mendoza
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+
+#include <sys/stat.h>
+
+#include <folly/File.h>
+
+#include "gtest/gtest_prod.h"
+
+#include "Config.h"
+
+namespace mimeographer
+{
+
+////
+/// Open file descriptors of recently requested static and upload files,
+/// along with their fstat() info, so a hot file isn't opened, stat()ed and
+/// closed on every request. Requests for the same file share the fd and
+/// read it with pread. Entries are dropped least recently used first, and
+/// as soon as inotify reports a change under staticBase or uploadDest.
+////
+class FdCache
+{
+    FRIEND_TEST(FdCacheTest, normalize);
+    FRIEND_TEST(FdCacheTest, openFile);
+
+public:
+    struct Entry
+    {
+        std::shared_ptr<folly::File> file;
+        struct stat info;
+    };
+
+private:
+    typedef std::list<std::pair<std::string, Entry>> EntryList;
+
+    static std::mutex cacheLock;
+    static EntryList entries;
+    static std::unordered_map<std::string, EntryList::iterator> index;
+    static size_t maxEntries;
+    static std::atomic<uint64_t> hits, misses;
+
+    // Bumped on every inotify event, so a file that changes while it's
+    // being opened doesn't go into the cache
+    static uint64_t generation;
+
+    // inotify watch descriptor to the directory it watches, and the other
+    // way around. Only files directly in a watched directory are cached
+    static std::unordered_map<int, std::string> watches;
+    static std::unordered_map<std::string, int> watchedDirs;
+    static int inotifyFd;
+
+    ////
+    /// Drop the least recently used entries until there are no more than
+    /// maxEntries. Caller should be holding cacheLock
+    ////
+    static void evict();
+
+    ////
+    /// Clean up a path so the same file always has the same key. Returns
+    /// an empty string for paths with ".." in them, which aren't cached
+    ////
+    static std::string normalize(const std::string &path);
+
+    ////
+    /// Watch dir and all the directories under it. Caller should be
+    /// holding cacheLock
+    ////
+    static void addWatches(const std::string &dir);
+
+    ////
+    /// Read inotify events and invalidate the files they're about
+    ////
+    static void watchChanges();
+
+public:
+    ////
+    /// Set the cache size and start watching staticBase and uploadDest.
+    /// A size of 0 turns the cache off
+    ////
+    static void init(const Config &config);
+
+    ////
+    /// Get an open fd and the fstat() info of a file
+    /// \param path Local path of the file
+    /// \return The cached entry, or a newly opened one
+    /// \throw std::system_error if the file can't be opened
+    ////
+    static Entry open(const std::string &path);
+
+    ////
+    /// Drop path from the cache
+    ////
+    static void invalidate(const std::string &path);
+
+    ////
+    /// Drop everything from the cache
+    ////
+    static void clear();
+
+    ////
+    /// \return Number of open() calls answered from the cache
+    ////
+    static uint64_t getHits() { return hits; }
+
+    ////
+    /// \return Number of open() calls that had to open the file
+    ////
+    static uint64_t getMisses() { return misses; }
+};
+
+}
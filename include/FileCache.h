@@ -0,0 +1,103 @@
+/*
+ * Copyright 2017-present Keith Mendoza
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#pragma once
+
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+
+#include <sys/stat.h>
+
+#include <boost/optional.hpp>
+
+#include "gtest/gtest_prod.h"
+
+#include "Config.h"
+
+namespace mimeographer
+{
+
+////
+/// Contents of small, frequently requested static and upload files so they
+/// can be sent without opening and reading the file again. Entries are
+/// checked against the file's current stat() info, so edits show up on the
+/// next request.
+////
+class FileCache
+{
+    FRIEND_TEST(FileCacheTest, evict);
+
+public:
+    struct File
+    {
+        std::shared_ptr<const std::string> content;
+        std::string mimeType;
+        ino_t inode;
+        off_t size;
+        struct timespec mtime;
+    };
+
+private:
+    typedef std::list<std::pair<std::string, File>> FileList;
+
+    static std::mutex cacheLock;
+    static FileList files;
+    static std::unordered_map<std::string, FileList::iterator> index;
+    static size_t cacheBytes, maxBytes, maxEntry;
+
+    ////
+    /// Drop the least recently used files until the cache fits in maxBytes.
+    /// Caller should be holding cacheLock
+    ////
+    static void evict();
+
+    ////
+    /// Remove path from the cache. Caller should be holding cacheLock
+    ////
+    static void erase(std::unordered_map<std::string, FileList::iterator>::iterator entry);
+
+public:
+    static void init(const Config &config);
+
+    ////
+    /// Check if a file of the given size is allowed in the cache
+    ////
+    static bool cacheable(off_t size);
+
+    ////
+    /// Find a file
+    /// \param path Local path of the file
+    /// \param info Current stat() info of the file
+    /// \return The file if cached and unchanged, boost::none otherwise
+    ////
+    static boost::optional<File> find(const std::string &path,
+        const struct stat &info);
+
+    ////
+    /// Add a file, replacing any existing entry for it
+    /// \param path Local path of the file
+    /// \param info stat() info of the file when content was read
+    /// \param mimeType MIME type to send the file with
+    /// \param content File content
+    ////
+    static void store(const std::string &path, const struct stat &info,
+        const std::string &mimeType, std::string content);
+};
+
+}
@@ -0,0 +1,143 @@
+/*
+ * Copyright 2017-present Keith Mendoza
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#pragma once
+
+#include <functional>
+#include <memory>
+
+#include <sys/types.h>
+
+#include <folly/Executor.h>
+#include <folly/io/IOBuf.h>
+#include <folly/io/async/EventBase.h>
+#include <folly/io/async/EventHandler.h>
+
+#include "Config.h"
+
+struct io_uring;
+
+namespace mimeographer
+{
+
+////
+/// Asynchronous file reads and writes for the handlers running on an
+/// EventBase. Each EventBase gets its own io_uring, and completions are
+/// picked up by the EventBase loop, so the handler never leaves its
+/// thread. On kernels or builds without io_uring the work goes to a
+/// thread pool that only does file I/O, and the completions are still
+/// delivered on the EventBase thread.
+////
+class FileIOService
+{
+public:
+    ////
+    /// Gets the data read, which is shorter than requested at the end of
+    /// the file, and 0 or the errno of a failed read
+    ////
+    typedef std::function<void(std::unique_ptr<folly::IOBuf>, int)>
+        ReadCallback;
+
+    ////
+    /// Gets 0 once all the data is written, or the errno of a failed write
+    ////
+    typedef std::function<void(int)> WriteCallback;
+
+private:
+    static bool useRing;
+    static unsigned int ringEntries, poolThreads;
+
+    // A read or write in flight. Defined in FileIOService.cpp
+    struct Op;
+
+    folly::EventBase &evb;
+    struct io_uring *ring = nullptr;
+    int ringEvent = -1;
+    size_t inFlight = 0;
+
+    ////
+    /// Watches the eventfd the ring signals when completions are posted
+    ////
+    class Completions : public folly::EventHandler
+    {
+    private:
+        FileIOService &parent;
+
+    public:
+        Completions(FileIOService &parent, int fd);
+        void handlerReady(uint16_t events) noexcept override;
+    };
+    std::unique_ptr<Completions> completions;
+
+    ////
+    /// Queue op on the ring, or on the thread pool if there's no ring or
+    /// it's full
+    ////
+    void submit(Op *op);
+
+    ////
+    /// Run the callbacks of the completed ring ops
+    ////
+    void reap();
+
+    ////
+    /// Finish op with the return value of the read/write, or -errno
+    ////
+    void complete(Op *op, int result);
+
+    static folly::Executor &pool();
+
+public:
+    explicit FileIOService(folly::EventBase &evb);
+    ~FileIOService();
+
+    FileIOService(const FileIOService &) = delete;
+    FileIOService &operator=(const FileIOService &) = delete;
+
+    static void init(const Config &config);
+
+    ////
+    /// Get the service for an EventBase, creating it on first use. Has to
+    /// be called from the EventBase's thread
+    ////
+    static FileIOService &get(folly::EventBase *evb);
+
+    ////
+    /// \return true if requests go through io_uring
+    ////
+    bool usingRing() const { return ring != nullptr; }
+
+    ////
+    /// Read from a file. fd has to stay open until callback is called
+    /// \param fd File to read
+    /// \param length Number of bytes to read
+    /// \param offset Where in the file to start reading
+    /// \param callback Called on the EventBase thread when done
+    ////
+    void read(int fd, size_t length, off_t offset, ReadCallback callback);
+
+    ////
+    /// Write all of data to a file. fd has to stay open until callback is
+    /// called
+    /// \param fd File to write
+    /// \param data Data to write
+    /// \param offset Where in the file to write data
+    /// \param callback Called on the EventBase thread when done
+    ////
+    void write(int fd, std::unique_ptr<folly::IOBuf> data, off_t offset,
+        WriteCallback callback);
+};
+
+}
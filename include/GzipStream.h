@@ -0,0 +1,58 @@
+/*
+ * Copyright 2017-present Keith Mendoza
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#pragma once
+
+#include <memory>
+
+#include <zlib.h>
+
+#include <folly/io/IOBuf.h>
+
+namespace mimeographer
+{
+
+////
+/// Gzip-compress a response body that is sent out in pieces. Every call to
+/// compress() flushes, so each piece can go out to the client right away
+////
+class GzipStream
+{
+private:
+    z_stream stream;
+    bool finished = false;
+
+public:
+    ////
+    /// Constructor
+    /// \param level zlib compression level, 1-9
+    ////
+    explicit GzipStream(int level);
+    ~GzipStream();
+
+    GzipStream(const GzipStream &) = delete;
+    GzipStream &operator=(const GzipStream &) = delete;
+
+    ////
+    /// Compress the next piece of the body
+    /// \param data Piece of the body to compress
+    /// \param finish true if this is the last piece
+    /// \return Compressed data to send
+    ////
+    std::unique_ptr<folly::IOBuf> compress(const folly::IOBuf &data,
+        bool finish);
+};
+
+}
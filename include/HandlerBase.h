@@ -19,18 +19,28 @@
 #include <exception>
 #include <fstream>
 #include <boost/optional.hpp>
+#include <functional>
+#include <memory>
+#include <set>
 #include <utility>
 #include <vector>
 
 #include <proxygen/httpserver/RequestHandler.h>
 #include <proxygen/httpserver/ResponseBuilder.h>
 #include <proxygen/lib/http/experimental/RFC1867.h>
+#include <folly/File.h>
 #include <folly/io/IOBuf.h>
+#include <folly/ssl/OpenSSLHash.h>
 
 #include "gtest/gtest_prod.h"
 
 #include "Config.h"
 #include "DBConn.h"
+#include "GzipStream.h"
+#include "RequestArena.h"
+#include "RequestContext.h"
+#include "Router.h"
+#include "UrlEncodedParser.h"
 #include "UserSession.h"
 
 namespace mimeographer 
@@ -42,7 +52,10 @@ class HandlerBase : public proxygen::RequestHandler
     FRIEND_TEST(HandlerBaseTest, buildPageTrailer);
     FRIEND_TEST(HandlerBaseTest, prependResponse);
     FRIEND_TEST(HandlerBaseTest, getPostParam);
-    FRIEND_TEST(HandlerBaseTest, parseCookies);
+    FRIEND_TEST(HandlerBaseTest, acceptsGzip);
+    FRIEND_TEST(HandlerBaseTest, htmlEscape);
+    FRIEND_TEST(HandlerBaseTest, reset);
+    FRIEND_TEST(HandlerBaseTest, refuseFiles);
     
     FRIEND_TEST(PrimaryHandlerTest, buildFrontPage);
     FRIEND_TEST(PrimaryHandlerTest, renderArticle_header);
@@ -51,6 +64,7 @@ class HandlerBase : public proxygen::RequestHandler
     FRIEND_TEST(PrimaryHandlerTest, renderArticle_blockquote);
     FRIEND_TEST(PrimaryHandlerTest, renderArticle_link);
     FRIEND_TEST(PrimaryHandlerTest, renderArticle_image);
+    FRIEND_TEST(PrimaryHandlerTest, renderArticle_imageVariants);
     FRIEND_TEST(PrimaryHandlerTest, renderArticle_codeblock);
     FRIEND_TEST(PrimaryHandlerTest, renderArticle_htmlblock);
     FRIEND_TEST(PrimaryHandlerTest, renderArticle_htmlinline);
@@ -68,31 +82,132 @@ protected:
     };
 
 private:
+    // Backs the per-request containers below, so it has to be declared
+    // before them
+    RequestArena arena;
+
     std::unique_ptr<folly::IOBuf> handlerResponse;
     std::unique_ptr<proxygen::HTTPMessage> requestHeaders;
 
+    // Views into requestHeaders
+    RequestContext context;
+
     struct PostParam
     {
         PostParamType type;
         std::string value;
         std::string filename;
         std::string localFilename;
+
+        // Hex SHA-256 and size of a FILE_UPLOAD, set once it's all in
+        std::string sha256;
+        uint64_t size;
     };
-    std::map<std::string, PostParam> postParams;
+    ArenaMap<ArenaString, PostParam> postParams;
 
-    class PostBodyCallback : public proxygen::RFC1867Codec::Callback
+    ////
+    /// Takes the fields from both multipart/form-data and urlencoded bodies
+    ////
+    class PostBodyCallback : public proxygen::RFC1867Codec::Callback,
+        public UrlEncodedParser::Callback
     {
     private:
+        ////
+        /// Upload writes still in flight for the request, shared with the
+        /// write callbacks so they can finish after the handler is gone
+        ////
+        struct UploadWrites
+        {
+            size_t pending = 0;
+            std::set<std::string> failedParams;
+            std::function<void()> onDrained;
+
+            // Bytes handed to FileIOService and not written yet. Ingress is
+            // paused while there's too much of it
+            size_t buffered = 0;
+            bool paused = false;
+            std::function<void()> onResume;
+        };
+
         HandlerBase &parent;
-        std::ofstream saveFile;
+        std::shared_ptr<UploadWrites> writes;
+        std::shared_ptr<folly::File> saveFile;
+        off_t saveOffset = 0, allocated = 0;
         std::string localFilename, uploadFileParam;
+        uint64_t bodyLength = 0;
+        bool overLimit = false;
+
+        // Whether file parts are saved, and whether the one coming in is
+        // being thrown away instead
+        bool acceptFiles = true, skipFile = false;
+
+        // Uploads are hashed as they come in, for UploadStore
+        folly::ssl::OpenSSLHash::Digest digest;
+
+        // Where the request's uploads were saved. Whatever the handler
+        // didn't move to UploadStore is removed with the request
+        std::vector<std::string> tempFiles;
+
+        ////
+        /// Delete the uploads left in tempFiles
+        ////
+        void removeTempFiles();
+
+        ////
+        /// Remove the uploads that couldn't be written from the POST params
+        /// and delete what was saved of them
+        ////
+        void dropFailedUploads();
 
     public:
-        explicit PostBodyCallback(HandlerBase &parent) : parent(parent)
+        explicit PostBodyCallback(HandlerBase &parent) : parent(parent),
+            writes(std::make_shared<UploadWrites>())
         {}
 
+        ~PostBodyCallback();
+
+        ////
+        /// Forget the request's uploads. Writes still in flight finish
+        /// without calling back into the handler
+        ////
+        void reset();
+
+        ////
+        /// Set the Content-Length of the request body, so the space for an
+        /// upload can be allocated up front
+        ////
+        inline void setBodyLength(uint64_t length)
+        {
+            bodyLength = length;
+        }
+
+        ////
+        /// Throw away the file parts of the body instead of saving them. The
+        /// other fields are still parsed
+        ////
+        inline void refuseFiles()
+        {
+            acceptFiles = false;
+        }
+
+        ////
+        /// \return true if an upload was dropped for going over uploadMaxSize
+        ////
+        inline bool isOverLimit() const
+        {
+            return overLimit;
+        }
+
+        ////
+        /// Call callback once all the upload data is on disk
+        /// \param callback Called once the writes finish
+        /// \return true if callback was deferred, false if there was
+        ///     nothing to wait for and callback wasn't called
+        ////
+        bool waitForUploads(std::function<void()> callback);
+
         void onParam(const std::string& name, const std::string& value,
-            uint64_t postBytesProcessed);
+            uint64_t postBytesProcessed) override;
         int onFileStart(const std::string& name, const std::string& filename,
             std::unique_ptr<proxygen::HTTPMessage> msg,
             uint64_t postBytesProcessed);
@@ -100,7 +215,7 @@ private:
             uint64_t postBytesProcessed);
         void onFileEnd(bool end, uint64_t postBytesProcessed);
 
-        void onError()
+        void onError() override
         {
             LOG(ERROR) << "Error encountered parsing POST request body";
             parent.postParams.clear();
@@ -109,21 +224,140 @@ private:
     PostBodyCallback pbCallback;
 
     std::unique_ptr<proxygen::RFC1867Codec> postParser;
-    std::map<std::string, std::string> cookieJar;
+    std::unique_ptr<UrlEncodedParser> formParser;
+
+    // The response went out before the body was all in, and the rest of
+    // the body is ignored
+    bool bodyRefused = false;
+
+    ////
+    /// Send an error response right away instead of reading the rest of the
+    /// request body, and stop reading it. Also used when the body can't be
+    /// parsed
+    /// \param code HTTP status code
+    /// \param msg Status text, which is also shown on the page
+    ////
+    void refuseBody(unsigned short code, const std::string &msg) noexcept;
+
+    // User holding an UploadLimiter slot for this request's uploads
+    boost::optional<int> uploadUser;
+
+    ////
+    /// Give back the request's UploadLimiter slot if it has one
+    ////
+    void releaseUploadSlot();
+
+    // Cookies to send with the response
+    ArenaMap<ArenaString, ArenaString> cookieJar;
+
+    bool streamingAllowed = false;
+    bool headersSent = false;
+    bool egressPaused = false;
+    std::function<bool()> bodyProducer;
+    std::string etag;
+    bool publicResponse = false;
+
+    std::unique_ptr<GzipStream> gzip;
+    bool cacheResponse = false;
+    std::string plainCopy, gzipCopy;
+
+    ////
+    /// Add the headers common to every page response
+    /// \param builder ResponseBuilder to add the headers to
+    ////
+    void addPageHeaders(proxygen::ResponseBuilder &builder);
+
+    ////
+    /// Run processRequest() and send its response, or the error page. Done
+    /// by onEOM(), after the uploads are written if there are any
+    ////
+    void respond() noexcept;
+
+    ////
+    /// Add the Cache-Control and related headers for the page. Also adds the
+    /// session cookie unless the page is going to shared caches
+    /// \param builder ResponseBuilder to add the headers to
+    ////
+    void addCacheHeaders(proxygen::ResponseBuilder &builder);
+
+    ////
+    /// Add Set-Cookie headers for everything in cookieJar
+    /// \param builder ResponseBuilder to add the headers to
+    ////
+    void addCookieHeaders(proxygen::ResponseBuilder &builder);
+
+    ////
+    /// Send a piece of the page body, compressing it if the client accepts
+    /// gzip and keeping a copy if the page is going to PageCache
+    /// \param builder ResponseBuilder to send the body with
+    /// \param body Piece of the body
+    /// \param eom true if this is the end of the page
+    ////
+    void sendBody(proxygen::ResponseBuilder &builder,
+        std::unique_ptr<folly::IOBuf> body, bool eom);
+
+    ////
+    /// Send the page from PageCache if it's there. Otherwise mark the
+    /// response to be added to the cache once it's done
+    /// \return true if the page was sent from the cache
+    ////
+    bool sendCachedPage();
+
+    ////
+    /// Add the page collected by sendBody() to PageCache
+    ////
+    void storeCachedPage();
+
+    ////
+    /// Check if an Accept-Encoding header value allows gzip
+    /// \param acceptEncoding Accept-Encoding header value
+    ////
+    static bool acceptsGzip(const std::string &acceptEncoding);
+
+    ////
+    /// Send a chunk of the response body when streaming
+    /// \param chunk Data to send
+    ////
+    void sendBodyChunk(std::unique_ptr<folly::IOBuf> chunk);
+
+    ////
+    /// Close out a streamed response that hit an error after the headers
+    /// already went out
+    /// \param msg HTML to show the user before the page trailer
+    ////
+    void finishStreamedResponse(const std::string &msg);
+
+    ////
+    /// Run bodyProducer until it is done or egress gets paused. Closes out
+    /// the response once the producer is done
+    ////
+    void produceBody();
+
+    ////
+    /// Build the ETag for the page from getResourceVersion() and send a 304
+    /// if it matches the request's If-None-Match
+    /// \return true if the 304 was sent and the request is done
+    ////
+    bool sendNotModified();
 
 protected:
     const Config &config;
     DBConn db;
     UserSession session;
+    RouteMatch route;
 
     std::unique_ptr<folly::IOBuf> buildPageHeader();
-    void parseCookies(const std::string &cookies) noexcept;
 
     inline void prependResponse(const std::string &data)
     {
         VLOG(2) << "Start " << __PRETTY_FUNCTION__;
 
-        if(handlerResponse)
+        if(headersSent)
+        {
+            VLOG(3) << "Streaming data to client";
+            sendBodyChunk(folly::IOBuf::copyBuffer(data));
+        }
+        else if(handlerResponse)
         {
             VLOG(3) << "Prepending to existing handlerResponse";
             handlerResponse->prependChain(std::move(folly::IOBuf::copyBuffer(data)));
@@ -149,31 +383,49 @@ protected:
 
     inline void addCookie(const std::string &name, const std::string &value)
     {
-        cookieJar[name] = value;
+        findOrInsert(cookieJar, name).assign(value.data(), value.size());
     }
 
     inline boost::optional<std::string> getCookie(const std::string &name)
     {
         VLOG(2) << "Start " << __PRETTY_FUNCTION__;
 
+        // A cookie set while handling the request replaces the one the
+        // client sent
         boost::optional<std::string> retVal = boost::none;
-        try
+        auto entry = cookieJar.find(name);
+        auto requestCookie = context.getCookie(name);
+        if(entry != cookieJar.end())
         {
-            auto r = cookieJar.at(name);
-            VLOG(1) << "Cookie with name " << name << " found";
-
-            VLOG(2) << "End " << __PRETTY_FUNCTION__;
-            retVal = r;
+            VLOG(1) << "Cookie with name " << name << " set for response";
+            retVal = std::string(entry->second.data(), entry->second.size());
         }
-        catch(std::out_of_range &e)
+        else if(requestCookie)
         {
-            VLOG(1) << "No cookie with name " << name;
+            VLOG(1) << "Cookie with name " << name << " found";
+            retVal = requestCookie->str();
         }
+        else
+            VLOG(1) << "No cookie with name " << name;
 
         VLOG(2) << "End " << __PRETTY_FUNCTION__;
         return retVal;
     }
 
+    ////
+    /// Get a query string param
+    /// \param name Param name
+    /// \return The decoded value, or boost::none if the request doesn't
+    ///     have the param or it's malformed
+    ////
+    boost::optional<std::string> getQueryParam(const std::string &name) const;
+
+    ////
+    /// Escape text for HTML content and quoted attribute values
+    /// \param text Text to escape
+    ////
+    static std::string htmlEscape(folly::StringPiece text);
+
     ////
     /// Generate HTML for action buttons outside of the navbar
     /// \param links vector of target/label pairs to generate buttons for
@@ -182,21 +434,88 @@ protected:
     const std::string makeMenuButtons(
         const std::vector<std::pair<std::string, std::string>> &links) const;
 
+    ////
+    /// Send the response status, headers and page header right away so the
+    /// browser can start loading the page while the rest is being built.
+    /// Everything passed to prependResponse() afterwards goes straight to
+    /// the client. Only call this once the handler knows the response is a
+    /// 200; it does nothing outside of onEOM().
+    ////
+    void startStreaming();
+
+    ////
+    /// Hand the rest of the response body over to producer. Each call to
+    /// producer should pass the next piece of the body to prependResponse()
+    /// and return false once there is nothing left. When streaming,
+    /// producer is only called while the client keeps up; otherwise it is
+    /// run to completion right away.
+    /// \param producer Function generating the body piece by piece
+    ////
+    void setBodyProducer(std::function<bool()> producer);
+
+    ////
+    /// Return a string that changes whenever the content of the requested
+    /// page changes. It is combined with the template version and the
+    /// user's auth state to build the page's ETag. This is called before
+    /// processRequest() so it should be cheap; return boost::none if the
+    /// page should not be cached
+    ////
+    virtual boost::optional<std::string> getResourceVersion()
+    {
+        return boost::none;
+    }
+
+    ////
+    /// Return true if the requested page looks the same to every anonymous
+    /// user. When proxyCache is enabled these pages are sent without a
+    /// session cookie and marked cacheable by shared caches
+    ////
+    virtual bool isPublicPage() const
+    {
+        return false;
+    }
+
+    ////
+    /// Dispose of the handler once the request is done. Pooled handlers
+    /// override this to hand themselves back to their HandlerPool
+    ////
+    virtual void recycle() noexcept
+    {
+        delete this;
+    }
+
 public:
     HandlerBase(const Config &config);
+
+    ////
+    /// Set the route the factory matched for this request. Its params point
+    /// into the request's HTTPMessage, which the handler keeps
+    ////
+    inline void setRoute(const RouteMatch &match)
+    {
+        route = match;
+    }
+
     void onRequest(std::unique_ptr<proxygen::HTTPMessage> headers)
             noexcept override;
 
-    void onBody(std::unique_ptr<folly::IOBuf> body) noexcept override 
-    {
-        if(postParser)
-            postParser->onIngress(std::move(body));
-    };
+    ////
+    /// Put the handler back in the state of a new one so HandlerPool can
+    /// give it to another request. Everything about the request and its
+    /// user goes; the DB connection and the arena's block are kept
+    /// \return false if the DB connection is broken and the handler
+    ///     shouldn't be reused
+    ////
+    bool reset() noexcept;
+
+    void onBody(std::unique_ptr<folly::IOBuf> body) noexcept override;
 
     void onEOM() noexcept override;
     void onUpgrade(proxygen::UpgradeProtocol proto) noexcept override {};
     void requestComplete() noexcept override;
     void onError(proxygen::ProxygenError err) noexcept override;
+    void onEgressPaused() noexcept override;
+    void onEgressResumed() noexcept override;
     virtual void processRequest() = 0;
 
     ////
@@ -0,0 +1,204 @@
+/*
+ * Copyright 2017-present Keith Mendoza
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <vector>
+
+#include <glog/logging.h>
+
+#include "Config.h"
+
+namespace mimeographer
+{
+
+class HandlerBase;
+
+////
+/// Whether an idle T keeps a database connection open. Every HandlerBase
+/// does
+////
+template <class T>
+struct PoolHoldsConnection : std::is_base_of<HandlerBase, T> {};
+
+////
+/// Settings and counts shared by all the HandlerPool instantiations
+////
+class HandlerPoolBase
+{
+protected:
+    static size_t maxFree, maxConnections;
+
+    // Idle handlers holding a database connection, across all the threads
+    // and handler types
+    static std::atomic<size_t> idleConnections;
+
+    ////
+    /// Count one more idle database connection
+    /// \return false if there are already maxConnections of them
+    ////
+    static bool takeConnection() noexcept;
+
+    ////
+    /// Stop counting idle database connections
+    /// \param count Number of connections no longer idle
+    ////
+    static void giveConnections(size_t count) noexcept;
+
+public:
+    ////
+    /// Set how many idle handlers of each type a thread keeps, and how many
+    /// idle database connections they can hold between them
+    ////
+    static void init(const Config &config);
+};
+
+////
+/// Per-thread freelist of request handlers so each request doesn't pay for
+/// constructing and destroying one, DB connection included. Every I/O
+/// thread runs one EventBase, and a handler is created and completed on
+/// the EventBase of its request, so a thread local list is a list per
+/// EventBase and needs no locking.
+///
+/// T needs a T(const Config &) constructor and a bool reset() noexcept
+/// member. reset() is called as soon as the handler is done with a request
+/// and has to put it back in the state of a newly constructed one, apart
+/// from reusable capacity and resources that hold nothing about the
+/// request. That way an idle handler holds nothing from the last request
+/// either. reset() returns false if the handler can't be reused, and it
+/// gets deleted instead.
+///
+/// Each idle handler that holds a database connection also counts against
+/// a limit shared by all the threads, so the pools can't hold more
+/// connections open than the database server allows.
+////
+template <class T>
+class HandlerPool : public HandlerPoolBase
+{
+private:
+    // Stops counting the connections of the thread's idle handlers when
+    // the thread exits
+    struct FreeList
+    {
+        std::vector<std::unique_ptr<T>> list;
+
+        ~FreeList()
+        {
+            if(PoolHoldsConnection<T>::value)
+                giveConnections(list.size());
+        }
+    };
+
+    static std::vector<std::unique_ptr<T>> &freeList()
+    {
+        static thread_local FreeList handlers;
+        return handlers.list;
+    }
+
+public:
+    ////
+    /// Get an idle handler, or a new one if there are none
+    /// \param config Server config, for a new handler
+    ////
+    static T *get(const Config &config)
+    {
+        VLOG(2) << "Start " << __PRETTY_FUNCTION__;
+
+        auto &list = freeList();
+        T *retVal;
+        if(list.empty())
+        {
+            VLOG(1) << "No idle handler, creating one";
+            retVal = new T(config);
+        }
+        else
+        {
+            VLOG(1) << "Reusing idle handler";
+            retVal = list.back().release();
+            list.pop_back();
+            if(PoolHoldsConnection<T>::value)
+                giveConnections(1);
+        }
+
+        VLOG(2) << "End " << __PRETTY_FUNCTION__;
+        return retVal;
+    }
+
+    ////
+    /// Reset a handler that's done with its request and keep it for a
+    /// later one, or delete it if the pool is full
+    /// \param handler Handler from get()
+    ////
+    static void release(T *handler) noexcept
+    {
+        VLOG(2) << "Start " << __PRETTY_FUNCTION__;
+
+        std::unique_ptr<T> owned(handler);
+        auto &list = freeList();
+        bool holdsConnection = PoolHoldsConnection<T>::value;
+        if(list.size() >= maxFree)
+            VLOG(1) << "Handler pool full, deleting handler";
+        else if(holdsConnection && !takeConnection())
+            VLOG(1) << "Enough idle DB connections already, deleting handler";
+        else if(!owned->reset())
+        {
+            LOG(WARNING) << "Handler can't be reused, deleting it";
+            if(holdsConnection)
+                giveConnections(1);
+        }
+        else
+        {
+            try
+            {
+                list.push_back(std::move(owned));
+                VLOG(1) << "Handler returned to pool";
+            }
+            catch(const std::bad_alloc &)
+            {
+                LOG(WARNING) << "No room in handler pool, deleting handler";
+                if(holdsConnection)
+                    giveConnections(1);
+            }
+        }
+
+        VLOG(2) << "End " << __PRETTY_FUNCTION__;
+    }
+
+    ////
+    /// Number of idle handlers on this thread
+    ////
+    static size_t getFreeCount()
+    {
+        return freeList().size();
+    }
+
+    ////
+    /// Delete this thread's idle handlers
+    ////
+    static void clear()
+    {
+        auto &list = freeList();
+        if(PoolHoldsConnection<T>::value)
+            giveConnections(list.size());
+        list.clear();
+    }
+};
+
+}
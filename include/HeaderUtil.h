@@ -0,0 +1,46 @@
+/*
+ * Copyright 2017-present Keith Mendoza
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#pragma once
+
+#include <string>
+
+namespace mimeographer
+{
+
+////
+/// Parsing of request header values shared by the handlers
+////
+class HeaderUtil
+{
+public:
+    ////
+    /// Check if an ETag is listed in an If-None-Match header value
+    /// \param ifNoneMatch If-None-Match header value
+    /// \param etag Quoted ETag to look for
+    ////
+    static bool etagMatches(const std::string &ifNoneMatch,
+        const std::string &etag);
+
+    ////
+    /// Check if an Accept-Encoding header value allows a content coding
+    /// \param acceptEncoding Accept-Encoding header value
+    /// \param coding Content coding to look for, in lower case
+    ////
+    static bool acceptsCoding(const std::string &acceptEncoding,
+        const std::string &coding);
+};
+
+}
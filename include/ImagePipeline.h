@@ -0,0 +1,93 @@
+/*
+ * Copyright 2017-present Keith Mendoza
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#pragma once
+
+#include <memory>
+#include <string>
+
+#include <folly/Range.h>
+#include <folly/executors/CPUThreadPoolExecutor.h>
+
+#include "Config.h"
+#include "DBConn.h"
+
+namespace mimeographer
+{
+
+////
+/// Makes downscaled copies of uploaded images in the background so pages
+/// don't have to send camera-sized files to be shown a few hundred pixels
+/// wide. Each copy is recompressed with its metadata stripped and stored
+/// next to the original, and the original's size and its copies are saved
+/// for renderArticle to build srcset from. The original is left as it was
+/// uploaded since it's named after its content. Only does anything in
+/// builds with libvips.
+////
+class ImagePipeline
+{
+private:
+    static std::unique_ptr<Config> config;
+    static std::unique_ptr<folly::CPUThreadPoolExecutor> executor;
+
+    ////
+    /// Get the calling worker's database connection, connecting if needed
+    ////
+    static DBConn &connection();
+
+    ////
+    /// Make the copies of an image and save them
+    /// \param uploadDest Base directory of the uploads
+    /// \param path Stored image path relative to uploadDest
+    /// \param sha256 Hex SHA-256 of the image
+    ////
+    static void makeVariants(const std::string &uploadDest,
+        const std::string &path, const std::string &sha256);
+
+    ////
+    /// Make and save one copy of an image
+    /// \param base Base directory of the uploads, without a trailing '/'
+    /// \param path Stored image path relative to base
+    /// \param sha256 Hex SHA-256 of the image
+    /// \param width Width of the copy
+    /// \return false if the copy couldn't be made or saved
+    ////
+    static bool makeVariant(const std::string &base, const std::string &path,
+        const std::string &sha256, unsigned int width);
+
+public:
+    ////
+    /// Start the worker pool if this build can make copies
+    ////
+    static void init(const Config &config);
+
+    ////
+    /// Check whether a file can be given downscaled copies, going by its
+    /// extension
+    /// \param path File path
+    ////
+    static bool isImage(folly::StringPiece path);
+
+    ////
+    /// Queue a newly stored upload to have copies made if it's an image
+    /// \param uploadDest Base directory of the uploads
+    /// \param path Stored file path relative to uploadDest
+    /// \param sha256 Hex SHA-256 of the file
+    ////
+    static void submit(const std::string &uploadDest, const std::string &path,
+        const std::string &sha256);
+};
+
+}
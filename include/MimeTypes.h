@@ -0,0 +1,173 @@
+/*
+ * Copyright 2017-present Keith Mendoza
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+#include "gtest/gtest_prod.h"
+
+namespace mimeographer
+{
+
+////
+/// File extension to MIME type lookup for static and upload files. The
+/// table is fixed at compile time and searched with a case-insensitive
+/// binary search, so a lookup doesn't allocate or throw.
+////
+class MimeTypes
+{
+    FRIEND_TEST(MimeTypesTest, table);
+
+private:
+    struct Entry
+    {
+        const char *extension;
+        const char *type;
+    };
+
+    // Sorted by extension, all lower case
+    static constexpr Entry table[] = {
+        { "aac", "audio/aac" },
+        { "apng", "image/apng" },
+        { "avif", "image/avif" },
+        { "bmp", "image/bmp" },
+        { "cmx", "image/x-cmx" },
+        { "cod", "image/cis-cod" },
+        { "css", "text/css" },
+        { "csv", "text/csv" },
+        { "eot", "application/vnd.ms-fontobject" },
+        { "flac", "audio/flac" },
+        { "gif", "image/gif" },
+        { "htm", "text/html" },
+        { "html", "text/html" },
+        { "ico", "image/x-icon" },
+        { "ics", "text/calendar" },
+        { "ief", "image/ief" },
+        { "jfif", "image/pipeg" },
+        { "jpe", "image/jpeg" },
+        { "jpeg", "image/jpeg" },
+        { "jpg", "image/jpeg" },
+        { "js", "text/javascript" },
+        { "json", "application/json" },
+        { "jsonld", "application/ld+json" },
+        { "m4a", "audio/mp4" },
+        { "map", "application/json" },
+        { "md", "text/markdown" },
+        { "mjs", "text/javascript" },
+        { "mov", "video/quicktime" },
+        { "mp3", "audio/mpeg" },
+        { "mp4", "video/mp4" },
+        { "oga", "audio/ogg" },
+        { "ogg", "audio/ogg" },
+        { "ogv", "video/ogg" },
+        { "otf", "font/otf" },
+        { "pbm", "image/x-portable-bitmap" },
+        { "pdf", "application/pdf" },
+        { "pgm", "image/x-portable-graymap" },
+        { "png", "image/png" },
+        { "pnm", "image/x-portable-anymap" },
+        { "ppm", "image/x-portable-pixmap" },
+        { "ras", "image/x-cmu-raster" },
+        { "rgb", "image/x-rgb" },
+        { "rss", "application/rss+xml" },
+        { "svg", "image/svg+xml" },
+        { "tif", "image/tiff" },
+        { "tiff", "image/tiff" },
+        { "ttf", "font/ttf" },
+        { "txt", "text/plain" },
+        { "wasm", "application/wasm" },
+        { "wav", "audio/wav" },
+        { "webm", "video/webm" },
+        { "webmanifest", "application/manifest+json" },
+        { "webp", "image/webp" },
+        { "woff", "font/woff" },
+        { "woff2", "font/woff2" },
+        { "xbm", "image/x-xbitmap" },
+        { "xml", "application/xml" },
+        { "xpm", "image/x-xpixmap" },
+        { "xwd", "image/x-xwindowdump" },
+        { "zip", "application/zip" }
+    };
+    static constexpr size_t tableSize = sizeof(table) / sizeof(table[0]);
+
+    // Longest extension in table. Anything longer can't match
+    static constexpr size_t maxExtension = 11;
+
+    static constexpr char lower(char c)
+    {
+        return c >= 'A' && c <= 'Z' ? c - 'A' + 'a' : c;
+    }
+
+    static constexpr size_t length(const char *str)
+    {
+        size_t retVal = 0;
+        while(str[retVal])
+            retVal++;
+        return retVal;
+    }
+
+    ////
+    /// Compare an extension to a table entry, ignoring the extension's case
+    /// \param ext Extension, doesn't have to be null terminated
+    /// \param extLength Length of ext
+    /// \param entry Extension in the table
+    /// \return <0, 0 or >0 like strcmp
+    ////
+    static constexpr int compare(const char *ext, size_t extLength,
+        const char *entry)
+    {
+        for(size_t i = 0; i < extLength; i++)
+        {
+            auto c = lower(ext[i]);
+            if(!entry[i] || c > entry[i])
+                return 1;
+            else if(c < entry[i])
+                return -1;
+        }
+        return entry[extLength] ? -1 : 0;
+    }
+
+    static constexpr bool sorted()
+    {
+        for(size_t i = 1; i < tableSize; i++)
+        {
+            if(compare(table[i].extension, length(table[i].extension),
+                table[i - 1].extension) <= 0)
+                return false;
+        }
+        return true;
+    }
+
+public:
+    static constexpr const char *defaultType = "application/octet-stream";
+
+    ////
+    /// Find the MIME type of a file
+    /// \param fileName File name or path
+    /// \param length Length of fileName
+    /// \return MIME type for the file's extension, defaultType if it's not
+    ///     known
+    ////
+    static const char *find(const char *fileName, size_t length);
+
+    static const char *find(const std::string &fileName)
+    {
+        return find(fileName.data(), fileName.size());
+    }
+};
+
+}
@@ -0,0 +1,94 @@
+/*
+ * Copyright 2017-present Keith Mendoza
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#pragma once
+
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+
+#include <boost/optional.hpp>
+#include <folly/io/IOBuf.h>
+
+#include "gtest/gtest_prod.h"
+
+#include "Config.h"
+
+namespace mimeographer
+{
+
+////
+/// Fully rendered pages that look the same to every anonymous user, kept in
+/// both plain and gzip form so they are rendered and compressed only once.
+/// Entries are keyed by the page's ETag, so a new article version simply
+/// misses and the stale entry ages out.
+////
+class PageCache
+{
+    FRIEND_TEST(PageCacheTest, evict);
+
+public:
+    ////
+    /// Cached page. gzip is null if the page was sent uncompressed
+    ////
+    struct Page
+    {
+        std::shared_ptr<const std::string> plain, gzip;
+    };
+
+private:
+    typedef std::list<std::pair<std::string, Page>> PageList;
+
+    static std::mutex cacheLock;
+    static PageList pages;
+    static std::unordered_map<std::string, PageList::iterator> index;
+    static size_t cacheBytes, maxBytes;
+
+    ////
+    /// Drop the least recently used pages until the cache fits in maxBytes.
+    /// Caller should be holding cacheLock
+    ////
+    static void evict();
+
+public:
+    static void init(const Config &config);
+
+    ////
+    /// Find a page
+    /// \param key Page ETag
+    /// \return The page if cached, boost::none otherwise
+    ////
+    static boost::optional<Page> find(const std::string &key);
+
+    ////
+    /// Add a page, replacing any existing page with the same key
+    /// \param key Page ETag
+    /// \param page Page content
+    ////
+    static void store(const std::string &key, Page page);
+
+    ////
+    /// Wrap cached content in an IOBuf without copying it. The content stays
+    /// alive until the IOBuf is freed, even if the page gets evicted
+    /// \param content Cached content to wrap
+    ////
+    static std::unique_ptr<folly::IOBuf> toIOBuf(
+        std::shared_ptr<const std::string> content);
+};
+
+}
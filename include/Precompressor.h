@@ -0,0 +1,71 @@
+/*
+ * Copyright 2017-present Keith Mendoza
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#pragma once
+
+#include <string>
+
+#include <sys/stat.h>
+
+#include "gtest/gtest_prod.h"
+
+namespace mimeographer
+{
+
+////
+/// Writes gzip copies ("sidecars") of text assets next to the originals so
+/// StaticHandler can send them without compressing anything at request time
+////
+class Precompressor
+{
+    FRIEND_TEST(PrecompressorTest, writeGzip);
+
+private:
+    ////
+    /// Write fileName.gz if it's missing or not newer than fileName. Nothing
+    /// is written when compression doesn't make the file smaller
+    /// \param fileName File to compress
+    /// \param level zlib compression level
+    /// \return false if the sidecar couldn't be written
+    ////
+    static bool writeGzip(const std::string &fileName, int level);
+
+public:
+    ////
+    /// Check if a file is worth sending compressed, based on its MIME type
+    ////
+    static bool compressible(const std::string &fileName);
+
+    ////
+    /// Check if a sidecar was written after the last change to its source.
+    /// The nanoseconds are compared too, since the source can change in the
+    /// same second the sidecar was written
+    /// \param sidecar stat() info of the sidecar
+    /// \param source stat() info of the file it was made from
+    /// \return true if sidecar is strictly newer than source
+    ////
+    static bool isFresh(const struct stat &sidecar, const struct stat &source);
+
+    ////
+    /// Write sidecars for all the compressible files under dir
+    /// \param dir Directory to walk recursively
+    /// \param level zlib compression level
+    /// \param threads Number of files to compress at the same time
+    /// \return false if any sidecar couldn't be written
+    ////
+    static bool run(const std::string &dir, int level, size_t threads);
+};
+
+}
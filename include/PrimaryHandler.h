@@ -18,13 +18,15 @@
 #include <proxygen/httpserver/RequestHandler.h>
 #include <proxygen/httpserver/ResponseBuilder.h>
 
-#include <regex>
 #include <string>
 #include <exception>
 
+#include <cmark.h>
+
 #include "gtest/gtest_prod.h"
 
 #include "HandlerBase.h"
+#include "HandlerPool.h"
 
 namespace mimeographer 
 {
@@ -38,6 +40,7 @@ class PrimaryHandler : public HandlerBase
     FRIEND_TEST(PrimaryHandlerTest, renderArticle_blockquote);
     FRIEND_TEST(PrimaryHandlerTest, renderArticle_link);
     FRIEND_TEST(PrimaryHandlerTest, renderArticle_image);
+    FRIEND_TEST(PrimaryHandlerTest, renderArticle_imageVariants);
     FRIEND_TEST(PrimaryHandlerTest, renderArticle_codeblock);
     FRIEND_TEST(PrimaryHandlerTest, renderArticle_htmlblock);
     FRIEND_TEST(PrimaryHandlerTest, renderArticle_htmlinline);
@@ -45,6 +48,17 @@ class PrimaryHandler : public HandlerBase
     FRIEND_TEST(PrimaryHandlerTest, renderArticle_strong);
 
 private:
+    // Sizes and downscaled copies of the uploaded images in the article
+    // being rendered
+    DBConn::ImageVariantMap images;
+
+    ////
+    /// Get the hash of the stored upload an image URL points to
+    /// \param url Image URL
+    /// \return The hex SHA-256, or an empty range if url isn't a stored
+    ///     upload
+    ////
+    static folly::StringPiece uploadHash(folly::StringPiece url);
 
     ////
     /// Parse the markdown for sending in the response
@@ -52,6 +66,24 @@ private:
     ////
     void renderArticle(const std::string &data);
 
+    ////
+    /// Render the next top-level block of a parsed article
+    /// \param rootNode Document node of the article
+    /// \param iterator Iterator walking rootNode
+    /// \param inItem Whether the iterator is inside a list item
+    /// \return true if there are more blocks to render
+    ////
+    bool renderBlock(cmark_node *rootNode, cmark_iter *iterator, bool &inItem);
+
+    ////
+    /// Build the width and height attributes of a stored image, and the
+    /// srcset and sizes attributes too if it has downscaled copies
+    /// \param url Image URL
+    /// \return The attributes with a leading space, or an empty string if
+    ///     url isn't a stored image whose size is known
+    ////
+    std::string imageAttributes(const std::string &url);
+
     ////
     /// Render the site's front/index page
     ////
@@ -59,6 +91,13 @@ private:
     void buildArchive();
     void buildArticlePage();
     void processRequest();
+    boost::optional<std::string> getResourceVersion() override;
+    bool isPublicPage() const override;
+
+    void recycle() noexcept override
+    {
+        HandlerPool<PrimaryHandler>::release(this);
+    }
 
 public:
     PrimaryHandler(const Config &config) : HandlerBase(config) {};
@@ -0,0 +1,220 @@
+/*
+ * Copyright 2017-present Keith Mendoza
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <scoped_allocator>
+#include <string>
+#include <tuple>
+#include <utility>
+
+#include <folly/Range.h>
+
+#include "gtest/gtest_prod.h"
+
+namespace mimeographer
+{
+
+////
+/// Bump allocator for memory that lives exactly as long as one request.
+/// Allocations are carved out of an inline block first, then out of heap
+/// blocks that double in size. Nothing is given back until the arena is
+/// destroyed, when every block goes at once. Not thread safe; a request is
+/// only ever handled on its EventBase thread.
+////
+class RequestArena
+{
+    FRIEND_TEST(RequestArenaTest, allocate);
+    FRIEND_TEST(RequestArenaTest, largeAllocation);
+    FRIEND_TEST(RequestArenaTest, reset);
+
+private:
+    struct Block
+    {
+        Block *next;
+        size_t size;
+    };
+
+    static constexpr size_t inlineSize = 2048;
+    static constexpr size_t minBlockSize = 8192;
+    static constexpr size_t maxBlockSize = 65536;
+
+    alignas(std::max_align_t) char inlineBlock[inlineSize];
+    char *pos = inlineBlock;
+    char *end = inlineBlock + inlineSize;
+
+    // Heap blocks, newest first. current is the one pos points into, if
+    // it's not the inline block. spare is a block kept by reset() for the
+    // next request
+    Block *blocks = nullptr;
+    Block *current = nullptr;
+    Block *spare = nullptr;
+    size_t nextBlockSize = minBlockSize;
+    size_t allocated = 0;
+
+    ////
+    /// Get a new heap block for an allocation that didn't fit in the current
+    /// one. Allocations bigger than a quarter of a block get a block of
+    /// their own so the current block isn't wasted
+    ////
+    void *allocateSlow(size_t size, size_t align);
+
+public:
+    RequestArena() = default;
+    ~RequestArena();
+
+    RequestArena(const RequestArena &) = delete;
+    RequestArena &operator=(const RequestArena &) = delete;
+
+    ////
+    /// Allocate memory from the arena
+    /// \param size Number of bytes
+    /// \param align Alignment, a power of 2
+    /// \throw std::bad_alloc if a new block can't be allocated
+    ////
+    inline void *allocate(size_t size, size_t align)
+    {
+        auto start = reinterpret_cast<char *>(
+            (reinterpret_cast<uintptr_t>(pos) + align - 1) & ~(align - 1));
+        if(start > end || size > static_cast<size_t>(end - start))
+            return allocateSlow(size, align);
+
+        pos = start + size;
+        allocated += size;
+        return start;
+    }
+
+    ////
+    /// Free everything allocated so far so the arena can serve another
+    /// request. Containers using the arena must be emptied first. The
+    /// block in use is kept for the next allocations that spill out of the
+    /// inline block
+    ////
+    void reset() noexcept;
+
+    ////
+    /// Bytes handed out so far
+    ////
+    inline size_t getAllocated() const
+    {
+        return allocated;
+    }
+};
+
+////
+/// Standard allocator drawing from a RequestArena. deallocate() is a no-op;
+/// the memory goes when the arena does. A default constructed allocator
+/// isn't tied to an arena and uses the heap, so temporaries built without
+/// one still work.
+////
+template <class T>
+class ArenaAllocator
+{
+private:
+    RequestArena *arena_ = nullptr;
+
+    template <class U>
+    friend class ArenaAllocator;
+
+public:
+    typedef T value_type;
+
+    ArenaAllocator() noexcept = default;
+
+    explicit ArenaAllocator(RequestArena &arena) noexcept : arena_(&arena)
+    {}
+
+    template <class U>
+    ArenaAllocator(const ArenaAllocator<U> &other) noexcept :
+        arena_(other.arena_)
+    {}
+
+    T *allocate(size_t n)
+    {
+        if(arena_)
+            return static_cast<T *>(arena_->allocate(n * sizeof(T),
+                alignof(T)));
+        return std::allocator<T>().allocate(n);
+    }
+
+    void deallocate(T *p, size_t n) noexcept
+    {
+        if(!arena_)
+            std::allocator<T>().deallocate(p, n);
+    }
+
+    template <class U>
+    bool operator==(const ArenaAllocator<U> &other) const noexcept
+    {
+        return arena_ == other.arena_;
+    }
+
+    template <class U>
+    bool operator!=(const ArenaAllocator<U> &other) const noexcept
+    {
+        return arena_ != other.arena_;
+    }
+};
+
+typedef std::basic_string<char, std::char_traits<char>, ArenaAllocator<char>>
+    ArenaString;
+
+////
+/// Ordering for ArenaMap keys. Works across string types so lookups don't
+/// have to build an ArenaString
+////
+struct ArenaLess
+{
+    typedef void is_transparent;
+
+    template <class A, class B>
+    bool operator()(const A &a, const B &b) const
+    {
+        return folly::StringPiece(a.data(), a.size()) <
+            folly::StringPiece(b.data(), b.size());
+    }
+};
+
+////
+/// std::map whose nodes come from an arena. ArenaString keys and values
+/// are put in the same arena as the map
+////
+template <class K, class V>
+using ArenaMap = std::map<K, V, ArenaLess,
+    std::scoped_allocator_adaptor<ArenaAllocator<std::pair<const K, V>>>>;
+
+////
+/// Get the value for key in an ArenaMap with ArenaString keys, adding a
+/// default constructed one if it's not there. Unlike operator[] this
+/// doesn't build a key on the heap first
+////
+template <class V>
+V &findOrInsert(ArenaMap<ArenaString, V> &map, folly::StringPiece key)
+{
+    auto entry = map.find(key);
+    if(entry == map.end())
+    {
+        entry = map.emplace(std::piecewise_construct,
+            std::forward_as_tuple(key.data(), key.size()),
+            std::forward_as_tuple()).first;
+    }
+    return entry->second;
+}
+
+}
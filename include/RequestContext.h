@@ -0,0 +1,130 @@
+/*
+ * Copyright 2017-present Keith Mendoza
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#pragma once
+
+#include <utility>
+
+#include <boost/optional.hpp>
+#include <folly/Range.h>
+#include <folly/small_vector.h>
+#include <proxygen/lib/http/HTTPMessage.h>
+
+#include "gtest/gtest_prod.h"
+
+namespace mimeographer
+{
+
+////
+/// The parts of a request the handlers look things up in: path, query
+/// string and cookies. Everything is parsed once, when the request comes in,
+/// into views over the HTTPMessage's own storage. Nothing is copied or
+/// written to, so the HTTPMessage has to outlive the context. Lookups are a
+/// linear scan of a small inline vector, which beats a map for the handful
+/// of cookies and params a request carries.
+////
+class RequestContext
+{
+    FRIEND_TEST(RequestContextTest, parseCookies);
+    FRIEND_TEST(RequestContextTest, parseQuery);
+
+public:
+    typedef std::pair<folly::StringPiece, folly::StringPiece> Field;
+    typedef folly::small_vector<Field, 8> Fields;
+
+private:
+    folly::StringPiece path;
+    folly::StringPiece query;
+    Fields cookies;
+    Fields queryParams;
+
+    ////
+    /// Add the name/value pairs of a Cookie header value to fields. Values
+    /// can contain '='; surrounding double quotes are dropped
+    /// \param header Cookie header value
+    /// \param fields Where to add the cookies
+    ////
+    static void parseCookies(folly::StringPiece header, Fields &fields);
+
+    ////
+    /// Add the params of a query string to fields. Names and values are
+    /// left URL-encoded
+    /// \param query Query string without the '?'
+    /// \param fields Where to add the params
+    ////
+    static void parseQuery(folly::StringPiece query, Fields &fields);
+
+    static boost::optional<folly::StringPiece> find(const Fields &fields,
+        folly::StringPiece name);
+
+public:
+    RequestContext() = default;
+
+    explicit RequestContext(const proxygen::HTTPMessage &message)
+    {
+        parse(message);
+    }
+
+    ////
+    /// Parse a request, replacing whatever was parsed before
+    /// \param message Request headers, which have to outlive the context
+    ////
+    void parse(const proxygen::HTTPMessage &message);
+
+    ////
+    /// Forget the request
+    ////
+    void clear();
+
+    inline folly::StringPiece getPath() const
+    {
+        return path;
+    }
+
+    inline folly::StringPiece getQueryString() const
+    {
+        return query;
+    }
+
+    ////
+    /// Get a cookie sent with the request
+    /// \param name Cookie name
+    /// \return boost::none if there's no such cookie. If the request has it
+    ///     more than once, the first one
+    ////
+    inline boost::optional<folly::StringPiece> getCookie(
+        folly::StringPiece name) const
+    {
+        return find(cookies, name);
+    }
+
+    ////
+    /// Get a query string param
+    /// \param name Param name, URL-encoded as it is in the query string
+    /// \return The URL-encoded value, boost::none if there's no such param
+    ////
+    inline boost::optional<folly::StringPiece> getQueryParam(
+        folly::StringPiece name) const
+    {
+        return find(queryParams, name);
+    }
+
+    inline const Fields &getCookies() const
+    {
+        return cookies;
+    }
+};
+
+}
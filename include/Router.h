@@ -0,0 +1,210 @@
+/*
+ * Copyright 2017-present Keith Mendoza
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <initializer_list>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <boost/optional.hpp>
+#include <folly/Range.h>
+
+#include "gtest/gtest_prod.h"
+
+namespace mimeographer
+{
+
+////
+/// Pages the server knows about. The factory picks the handler from the
+/// route and the handler dispatches on it, so neither has to look at the
+/// path again
+////
+enum class Route
+{
+    NOT_FOUND,
+
+    FRONT_PAGE,
+    ARCHIVES,
+    ARTICLE,
+
+    EDIT_HOME,
+    EDIT_NEW,
+    EDIT_SAVE_ARTICLE,
+    EDIT_ARTICLE_LIST,
+    EDIT_ARTICLE,
+    EDIT_UPLOAD,
+    EDIT_VIEW_UPLOAD,
+    EDIT_UNKNOWN,
+
+    USER_LOGIN,
+    USER_LOGOUT,
+    USER_CHANGE_PASS,
+    USER_ADD,
+    USER_UNKNOWN,
+
+    STATIC_FILE,
+    UPLOAD_FILE,
+    FAVICON
+};
+
+enum class RouteHandler
+{
+    PRIMARY,
+    EDIT,
+    USER,
+    STATIC
+};
+
+////
+/// Result of Router::match(). Param names and values are views into the
+/// route table and the request path, so the match is only good for as
+/// long as the HTTPMessage it came from
+////
+struct RouteMatch
+{
+    struct Param
+    {
+        folly::StringPiece name;
+        folly::StringPiece value;
+        int64_t intValue;
+    };
+
+    static constexpr size_t maxParams = 4;
+
+    Route route = Route::NOT_FOUND;
+    RouteHandler handler = RouteHandler::PRIMARY;
+    std::array<Param, maxParams> params;
+    size_t paramCount = 0;
+
+    ////
+    /// Get a captured param's text
+    /// \param name Param name as written in the route pattern
+    /// \return boost::none if the route has no such param
+    ////
+    boost::optional<folly::StringPiece> param(folly::StringPiece name) const;
+
+    ////
+    /// Get the value of an {name:int} param
+    /// \param name Param name as written in the route pattern
+    /// \return boost::none if the route has no such param
+    ////
+    boost::optional<int64_t> intParam(folly::StringPiece name) const;
+};
+
+////
+/// Path to route lookup. Route patterns are compiled into a trie of path
+/// segments once at startup; a segment is either literal text or a typed
+/// capture:
+///     {name:int}  Decimal digits only
+///     {name}      Any non-empty segment
+///     {name:*}    The rest of the path, slashes and all. Must be last
+/// Literal segments win over captures, and int over plain over rest
+/// captures. If a more specific branch fails further down the path the
+/// lookup backs up and tries the next one. A single trailing slash is
+/// ignored. Matching doesn't allocate or throw.
+////
+class Router
+{
+    FRIEND_TEST(RouterTest, parseInt);
+
+public:
+    struct Definition
+    {
+        const char *pattern;
+        Route route;
+        RouteHandler handler;
+    };
+
+private:
+    struct Node
+    {
+        std::vector<std::pair<std::string, std::unique_ptr<Node>>> literals;
+        std::unique_ptr<Node> intChild;
+        std::unique_ptr<Node> stringChild;
+        std::unique_ptr<Node> restChild;
+
+        // Capture name when this is a param node
+        std::string param;
+
+        bool terminal = false;
+        Route route = Route::NOT_FOUND;
+        RouteHandler handler = RouteHandler::PRIMARY;
+    };
+
+    Node root;
+
+    ////
+    /// Add a route pattern to the trie
+    /// \throw std::invalid_argument if the pattern is malformed or is
+    ///     already in the trie
+    ////
+    void add(const Definition &definition);
+
+    ////
+    /// Get the param child of node for a {...} segment, creating it if
+    /// needed
+    ////
+    Node &addParam(Node &node, folly::StringPiece segment, bool last);
+
+    ////
+    /// Parse a whole segment as a non-negative decimal integer
+    /// \param segment Segment text
+    /// \param value Set to the parsed value on success
+    /// \return false if segment isn't all digits or would overflow
+    ////
+    static bool parseInt(folly::StringPiece segment, int64_t &value)
+        noexcept;
+
+    ////
+    /// Match the rest of the path against node's children
+    /// \param node Trie node that matched the path up to rest
+    /// \param rest Unmatched part of the path, starting with '/' unless
+    ///     it's empty
+    /// \param result Filled in on success
+    ////
+    bool matchNode(const Node &node, folly::StringPiece rest,
+        RouteMatch &result) const noexcept;
+
+public:
+    ////
+    /// Compile a route table
+    /// \throw std::invalid_argument on a malformed or duplicate pattern
+    ////
+    explicit Router(std::initializer_list<Definition> routes);
+
+    Router(const Router &) = delete;
+    Router &operator=(const Router &) = delete;
+
+    ////
+    /// Find the route for a request path
+    /// \param path Request path without the query string. Must outlive the
+    ///     returned RouteMatch
+    /// \return Route::NOT_FOUND with the PRIMARY handler if nothing matched
+    ////
+    RouteMatch match(folly::StringPiece path) const noexcept;
+
+    ////
+    /// The site's route table
+    ////
+    static const Router &site();
+};
+
+}
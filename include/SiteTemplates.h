@@ -33,11 +33,25 @@ class SiteTemplates
 
 private:
     static std::map<std::string, std::string> templateItems;
+    static std::string templateVersion;
 
 public:
     static void init(const Config &config);
 
     static const std::string &getTemplate(const std::string &name);
+
+    ////
+    /// Digest of all the loaded templates. Changes whenever any template's
+    /// content changes, so it can be folded into page ETags
+    ////
+    static const std::string &getVersion();
+
+    ////
+    /// Page header, navigation bar and content opening of a page
+    /// \param authenticated true to show the editor menu instead of the
+    ///     login link
+    ////
+    static std::string buildPageHeader(bool authenticated);
 };
 
 }
@@ -15,40 +15,213 @@
  */
 #pragma once
 
+#include <sys/stat.h>
+#include <ctime>
+#include <utility>
+#include <vector>
+
+#include <boost/optional.hpp>
 #include <folly/Memory.h>
 #include <folly/File.h>
+#include <proxygen/httpserver/RequestHandler.h>
+#include <proxygen/httpserver/ResponseBuilder.h>
+
+#include "gtest/gtest_prod.h"
 
-#include "HandlerBase.h"
+#include "Config.h"
+#include "HandlerPool.h"
+#include "Router.h"
 
 namespace mimeographer 
 {
 
-class StaticHandler : public HandlerBase 
+////
+/// Serves /static, /uploads and the favicon. Static requests don't need to
+/// know who the user is, so unlike the HandlerBase handlers this one never
+/// connects to the database or looks at the session
+////
+class StaticHandler : public proxygen::RequestHandler
 {
     FRIEND_TEST(StaticHandlerTest, parsePath);
+    FRIEND_TEST(StaticHandlerTest, parseRange);
+    FRIEND_TEST(StaticHandlerTest, notModified);
+    FRIEND_TEST(StaticHandlerTest, findSidecar);
 
 private:
-    std::unique_ptr<folly::File> file_;
+    const Config &config;
+    RouteMatch route_;
+
+    // Shared with FdCache and other requests for the same file
+    std::shared_ptr<folly::File> file_;
     bool readFileScheduled_{false};
-    std::atomic<bool> paused_{false};
+    bool paused_{false};
     bool finished_{false};
     std::string fileName;
 
-    void readFile(folly::EventBase* evb);
+    // stat() info of fileName when the request came in
+    struct stat fileInfo_;
+    std::string contentType_, etag_;
+    bool upload_{false};
+
+    // Hash of an upload in UploadStore, which is its ETag
+    std::string contentHash_;
+
+    // Content-Encoding of the precompressed sidecar being sent instead of
+    // the requested file, if any. varyEncoding_ is set for every file that
+    // could have a sidecar
+    std::string contentEncoding_;
+    bool varyEncoding_{false};
+
+    // Set when the file is small enough to go into FileCache once read
+    bool cacheFill_{false};
+    std::string cacheCopy_;
+
+    ////
+    /// Piece of the response body: prefix followed by length bytes of the
+    /// file starting at offset. Whole-file responses are a single segment
+    /// with no prefix; multipart/byteranges ones use prefix for the part
+    /// boundaries and headers
+    ////
+    struct Segment
+    {
+        std::string prefix;
+        off_t offset;
+        off_t length;
+    };
+    std::vector<Segment> segments_;
+    size_t segment_{0};
+    off_t segmentOffset_{0};
+    bool prefixSent_{false};
+
+    // Set when the file is sent straight out of an mmap()ed region
+    std::unique_ptr<folly::IOBuf> mapped_;
+
+    ////
+    /// Send out segment prefixes and start the read of the next piece of
+    /// the file, until egress is paused, a read is in flight or the whole
+    /// response is sent
+    ////
+    void readNext();
+
+    ////
+    /// Send the piece of the file that was read and carry on with the next
+    /// \param data Data read
+    /// \param err errno of a failed read, 0 otherwise
+    ////
+    void onRead(std::unique_ptr<folly::IOBuf> data, int err);
+
+    ////
+    /// Map file_ into memory so the body can be sent without reading it
+    /// through a userspace buffer. file_ is closed on success. Only uploads
+    /// stored by their hash are mapped, and not those being added to the
+    /// file cache
+    /// \return true if the file is mapped
+    ////
+    bool mapFile();
+
+    ////
+    /// Send slices of the mapped file until egress is paused or the whole
+    /// file is sent
+    ////
+    void sendMapped();
     bool checkForCompletion();
-    std::string parsePath(const std::string &path);
 
-    std::string findMimeType(const std::string &fileName);
+    ////
+    /// Decode a URL-encoded path
+    /// \param path Path as sent by the client
+    /// \throw HandlerError 400 if a %-escape is malformed or the path has a
+    ///     NUL in it, or 404 if it has a ".." segment
+    ////
+    static std::string parsePath(folly::StringPiece path);
+
+    ////
+    /// Set the response status and content headers and fill segments_
+    /// according to the request's Range and If-Range headers. Sends the
+    /// 416 response itself when none of the ranges can be satisfied
+    /// \param headers Request headers
+    /// \param builder ResponseBuilder for the response headers
+    /// \return false if the response was already sent
+    ////
+    bool planBody(const proxygen::HTTPMessage &headers,
+        proxygen::ResponseBuilder &builder);
+
+    ////
+    /// List of offset/length pairs
+    ////
+    typedef std::vector<std::pair<off_t, off_t>> ByteRanges;
+
+    ////
+    /// Parse a Range header value
+    /// \param range Range header value
+    /// \param size Size of the file
+    /// \return boost::none if the header should be ignored, an empty list if
+    ///     none of the ranges can be satisfied
+    ////
+    static boost::optional<ByteRanges> parseRange(const std::string &range,
+        off_t size);
+
+    ////
+    /// Format time for Last-Modified and similar headers
+    ////
+    static std::string httpDate(time_t time);
+
+    ////
+    /// Add ETag, Last-Modified and Cache-Control for the file
+    /// \param builder ResponseBuilder to add the headers to
+    ////
+    void addCacheHeaders(proxygen::ResponseBuilder &builder);
+
+    ////
+    /// Check the request's If-None-Match, or If-Modified-Since if there's no
+    /// If-None-Match, against the file
+    /// \param headers Request headers
+    /// \return true if the client's copy is still good
+    ////
+    bool notModified(const proxygen::HTTPMessage &headers) const;
+
+    ////
+    /// Switch fileName, file_ and fileInfo_ over to a .br or .gz copy of
+    /// the file if the client accepts that encoding and the copy isn't
+    /// older than the file
+    /// \param acceptEncoding Request's Accept-Encoding header value
+    ////
+    void findSidecar(const std::string &acceptEncoding);
+
+    ////
+    /// Send an error page. The page is rendered as for an anonymous user
+    /// since the session isn't looked up
+    /// \param code HTTP status code
+    /// \param status HTTP status text
+    /// \param msg Message to show on the page
+    ////
+    void sendErrorPage(int code, const std::string &status,
+        const std::string &msg);
 
 public:
-    StaticHandler(const Config &config) : HandlerBase(config) {}
+    StaticHandler(const Config &config) : config(config) {}
+
+    ////
+    /// Set the route the factory matched for this request. Its params point
+    /// into the request's HTTPMessage
+    ////
+    void setRoute(const RouteMatch &match)
+    {
+        route_ = match;
+    }
+
     void onBody(std::unique_ptr<folly::IOBuf> body) noexcept override {}
     void onEOM() noexcept override {}
     void onUpgrade(proxygen::UpgradeProtocol proto) noexcept override {}
-    void processRequest(){}
 
     void onRequest(std::unique_ptr<proxygen::HTTPMessage> headers)
         noexcept override;
+
+    ////
+    /// Put the handler back in the state of a new one so HandlerPool can
+    /// give it to another request
+    /// \return true, there's nothing that can go bad between requests
+    ////
+    bool reset() noexcept;
     void requestComplete() noexcept override;
     void onError(proxygen::ProxygenError err) noexcept override;
     void onEgressPaused() noexcept override;
@@ -0,0 +1,64 @@
+/*
+ * Copyright 2017-present Keith Mendoza
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#pragma once
+
+#include <mutex>
+#include <unordered_map>
+
+#include "gtest/gtest_prod.h"
+
+#include "Config.h"
+
+namespace mimeographer
+{
+
+////
+/// Count of the uploads each user has in progress across all the I/O
+/// threads, so one user sending a pile of files at once can't tie up the
+/// disk for everyone else. A request takes a slot before any of its upload
+/// is written and gives it back when the request is done.
+////
+class UploadLimiter
+{
+    FRIEND_TEST(UploadLimiterTest, acquire);
+
+private:
+    static std::mutex lock;
+    static std::unordered_map<int, unsigned int> active;
+    static unsigned int perUser;
+
+public:
+    ////
+    /// Set how many uploads a user can have going at once
+    ////
+    static void init(const Config &config);
+
+    ////
+    /// Take an upload slot for a user
+    /// \param userId User uploading
+    /// \return false if the user already has as many uploads going as they
+    ///     are allowed
+    ////
+    static bool acquire(int userId);
+
+    ////
+    /// Give back a slot taken by acquire()
+    /// \param userId User whose upload is done
+    ////
+    static void release(int userId);
+};
+
+}
@@ -0,0 +1,126 @@
+/*
+ * Copyright 2017-present Keith Mendoza
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+#include <boost/optional.hpp>
+#include <folly/Range.h>
+
+#include "gtest/gtest_prod.h"
+
+#include "DBConn.h"
+
+namespace mimeographer
+{
+
+////
+/// Uploads are stored by content. An upload's file is named after the
+/// SHA-256 of what's in it, under a directory named after the first two hex
+/// digits of the hash, and keeps the extension it was uploaded with so its
+/// MIME type can still be told from the name. The same file uploaded again
+/// isn't stored again; the upload_blob table counts the uploads sharing
+/// each stored file. Since a stored file never changes, its hash is also
+/// its ETag. Downscaled copies of an image are kept next to it.
+////
+class UploadStore
+{
+    FRIEND_TEST(UploadStoreTest, blobPath);
+    FRIEND_TEST(UploadStoreTest, variantPath);
+
+private:
+    ////
+    /// Path of the stored file for an upload, relative to uploadDest
+    /// \param sha256 Hex SHA-256 of the upload
+    /// \param filename Name the upload was sent with
+    ////
+    static std::string blobPath(folly::StringPiece sha256,
+        folly::StringPiece filename);
+
+    ////
+    /// Split a stored file's path into its hash and what comes after it
+    /// \param path Upload path relative to uploadDest
+    /// \param rest Gets what comes after the hash
+    /// \return The hex SHA-256, or an empty range if path doesn't start
+    ///     like a stored file's path
+    ////
+    static folly::StringPiece splitBlobPath(folly::StringPiece path,
+        folly::StringPiece &rest);
+
+    ////
+    /// Check that a name ends with nothing or a plain extension
+    ////
+    static bool isExtension(folly::StringPiece rest);
+
+public:
+    ////
+    /// Hex-encode a hash
+    ////
+    static std::string hex(folly::ByteRange hash);
+
+    ////
+    /// Get the hash a stored file is named after
+    /// \param path Upload path relative to uploadDest
+    /// \return The hex SHA-256, or an empty range if path isn't a stored
+    ///     file's path
+    ////
+    static folly::StringPiece blobHash(folly::StringPiece path);
+
+    ////
+    /// Path of a downscaled copy of a stored image, which is the image's
+    /// path with the width put in before the extension
+    /// \param path Stored image path relative to uploadDest
+    /// \param width Width of the copy
+    ////
+    static std::string variantPath(folly::StringPiece path,
+        unsigned int width);
+
+    ////
+    /// Check whether a path is one variantPath() makes
+    /// \param path Upload path relative to uploadDest
+    ////
+    static bool isVariant(folly::StringPiece path);
+
+    ////
+    /// Move a received upload to its place in the store, or drop it if the
+    /// store already has the same file, and add it to the upload index
+    /// \param db Connection to count and index the upload with
+    /// \param uploadDest Base directory of the uploads
+    /// \param tempFile Where the upload was saved while it came in
+    /// \param sha256 Hex SHA-256 of the upload
+    /// \param filename Name the upload was sent with
+    /// \param size Size of the upload
+    /// \param userId Uploader
+    /// \return Path of the stored file relative to uploadDest, or
+    ///     boost::none if the upload couldn't be moved into place
+    ////
+    static boost::optional<std::string> store(DBConn &db,
+        const std::string &uploadDest, const std::string &tempFile,
+        const std::string &sha256, const std::string &filename,
+        uint64_t size, const boost::optional<int> &userId);
+
+    ////
+    /// Add the files in uploadDest that aren't in the upload index yet,
+    /// such as the ones uploaded before there was an index
+    /// \param db Connection to index the files with
+    /// \param uploadDest Base directory of the uploads
+    /// \return Number of files added, or -1 if uploadDest couldn't be read
+    ////
+    static long backfill(DBConn &db, const std::string &uploadDest);
+};
+
+}
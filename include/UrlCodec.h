@@ -0,0 +1,115 @@
+/*
+ * Copyright 2017-present Keith Mendoza
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+#include <folly/Range.h>
+
+#include "gtest/gtest_prod.h"
+
+namespace mimeographer
+{
+
+////
+/// Percent-encoding and decoding of URL components. The work is in
+/// finding where the next character that needs attention is, so that's
+/// done 16 bytes at a time with SSE2, or 32 with AVX2 when the CPU has it,
+/// and everything in between is copied in one go. The kernel to use is
+/// picked once at startup. Malformed input is reported through the return
+/// value; nothing here throws.
+////
+class UrlCodec
+{
+    FRIEND_TEST(UrlCodecTest, kernels);
+    FRIEND_TEST(UrlCodecTest, hexValue);
+
+private:
+    ////
+    /// Scans a buffer and returns the length of the leading run of bytes
+    /// that don't need any work
+    ////
+    typedef size_t (*Kernel)(const char *data, size_t size);
+
+    // Run up to the first '%' or '+', for decode()
+    static size_t plainRunScalar(const char *data, size_t size);
+
+    // Run of unreserved characters (RFC 3986 ALPHA, DIGIT, '-', '.', '_',
+    // '~'), for encode()
+    static size_t unreservedRunScalar(const char *data, size_t size);
+
+#if defined(__x86_64__) || defined(__i386__)
+#define MIMEOGRAPHER_URLCODEC_X86
+    static size_t plainRunSse2(const char *data, size_t size);
+    static size_t plainRunAvx2(const char *data, size_t size);
+    static size_t unreservedRunSse2(const char *data, size_t size);
+    static size_t unreservedRunAvx2(const char *data, size_t size);
+#endif
+
+    static const Kernel plainRun;
+    static const Kernel unreservedRun;
+
+    ////
+    /// Pick the best kernel the CPU supports
+    ////
+    static Kernel pickPlainRun();
+    static Kernel pickUnreservedRun();
+
+    ////
+    /// Value of a hex digit, -1 if c isn't one
+    ////
+    static inline int hexValue(char c)
+    {
+        if(c >= '0' && c <= '9')
+            return c - '0';
+        else if(c >= 'a' && c <= 'f')
+            return c - 'a' + 10;
+        else if(c >= 'A' && c <= 'F')
+            return c - 'A' + 10;
+        return -1;
+    }
+
+public:
+    ////
+    /// Decode %XX escapes, and '+' if plusIsSpace
+    /// \param in Encoded text
+    /// \param out Decoded text is appended to this. On failure it holds
+    ///     whatever was decoded before the bad escape
+    /// \param plusIsSpace Decode '+' as a space, as in form data and
+    ///     query strings
+    /// \return false if in has a % that isn't followed by 2 hex digits
+    ////
+    static bool decode(folly::StringPiece in, std::string &out,
+        bool plusIsSpace = true);
+
+    ////
+    /// %XX-escape everything but the unreserved characters, with upper
+    /// case hex digits
+    /// \param in Text to encode
+    /// \param out Encoded text is appended to this
+    ////
+    static void encode(folly::StringPiece in, std::string &out);
+
+    static std::string encode(folly::StringPiece in)
+    {
+        std::string retVal;
+        encode(in, retVal);
+        return retVal;
+    }
+};
+
+}
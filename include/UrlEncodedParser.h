@@ -0,0 +1,145 @@
+/*
+ * Copyright 2017-present Keith Mendoza
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+
+#include <folly/Range.h>
+#include <folly/io/IOBuf.h>
+
+#include "gtest/gtest_prod.h"
+
+namespace mimeographer
+{
+
+////
+/// Streaming parser for application/x-www-form-urlencoded request bodies.
+/// Each body chunk is decoded straight into the name and value of the field
+/// being read, so the body is never joined or copied whole. An escape split
+/// across chunks is held back until the rest of it comes in. Once the body
+/// goes over maxSize or has more than maxParams fields, parsing stops and
+/// the rest of the body is ignored.
+////
+class UrlEncodedParser
+{
+    FRIEND_TEST(UrlEncodedParserTest, parse);
+    FRIEND_TEST(UrlEncodedParserTest, splitChunks);
+    FRIEND_TEST(UrlEncodedParserTest, malformed);
+    FRIEND_TEST(UrlEncodedParserTest, limits);
+
+public:
+    class Callback
+    {
+    public:
+        virtual ~Callback() {}
+
+        ////
+        /// Called for each field once it's complete
+        /// \param name Decoded field name
+        /// \param value Decoded field value
+        /// \param bytesProcessed Body bytes parsed so far
+        ////
+        virtual void onParam(const std::string &name,
+            const std::string &value, uint64_t bytesProcessed) = 0;
+
+        ////
+        /// Called once if the body is malformed or over the limits. No
+        /// onParam calls follow
+        ////
+        virtual void onError() = 0;
+    };
+
+private:
+    const size_t maxSize, maxParams;
+    Callback *callback = nullptr;
+
+    std::string name, value;
+    bool inValue = false;
+    char pending[3];
+    size_t pendingSize = 0;
+
+    uint64_t bytesProcessed = 0;
+    size_t paramCount = 0;
+    bool failed = false, overLimit = false;
+
+    ////
+    /// Parse a piece of the body. Calls onError() if it's malformed or over
+    /// the limits
+    ////
+    void parse(folly::StringPiece data);
+
+    ////
+    /// Decode data onto the name or value being read, holding back an
+    /// escape that data ends in the middle of
+    /// \return false if there's a malformed escape
+    ////
+    bool decodeInto(folly::StringPiece data, bool complete);
+
+    ////
+    /// Pass the field read so far to the callback and start the next one
+    /// \return false if that's one field too many
+    ////
+    bool endField();
+
+    ////
+    /// Stop parsing and let the callback know
+    /// \param limit true if the body went over the limits
+    ////
+    void fail(bool limit);
+
+public:
+    ////
+    /// \param maxSize Most body bytes to accept
+    /// \param maxParams Most fields to accept
+    ////
+    UrlEncodedParser(size_t maxSize, size_t maxParams) :
+        maxSize(maxSize), maxParams(maxParams)
+    {}
+
+    inline void setCallback(Callback *cb)
+    {
+        callback = cb;
+    }
+
+    ////
+    /// Parse the next chunk of the body
+    /// \param chain Body chunk, which can be a chain of buffers
+    ////
+    void onIngress(std::unique_ptr<folly::IOBuf> chain);
+
+    ////
+    /// End of the body. Passes on the last field
+    ////
+    void onIngressEOM();
+
+    ////
+    /// \return true if parsing stopped because the body went over the
+    ///     limits
+    ////
+    inline bool isOverLimit() const
+    {
+        return overLimit;
+    }
+
+    inline bool hasFailed() const
+    {
+        return failed;
+    }
+};
+
+}
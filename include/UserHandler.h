@@ -15,7 +15,6 @@
  */
 #pragma once
 
-#include <regex>
 #include <string>
 #include <exception>
 
@@ -23,6 +22,7 @@
 #include <proxygen/httpserver/ResponseBuilder.h>
 
 #include "HandlerBase.h"
+#include "HandlerPool.h"
 #include "UserSession.h"
 
 namespace mimeographer 
@@ -80,6 +80,11 @@ private:
 
     void processAddUser();
 
+    void recycle() noexcept override
+    {
+        HandlerPool<UserHandler>::release(this);
+    }
+
 public:
     UserHandler(const Config &config) : HandlerBase(config) {}
 
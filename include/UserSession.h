@@ -61,6 +61,16 @@ public:
     
     void initSession(const std::string &uuid = "");
 
+    ////
+    /// Forget the session so the object can be used for another request
+    ////
+    inline void reset()
+    {
+        uuid.clear();
+        userId = boost::none;
+        csrfkey.clear();
+    }
+
     inline const std::string &getUUID() const
     {
         return uuid;
@@ -15,12 +15,12 @@
  */
 #include <sstream>
 #include <cctype>
-#include <iomanip>
 #include <sstream>
 #include <stdexcept>
 #include <string>
 
 #include "DBConn.h"
+#include "UrlCodec.h"
 
 using namespace std;
 
@@ -31,24 +31,11 @@ const string DBConn::urlEncode(const string &str) const
 {
     VLOG(2) << "Start " << __PRETTY_FUNCTION__;
 
-    ostringstream buf;
-    buf.fill('0');
-    buf << hex;
-
-    for(unsigned char ch : str)
-    {
-        if(isalnum(ch) || ch == '-' || ch == '.' || ch ==  '_' || ch == '~')
-            buf << ch;
-        else
-            buf << '%' << uppercase << setw(2) << int(ch) << nouppercase;
-    }
-
-    VLOG(3) << "URL-encoded string to return: "
-        << buf.str();
+    auto retVal = UrlCodec::encode(str);
+    VLOG(3) << "URL-encoded string to return: " << retVal;
 
     VLOG(2) << "End " << __PRETTY_FUNCTION__;
-
-    return move(buf.str());
+    return retVal;
 }
 
 unique_ptr<PGresult, DBConn::PGresultCleaner>
@@ -177,15 +164,61 @@ DBConn::DBConn(const string &username, const string &password,
     VLOG(2) << "End " << __PRETTY_FUNCTION__;
 }
 
-DBConn::headline DBConn::getHeadlines() const
+bool DBConn::checkConnection() noexcept
 {
     VLOG(2) << "Start " << __PRETTY_FUNCTION__;
 
+    if(PQstatus(conn.get()) != CONNECTION_OK)
+    {
+        LOG(WARNING) << "DB connection lost: " << PQerrorMessage(conn.get());
+        PQreset(conn.get());
+        if(PQstatus(conn.get()) != CONNECTION_OK)
+        {
+            LOG(ERROR) << "Failed to reconnect to database: "
+                << PQerrorMessage(conn.get());
+
+            VLOG(2) << "End " << __PRETTY_FUNCTION__;
+            return false;
+        }
+        VLOG(1) << "DB connection reset";
+    }
+
+    // A transaction left open would carry over into the next request
+    auto transaction = PQtransactionStatus(conn.get());
+    if(transaction != PQTRANS_IDLE)
+    {
+        LOG(WARNING) << "DB connection not idle, transaction status "
+            << transaction;
+
+        VLOG(2) << "End " << __PRETTY_FUNCTION__;
+        return false;
+    }
+
+    VLOG(2) << "End " << __PRETTY_FUNCTION__;
+    return true;
+}
+
+DBConn::headline DBConn::getHeadlines(const boost::optional<int> &after,
+    const size_t &limit) const
+{
+    VLOG(2) << "Start " << __PRETTY_FUNCTION__;
+
+    // Paged by the position of the last article listed so every page is an
+    // index scan of limit rows. A NULL LIMIT gets all of them
     const static string query =
         "SELECT articleid, title, summary"
         " FROM article WHERE publishdate <= NOW()"
-        " ORDER BY publishdate DESC";
-    auto dbResult = execQuery(query);
+        " AND ($1::INT IS NULL OR (publishdate, articleid) <"
+            " (SELECT publishdate, articleid FROM article WHERE articleid = $1))"
+        " ORDER BY publishdate DESC, articleid DESC LIMIT $2::BIGINT";
+    auto afterId = after ? to_string(*after) : "";
+    auto limitStr = to_string(limit);
+    auto dbResult = execQuery(query,
+        array<const char *, 2>({
+            after ? afterId.c_str() : nullptr,
+            limit ? limitStr.c_str() : nullptr
+        })
+    );
     VLOG(1) << "Article query OK";
 
     auto rows = PQntuples(dbResult.get());
@@ -236,6 +269,79 @@ string DBConn::getArticle(const string &id) const
     return move(content);
 }
 
+boost::optional<string> DBConn::buildVersion(
+    unique_ptr<PGresult, PGresultCleaner> dbResult) const
+{
+    VLOG(2) << "Start " << __PRETTY_FUNCTION__;
+
+    boost::optional<string> retVal = boost::none;
+    if(PQntuples(dbResult.get()) < 1)
+        VLOG(1) << "No rows to build version from";
+    else
+    {
+        string version;
+        for(auto i=0; i<PQnfields(dbResult.get()); i++)
+        {
+            if(i)
+                version += ":";
+            version += string(PQgetvalue(dbResult.get(), 0, i),
+                PQgetlength(dbResult.get(), 0, i));
+        }
+        VLOG(3) << "Version: " << version;
+        retVal = version;
+    }
+
+    VLOG(2) << "End " << __PRETTY_FUNCTION__;
+    return retVal;
+}
+
+// The rendered article gets the size and variants of the uploaded images
+// it shows, which ImagePipeline fills in some time after the article is
+// saved
+const string DBConn::imagesVersion = "(SELECT MAX(processed) "
+    "FROM upload_blob WHERE sha256 IN (SELECT (regexp_matches(content, "
+        "'/uploads/[0-9a-f]{2}/([0-9a-f]{64})', 'g'))[1]))";
+
+boost::optional<string> DBConn::getArticleVersion(const string &id) const
+{
+    VLOG(2) << "Start " << __PRETTY_FUNCTION__;
+
+    const static string query = "SELECT articleid, savedate, "
+        + imagesVersion + " FROM article WHERE articleid=$1";
+    auto retVal = buildVersion(
+        execQuery(query, array<const char *,1>({ id.c_str() })));
+
+    VLOG(2) << "End " << __PRETTY_FUNCTION__;
+    return retVal;
+}
+
+boost::optional<string> DBConn::getLatestArticleVersion() const
+{
+    VLOG(2) << "Start " << __PRETTY_FUNCTION__;
+
+    const static string query = "SELECT articleid, savedate, "
+        + imagesVersion + " FROM article ORDER BY publishdate DESC LIMIT 1";
+    auto retVal = buildVersion(execQuery(query));
+
+    VLOG(2) << "End " << __PRETTY_FUNCTION__;
+    return retVal;
+}
+
+boost::optional<string> DBConn::getArchiveVersion() const
+{
+    VLOG(2) << "Start " << __PRETTY_FUNCTION__;
+
+    // Count catches deleted articles, publishdate catches scheduled ones
+    // going live
+    const static string query =
+        "SELECT COUNT(*), MAX(savedate), MAX(publishdate)"
+        " FROM article WHERE publishdate <= NOW()";
+    auto retVal = buildVersion(execQuery(query));
+
+    VLOG(2) << "End " << __PRETTY_FUNCTION__;
+    return retVal;
+}
+
 DBConn::UserRecord DBConn::getUserInfo(const std::string &email)
 {
     VLOG(2) << "Start " << __PRETTY_FUNCTION__;
@@ -501,4 +607,238 @@ void DBConn::addUser(const string &email, const string &newPass,
     VLOG(2) << "End " << __PRETTY_FUNCTION__;
 }
 
+string DBConn::addUploadBlob(const string &sha256, const string &path,
+    const uint64_t &size)
+{
+    VLOG(2) << "Start " << __PRETTY_FUNCTION__;
+    const string query = "INSERT INTO upload_blob(sha256, path, size) "
+        "VALUES ($1, $2, $3) ON CONFLICT (sha256) DO UPDATE "
+        "SET refcount = upload_blob.refcount + 1 RETURNING path, refcount";
+    auto dbRslt = execQuery(query,
+        array<const char *, 3>({
+            sha256.c_str(),
+            path.c_str(),
+            to_string(size).c_str()
+        })
+    );
+
+    if(PQntuples(dbRslt.get()) != 1)
+        throw DBError("Upload blob not returned");
+
+    string rslt(PQgetvalue(dbRslt.get(), 0, 0),
+        PQgetlength(dbRslt.get(), 0, 0));
+    VLOG(3) << "Blob " << sha256 << " stored as " << rslt << " with "
+        << PQgetvalue(dbRslt.get(), 0, 1) << " uploads";
+
+    VLOG(2) << "End " << __PRETTY_FUNCTION__;
+    return rslt;
+}
+
+int DBConn::addUpload(const string &path, const string &filename,
+    const string &sha256, const uint64_t &size,
+    const boost::optional<int> &userId)
+{
+    VLOG(2) << "Start " << __PRETTY_FUNCTION__;
+    const string query = "INSERT INTO upload(path, filename, sha256, size, "
+        "userid) VALUES ($1, $2, $3, $4, $5) RETURNING uploadid";
+    auto user = userId ? to_string(*userId) : "";
+    auto dbRslt = execQuery(query,
+        array<const char *, 5>({
+            path.c_str(),
+            filename.c_str(),
+            sha256.size() ? sha256.c_str() : nullptr,
+            to_string(size).c_str(),
+            userId ? user.c_str() : nullptr
+        })
+    );
+
+    if(PQntuples(dbRslt.get()) != 1)
+        throw DBError("Upload ID not returned");
+
+    size_t len = PQgetlength(dbRslt.get(), 0, 0);
+    int rslt = stoi(string(PQgetvalue(dbRslt.get(), 0, 0), len));
+    VLOG(3) << "New upload's ID: " << rslt;
+
+    VLOG(2) << "End " << __PRETTY_FUNCTION__;
+    return rslt;
+}
+
+bool DBConn::indexExistingUpload(const string &path, const string &sha256,
+    const uint64_t &size)
+{
+    VLOG(2) << "Start " << __PRETTY_FUNCTION__;
+    const string query = "INSERT INTO upload(path, filename, sha256, size) "
+        "SELECT $1, $2, $3, $4 "
+        "WHERE NOT EXISTS (SELECT 1 FROM upload WHERE path = $1)";
+    auto filename = path.substr(path.rfind('/') + 1);
+    auto dbRslt = execQuery(query,
+        array<const char *, 4>({
+            path.c_str(),
+            filename.c_str(),
+            sha256.size() ? sha256.c_str() : nullptr,
+            to_string(size).c_str()
+        })
+    );
+
+    bool rslt = string(PQcmdTuples(dbRslt.get())) == "1";
+    VLOG(1) << path << (rslt ? " added to" : " already in")
+        << " the upload index";
+
+    VLOG(2) << "End " << __PRETTY_FUNCTION__;
+    return rslt;
+}
+
+DBConn::UploadList DBConn::getUploads(const boost::optional<int> &before,
+    const size_t &limit) const
+{
+    VLOG(2) << "Start " << __PRETTY_FUNCTION__;
+
+    // Paging by ID instead of OFFSET keeps every page an index scan of
+    // limit rows, however far back it is
+    const static string query = "SELECT uploadid, path, "
+            "COALESCE((SELECT v.path FROM upload_variant v "
+                "WHERE v.sha256 = upload.sha256 ORDER BY v.width LIMIT 1), '') "
+        "FROM upload WHERE $1::INT IS NULL OR uploadid < $1 "
+        "ORDER BY uploadid DESC LIMIT $2";
+    auto beforeId = before ? to_string(*before) : "";
+    auto dbResult = execQuery(query,
+        array<const char *, 2>({
+            before ? beforeId.c_str() : nullptr,
+            to_string(limit).c_str()
+        })
+    );
+
+    auto rows = PQntuples(dbResult.get());
+    VLOG(1) << "Number of uploads found: " << rows;
+
+    UploadList retVal;
+    retVal.reserve(rows);
+    for(auto i=0; i<rows; i++)
+    {
+        auto len = PQgetlength(dbResult.get(), i, 0);
+        int id = stoi(string(PQgetvalue(dbResult.get(), i, 0), len));
+
+        len = PQgetlength(dbResult.get(), i, 1);
+        string path(PQgetvalue(dbResult.get(), i, 1), len);
+
+        len = PQgetlength(dbResult.get(), i, 2);
+        string thumbnail(PQgetvalue(dbResult.get(), i, 2), len);
+        VLOG(3) << "Upload " << id << ": " << path << " thumbnail: "
+            << thumbnail;
+
+        retVal.push_back(make_tuple(id, path, thumbnail));
+    }
+
+    VLOG(2) << "End " << __PRETTY_FUNCTION__;
+    return retVal;
+}
+
+void DBConn::setUploadDimensions(const string &sha256, const int &width,
+    const int &height)
+{
+    VLOG(2) << "Start " << __PRETTY_FUNCTION__;
+    const string query = "UPDATE upload_blob SET width = $2, height = $3, "
+        "processed = NOW() WHERE sha256 = $1";
+    execQuery(query,
+        array<const char *, 3>({
+            sha256.c_str(),
+            to_string(width).c_str(),
+            to_string(height).c_str()
+        })
+    );
+    VLOG(1) << "Image " << sha256 << " is " << width << "x" << height;
+
+    VLOG(2) << "End " << __PRETTY_FUNCTION__;
+}
+
+void DBConn::addUploadVariant(const string &sha256, const int &width,
+    const int &height, const string &path)
+{
+    VLOG(2) << "Start " << __PRETTY_FUNCTION__;
+    const string query = "WITH variant AS (INSERT INTO upload_variant("
+            "sha256, width, height, path) VALUES ($1, $2, $3, $4) "
+            "ON CONFLICT (sha256, width) DO UPDATE "
+            "SET height = EXCLUDED.height, path = EXCLUDED.path "
+            "RETURNING sha256) "
+        "UPDATE upload_blob SET processed = NOW() "
+        "WHERE sha256 IN (SELECT sha256 FROM variant)";
+    execQuery(query,
+        array<const char *, 4>({
+            sha256.c_str(),
+            to_string(width).c_str(),
+            to_string(height).c_str(),
+            path.c_str()
+        })
+    );
+    VLOG(1) << "Variant of " << sha256 << " saved as " << path;
+
+    VLOG(2) << "End " << __PRETTY_FUNCTION__;
+}
+
+DBConn::ImageVariantMap DBConn::getImageVariants(
+    const vector<string> &sha256s) const
+{
+    VLOG(2) << "Start " << __PRETTY_FUNCTION__;
+
+    ImageVariantMap retVal;
+    if(sha256s.empty())
+    {
+        VLOG(1) << "No images to look up";
+        VLOG(2) << "End " << __PRETTY_FUNCTION__;
+        return retVal;
+    }
+
+    // All the images of a page in one round trip. The hashes are hex, so
+    // they go in the array literal as is
+    string hashes = "{";
+    for(auto &i : sha256s)
+    {
+        if(hashes.size() > 1)
+            hashes += ",";
+        hashes += i;
+    }
+    hashes += "}";
+
+    const static string query = "SELECT b.sha256, b.width, b.height, "
+            "v.width, v.path "
+        "FROM upload_blob b LEFT JOIN upload_variant v "
+            "ON v.sha256 = b.sha256 "
+        "WHERE b.sha256 = ANY($1::CHAR(64)[]) AND b.width IS NOT NULL "
+        "ORDER BY b.sha256, v.width";
+    auto dbResult = execQuery(query,
+        array<const char *, 1>({ hashes.c_str() }));
+
+    auto rows = PQntuples(dbResult.get());
+    for(auto i=0; i<rows; i++)
+    {
+        auto len = PQgetlength(dbResult.get(), i, 0);
+        string sha256(PQgetvalue(dbResult.get(), i, 0), len);
+        auto found = retVal.find(sha256);
+        if(found == retVal.end())
+        {
+            ImageVariants image;
+            get<0>(image) = stoi(PQgetvalue(dbResult.get(), i, 1));
+            get<1>(image) = stoi(PQgetvalue(dbResult.get(), i, 2));
+            VLOG(3) << "Image " << sha256 << " is " << get<0>(image) << "x"
+                << get<1>(image);
+            found = retVal.emplace(sha256, move(image)).first;
+        }
+
+        // Without any variants there's still the one row with NULLs for them
+        if(PQgetisnull(dbResult.get(), i, 3))
+            continue;
+
+        int width = stoi(PQgetvalue(dbResult.get(), i, 3));
+        len = PQgetlength(dbResult.get(), i, 4);
+        string path(PQgetvalue(dbResult.get(), i, 4), len);
+        VLOG(3) << "Variant " << width << "w: " << path;
+
+        get<2>(found->second).push_back(make_tuple(width, path));
+    }
+    VLOG(1) << "Number of images with known sizes: " << retVal.size();
+
+    VLOG(2) << "End " << __PRETTY_FUNCTION__;
+    return retVal;
+}
+
 } // namespace
@@ -14,6 +14,10 @@
  * limitations under the License.
  */
 
+#include <cctype>
+#include <cerrno>
+#include <climits>
+#include <cstdlib>
 #include <string>
 #include <vector>
 
@@ -21,17 +25,16 @@
 
 #include <folly/io/IOBuf.h>
 
-#include <boost/filesystem.hpp>
-
 #include "EditHandler.h"
 #include "HandlerError.h"
 #include "HandlerRedirect.h"
 #include "SummaryBuilder.h"
+#include "UploadStore.h"
+#include "UrlCodec.h"
 
 using namespace std;
 using namespace proxygen;
 using namespace folly;
-using namespace boost::filesystem;
 
 namespace mimeographer 
 {
@@ -65,7 +68,7 @@ void EditHandler::buildEditor(const std::string &articleId)
 
     VLOG(1) << "Render editor";
     string page =
-        "<form method=\"post\" action=\"/edit/savearticle\" enctype=\"multipart/form-data\">\n"
+        "<form method=\"post\" action=\"/edit/savearticle\" enctype=\"application/x-www-form-urlencoded\">\n"
             "<input type=\"hidden\" name=\"csrf\" value=\"" + session.genCSRFKey() + "\">\n";
 
     if(articleId != "")
@@ -185,6 +188,7 @@ void EditHandler::buildEditSelect()
 
     VLOG(1) << "Build article list";
 
+    startStreaming();
     string data;
     for(auto article : db.getHeadlines())
     {
@@ -214,25 +218,20 @@ void EditHandler::processEditArticle()
 {
     VLOG(2) << "Start " << __PRETTY_FUNCTION__;
 
-    static regex parser("/edit/article/(\\d+)");
-    smatch match;
-    if(regex_match(getPath(), match, parser))
+    auto id = route.param("id");
+    if(route.route == Route::EDIT_ARTICLE && id)
     {
-        auto id = match[1];
-        VLOG(3) << "Article id: " << id.str();
-        buildEditor(id.str());
+        VLOG(3) << "Article id: " << id->str();
+        buildEditor(id->str());
     }
+    else if(route.route == Route::EDIT_ARTICLE_LIST)
+        buildEditSelect();
     else
     {
-        if(getPath() == "/edit/article")
-            buildEditSelect();
-        else
-        {
-            LOG(WARNING) << "Path didn't parse";
+        LOG(WARNING) << "Not an article route";
 
-            VLOG(2) << "End " <<  __PRETTY_FUNCTION__;
-            throw HandlerError(404, "File not found");
-        }
+        VLOG(2) << "End " <<  __PRETTY_FUNCTION__;
+        throw HandlerError(404, "File not found");
     }
 
     VLOG(2) << "End " <<  __PRETTY_FUNCTION__;
@@ -286,11 +285,17 @@ void EditHandler::processUpload()
             throw HandlerError(400, "Bad Request");
         }
 
-        string::size_type baseLen = config.uploadDest.size() -
-            (*(config.uploadDest.end()-1) == '/' ? 1 : 0);
-        VLOG(3) << "Value of baseLen: " << baseLen;
-        string displayPath = param->localFilename;
-        displayPath.replace(0, baseLen, "/uploads");
+        auto stored = UploadStore::store(db, config.uploadDest,
+            param->localFilename, param->sha256, param->filename,
+            param->size, session.getUserId());
+        if(!stored)
+        {
+            LOG(ERROR) << "Failed to store upload " << param->filename;
+            VLOG(2) << "End " << __PRETTY_FUNCTION__;
+            throw HandlerError(500, "Internal error");
+        }
+
+        string displayPath = "/uploads/" + *stored;
         string body = "<p>File uploaded and saved as " + displayPath + "</p>";
         prependResponse(body);
     }
@@ -304,61 +309,88 @@ void EditHandler::processUpload()
     VLOG(2) << "End " << __PRETTY_FUNCTION__;
 }
 
+string EditHandler::uploadUrl(const string &path)
+{
+    VLOG(2) << "Start " << __PRETTY_FUNCTION__;
+
+    string retVal = "/uploads";
+    StringPiece rest(path);
+    while(rest.size())
+    {
+        retVal += '/';
+        UrlCodec::encode(rest.split_step('/'), retVal);
+    }
+    VLOG(3) << "Upload URL: " << retVal;
+
+    VLOG(2) << "End " << __PRETTY_FUNCTION__;
+    return retVal;
+}
+
 void EditHandler::processViewUpload()
 {
     VLOG(2) << "Start " << __PRETTY_FUNCTION__;
-    string body = "<h1>Upload files</h1>";
-    prependResponse(body);
-    try
+
+    // Upload IDs are positive, and anything else in the param is an error
+    boost::optional<int> before;
+    auto param = getQueryParam("before");
+    if(param)
     {
-        string uploadDir = config.uploadDest + '/';
-        path p(uploadDir);
-        if(exists(p))
-        {
-            VLOG(1) << uploadDir << " exists";
-            if(is_directory(p))
-            {
-                VLOG(1) << uploadDir << " is a directory";
-                vector<string> fileList;
-                for(auto && f : directory_iterator(p))
-                {
-                    auto filename = f.path().filename().string();
-                    VLOG(3) << "Add file to vector: " << filename;
-                    fileList.push_back(filename);
-                }
-                sort(fileList.begin(), fileList.end());
-                body = "";
-                for(auto && x : fileList)
-                {
-                    auto displayPath = "/static/uploads/" + x;
-                    body += "<div class=\"row mb-3\">\n"
-                        "<div class=\"col-8\">"
-                            "<img class=\"img-fluid\" src=\""
-                                + displayPath + "\" /></div>\n"
-                        "<div class=\"col-4\"><p>" + displayPath + "</p></div>\n"
-                        "</div>\n";
-                }
-                prependResponse(body);
-            }
-            else
-            {
-                LOG(ERROR) << config.uploadDest << " is not a directory";
-                throw HandlerError(500, "Internal error");
-            }
-        }
-        else
+        char *end = nullptr;
+        errno = 0;
+        auto value = param->size() &&
+            isdigit(static_cast<unsigned char>(param->front())) ?
+            strtol(param->c_str(), &end, 10) : 0;
+        if(!end || *end || errno == ERANGE || value < 1 || value > INT_MAX)
         {
-            LOG(ERROR) << config.uploadDest << " does not exist";
-            throw HandlerError(500, "Internal error");
+            LOG(INFO) << "Bad before param " << *param;
+            VLOG(2) << "End " << __PRETTY_FUNCTION__;
+            throw HandlerError(400, "Bad Request");
         }
+        before = static_cast<int>(value);
     }
-    catch(const filesystem_error &e)
+
+    // One more than a page to tell whether there's another page after it
+    auto uploads = db.getUploads(before, config.uploadPageSize + 1);
+    bool more = uploads.size() > config.uploadPageSize;
+    if(more)
+        uploads.pop_back();
+    VLOG(1) << "Showing " << uploads.size() << " uploads";
+
+    // Images show their smallest downscaled copy if they have one, and
+    // the browser scales the rest down. Only the ones that scroll into view
+    // are loaded
+    string body = "<h1>Upload files</h1>\n<div class=\"row\">\n";
+    // Uploads from before they were content-addressed are named after
+    // what the user sent, so the names are escaped
+    for(auto &upload : uploads)
     {
-        LOG(ERROR) << "Exception encountered enumerating " << config.uploadDest
-            << ": " << e.what();
-        VLOG(2) << "End " << __PRETTY_FUNCTION__;
-        throw HandlerError(500, "Internal error");
+        auto url = uploadUrl(get<1>(upload));
+        auto thumbnail = get<2>(upload).size() ? uploadUrl(get<2>(upload)) :
+            url;
+        body += "<div class=\"col-6 col-md-3 mb-3\">"
+            "<a href=\"" + url + "\">"
+                "<img class=\"img-thumbnail\" src=\"" + thumbnail + "\" "
+                    "width=\"240\" height=\"180\" loading=\"lazy\" "
+                    "decoding=\"async\" style=\"object-fit:cover\" /></a>\n"
+            "<p class=\"small text-truncate\">"
+                + htmlEscape("/uploads/" + get<1>(upload)) + "</p>"
+            "</div>\n";
+    }
+    body += "</div>\n";
+
+    if(before || more)
+    {
+        body += "<nav><ul class=\"pagination\">\n";
+        if(before)
+            body += "<li class=\"page-item\"><a class=\"page-link\" "
+                "href=\"/edit/viewupload\">Newest</a></li>\n";
+        if(more)
+            body += "<li class=\"page-item\"><a class=\"page-link\" "
+                "href=\"/edit/viewupload?before="
+                + to_string(get<0>(uploads.back())) + "\">Older</a></li>\n";
+        body += "</ul></nav>\n";
     }
+    prependResponse(body);
 
     VLOG(2) << "End " << __PRETTY_FUNCTION__;
 }
@@ -367,9 +399,6 @@ void EditHandler::processRequest()
 {
     VLOG(2) << "Start " << __PRETTY_FUNCTION__;
 
-    auto path = getPath();
-    if(path.back() == '/')
-        path = path.substr(0,path.size()-1);
     auto sessionId = getCookie("session");
     VLOG(3) << "Value of session cookie: " << (sessionId ? *sessionId : "Not provided");
     if(!session.userAuthenticated())
@@ -384,21 +413,29 @@ void EditHandler::processRequest()
     }
     
     LOG(INFO) << "User is logged-in";
-    if(path == "/edit")
+    switch(route.route)
+    {
+    case Route::EDIT_HOME:
         buildMainPage();
-    else if(path == "/edit/new")
+        break;
+    case Route::EDIT_NEW:
         buildEditor();
-    else if(path == "/edit/savearticle")
+        break;
+    case Route::EDIT_SAVE_ARTICLE:
         processSaveArticle();
-    else if(path.substr(0, strlen("/edit/article")) == "/edit/article")
+        break;
+    case Route::EDIT_ARTICLE_LIST:
+    case Route::EDIT_ARTICLE:
         processEditArticle();
-    else if(path == "/edit/upload")
+        break;
+    case Route::EDIT_UPLOAD:
         processUpload();
-    else if(path == "/edit/viewupload")
+        break;
+    case Route::EDIT_VIEW_UPLOAD:
         processViewUpload();
-    else
-    {
-        LOG(INFO) << path << "not handled";
+        break;
+    default:
+        LOG(INFO) << getPath() << " not handled";
 
         VLOG(2) << "End " <<  __PRETTY_FUNCTION__;
         throw HandlerError(404, "File not found");
@@ -0,0 +1,332 @@
+/*
+ * Copyright 2017-present Keith Mendoza
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <cerrno>
+#include <cstring>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/inotify.h>
+
+#include <boost/filesystem.hpp>
+#include <glog/logging.h>
+#include <folly/FileUtil.h>
+
+#include "FdCache.h"
+
+using namespace std;
+
+namespace mimeographer
+{
+
+mutex FdCache::cacheLock;
+FdCache::EntryList FdCache::entries;
+unordered_map<string, FdCache::EntryList::iterator> FdCache::index;
+size_t FdCache::maxEntries = 0;
+atomic<uint64_t> FdCache::hits{0};
+atomic<uint64_t> FdCache::misses{0};
+uint64_t FdCache::generation = 0;
+unordered_map<int, string> FdCache::watches;
+unordered_map<string, int> FdCache::watchedDirs;
+int FdCache::inotifyFd = -1;
+
+static const uint32_t watchMask = IN_ATTRIB | IN_CLOSE_WRITE | IN_CREATE |
+    IN_DELETE | IN_DELETE_SELF | IN_MODIFY | IN_MOVE_SELF | IN_MOVED_FROM |
+    IN_MOVED_TO;
+
+void FdCache::init(const Config &config)
+{
+    VLOG(2) << "Start " << __PRETTY_FUNCTION__;
+
+    lock_guard<mutex> guard(cacheLock);
+    maxEntries = config.fdCacheEntries;
+    VLOG(1) << "Fd cache size: " << maxEntries;
+    evict();
+    if(!maxEntries)
+    {
+        VLOG(1) << "Fd cache disabled";
+        VLOG(2) << "End " << __PRETTY_FUNCTION__;
+        return;
+    }
+
+    if(inotifyFd < 0)
+    {
+        inotifyFd = inotify_init1(IN_CLOEXEC);
+        if(inotifyFd < 0)
+        {
+            int err = errno;
+            LOG(ERROR) << "Failed to start inotify, fd cache disabled. Cause: "
+                << strerror(err);
+            maxEntries = 0;
+            VLOG(2) << "End " << __PRETTY_FUNCTION__;
+            return;
+        }
+
+        // Runs for the life of the process
+        thread(watchChanges).detach();
+    }
+
+    addWatches(config.staticBase);
+    addWatches(config.uploadDest);
+
+    VLOG(2) << "End " << __PRETTY_FUNCTION__;
+}
+
+void FdCache::evict()
+{
+    VLOG(2) << "Start " << __PRETTY_FUNCTION__;
+
+    while(entries.size() > maxEntries)
+    {
+        VLOG(1) << "Evict fd of " << entries.back().first;
+        index.erase(entries.back().first);
+        entries.pop_back();
+    }
+
+    VLOG(2) << "End " << __PRETTY_FUNCTION__;
+}
+
+string FdCache::normalize(const string &path)
+{
+    vector<string> parts;
+    size_t start = 0;
+    while(start <= path.size())
+    {
+        auto end = path.find('/', start);
+        if(end == string::npos)
+            end = path.size();
+
+        auto part = path.substr(start, end - start);
+        if(part == "..")
+            return "";
+        else if(part.size() && part != ".")
+            parts.push_back(move(part));
+        start = end + 1;
+    }
+
+    string retVal = path.size() && path[0] == '/' ? "/" : "";
+    for(auto &part : parts)
+    {
+        if(retVal.size() && retVal.back() != '/')
+            retVal += '/';
+        retVal += part;
+    }
+    return retVal;
+}
+
+void FdCache::addWatches(const string &dir)
+{
+    VLOG(2) << "Start " << __PRETTY_FUNCTION__;
+
+    vector<string> dirs = { dir };
+    try
+    {
+        using namespace boost::filesystem;
+        for(recursive_directory_iterator i(dir), end; i != end; ++i)
+        {
+            if(is_directory(i->status()))
+                dirs.push_back(i->path().string());
+        }
+    }
+    catch(const boost::filesystem::filesystem_error &e)
+    {
+        LOG(WARNING) << "Failed to list directories under " << dir << ": "
+            << e.what();
+    }
+
+    for(auto &d : dirs)
+    {
+        auto wd = inotify_add_watch(inotifyFd, d.c_str(), watchMask);
+        if(wd < 0)
+        {
+            int err = errno;
+            LOG(WARNING) << "Failed to watch " << d << ", its files won't be "
+                "cached. Cause: " << strerror(err);
+            continue;
+        }
+
+        auto key = normalize(d);
+        VLOG(3) << "Watching " << key;
+        watches[wd] = key;
+        watchedDirs[key] = wd;
+    }
+
+    VLOG(2) << "End " << __PRETTY_FUNCTION__;
+}
+
+void FdCache::watchChanges()
+{
+    VLOG(2) << "Start " << __PRETTY_FUNCTION__;
+
+    alignas(struct inotify_event) char buf[4096];
+    while(true)
+    {
+        auto len = folly::readNoInt(inotifyFd, buf, sizeof(buf));
+        if(len <= 0)
+        {
+            int err = errno;
+            LOG(ERROR) << "Failed to read inotify events, fd cache disabled. "
+                "Cause: " << strerror(err);
+            lock_guard<mutex> guard(cacheLock);
+            maxEntries = 0;
+            evict();
+            break;
+        }
+
+        lock_guard<mutex> guard(cacheLock);
+        generation++;
+        for(char *p = buf; p < buf + len; )
+        {
+            auto event = reinterpret_cast<struct inotify_event *>(p);
+            p += sizeof(struct inotify_event) + event->len;
+
+            auto dir = watches.find(event->wd);
+            if(event->mask & IN_Q_OVERFLOW)
+            {
+                LOG(WARNING) << "Missed inotify events, clear fd cache";
+                entries.clear();
+                index.clear();
+                continue;
+            }
+            else if(dir == watches.end())
+                continue;
+            else if(event->mask & IN_IGNORED)
+            {
+                VLOG(1) << "No longer watching " << dir->second;
+                watchedDirs.erase(dir->second);
+                watches.erase(dir);
+                continue;
+            }
+
+            if(event->mask & IN_ISDIR)
+            {
+                // Every path under the directory changed. Rare enough to
+                // just start over
+                VLOG(1) << "Directory " << event->name << " changed in "
+                    << dir->second << ", clear fd cache";
+                entries.clear();
+                index.clear();
+                if(event->mask & (IN_CREATE | IN_MOVED_TO))
+                    addWatches(dir->second + "/" + event->name);
+                continue;
+            }
+
+            if(event->len)
+            {
+                auto entry = index.find(
+                    normalize(dir->second + "/" + event->name));
+                if(entry != index.end())
+                {
+                    VLOG(1) << entry->first << " changed, drop its fd";
+                    entries.erase(entry->second);
+                    index.erase(entry);
+                }
+            }
+        }
+    }
+
+    VLOG(2) << "End " << __PRETTY_FUNCTION__;
+}
+
+FdCache::Entry FdCache::open(const string &path)
+{
+    VLOG(2) << "Start " << __PRETTY_FUNCTION__;
+
+    auto key = normalize(path);
+    uint64_t openGeneration;
+    {
+        lock_guard<mutex> guard(cacheLock);
+        auto entry = index.find(key);
+        if(entry != index.end())
+        {
+            hits++;
+            VLOG(1) << "Fd cache hit for " << key;
+            entries.splice(entries.begin(), entries, entry->second);
+
+            VLOG(2) << "End " << __PRETTY_FUNCTION__;
+            return entry->second->second;
+        }
+        openGeneration = generation;
+    }
+
+    misses++;
+    VLOG(1) << "Fd cache miss for " << path;
+    Entry retVal;
+    retVal.file = make_shared<folly::File>(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if(fstat(retVal.file->fd(), &retVal.info) != 0)
+        throw system_error(errno, system_category(), "fstat failed");
+
+    auto slash = key.rfind('/');
+    if(key.empty() || slash == string::npos || !S_ISREG(retVal.info.st_mode))
+    {
+        VLOG(1) << "Not caching fd of " << path;
+        VLOG(2) << "End " << __PRETTY_FUNCTION__;
+        return retVal;
+    }
+
+    lock_guard<mutex> guard(cacheLock);
+    if(!maxEntries || generation != openGeneration ||
+        !watchedDirs.count(key.substr(0, slash)))
+    {
+        VLOG(1) << "Fd of " << key << " can't be cached";
+        VLOG(2) << "End " << __PRETTY_FUNCTION__;
+        return retVal;
+    }
+
+    auto entry = index.find(key);
+    if(entry != index.end())
+    {
+        entries.erase(entry->second);
+        index.erase(entry);
+    }
+    entries.emplace_front(key, retVal);
+    index[key] = entries.begin();
+    evict();
+
+    VLOG(2) << "End " << __PRETTY_FUNCTION__;
+    return retVal;
+}
+
+void FdCache::invalidate(const string &path)
+{
+    VLOG(2) << "Start " << __PRETTY_FUNCTION__;
+
+    lock_guard<mutex> guard(cacheLock);
+    auto entry = index.find(normalize(path));
+    if(entry != index.end())
+    {
+        VLOG(1) << "Drop fd of " << entry->first;
+        entries.erase(entry->second);
+        index.erase(entry);
+    }
+
+    VLOG(2) << "End " << __PRETTY_FUNCTION__;
+}
+
+void FdCache::clear()
+{
+    VLOG(2) << "Start " << __PRETTY_FUNCTION__;
+
+    lock_guard<mutex> guard(cacheLock);
+    entries.clear();
+    index.clear();
+
+    VLOG(2) << "End " << __PRETTY_FUNCTION__;
+}
+
+}
@@ -0,0 +1,143 @@
+/*
+ * Copyright 2017-present Keith Mendoza
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <glog/logging.h>
+
+#include "FileCache.h"
+
+using namespace std;
+
+namespace mimeographer
+{
+
+mutex FileCache::cacheLock;
+FileCache::FileList FileCache::files;
+unordered_map<string, FileCache::FileList::iterator> FileCache::index;
+size_t FileCache::cacheBytes = 0;
+size_t FileCache::maxBytes = 0;
+size_t FileCache::maxEntry = 0;
+
+void FileCache::init(const Config &config)
+{
+    VLOG(2) << "Start " << __PRETTY_FUNCTION__;
+
+    lock_guard<mutex> guard(cacheLock);
+    maxBytes = config.fileCacheBytes;
+    maxEntry = config.fileCacheMaxEntry;
+    VLOG(1) << "File cache size: " << maxBytes << " max file size: "
+        << maxEntry;
+    evict();
+
+    VLOG(2) << "End " << __PRETTY_FUNCTION__;
+}
+
+void FileCache::evict()
+{
+    VLOG(2) << "Start " << __PRETTY_FUNCTION__;
+
+    while(cacheBytes > maxBytes && files.size())
+    {
+        VLOG(1) << "Evict file " << files.back().first;
+        erase(index.find(files.back().first));
+    }
+
+    VLOG(2) << "End " << __PRETTY_FUNCTION__;
+}
+
+void FileCache::erase(unordered_map<string, FileList::iterator>::iterator entry)
+{
+    cacheBytes -= entry->second->second.content->size();
+    files.erase(entry->second);
+    index.erase(entry);
+}
+
+bool FileCache::cacheable(off_t size)
+{
+    lock_guard<mutex> guard(cacheLock);
+    return size >= 0 && (size_t)size <= maxEntry && (size_t)size <= maxBytes;
+}
+
+boost::optional<FileCache::File> FileCache::find(const string &path,
+    const struct stat &info)
+{
+    VLOG(2) << "Start " << __PRETTY_FUNCTION__;
+
+    boost::optional<File> retVal = boost::none;
+    lock_guard<mutex> guard(cacheLock);
+    auto entry = index.find(path);
+    if(entry == index.end())
+        VLOG(1) << "File cache miss for " << path;
+    else
+    {
+        auto &file = entry->second->second;
+        if(file.inode != info.st_ino || file.size != info.st_size ||
+            file.mtime.tv_sec != info.st_mtim.tv_sec ||
+            file.mtime.tv_nsec != info.st_mtim.tv_nsec)
+        {
+            VLOG(1) << "Cached copy of " << path << " is stale";
+            erase(entry);
+        }
+        else
+        {
+            VLOG(1) << "File cache hit for " << path;
+            files.splice(files.begin(), files, entry->second);
+            retVal = file;
+        }
+    }
+
+    VLOG(2) << "End " << __PRETTY_FUNCTION__;
+    return retVal;
+}
+
+void FileCache::store(const string &path, const struct stat &info,
+    const string &mimeType, string content)
+{
+    VLOG(2) << "Start " << __PRETTY_FUNCTION__;
+
+    if(content.size() != (size_t)info.st_size)
+    {
+        LOG(WARNING) << "Size of " << path << " changed while reading it";
+        VLOG(2) << "End " << __PRETTY_FUNCTION__;
+        return;
+    }
+
+    lock_guard<mutex> guard(cacheLock);
+    if(content.size() > maxEntry || content.size() > maxBytes)
+    {
+        VLOG(1) << path << " is too big to cache";
+        VLOG(2) << "End " << __PRETTY_FUNCTION__;
+        return;
+    }
+
+    auto entry = index.find(path);
+    if(entry != index.end())
+    {
+        VLOG(1) << "Replace cached copy of " << path;
+        erase(entry);
+    }
+
+    cacheBytes += content.size();
+    files.emplace_front(path, File {
+        make_shared<const string>(move(content)), mimeType, info.st_ino,
+        info.st_size, info.st_mtim });
+    index[path] = files.begin();
+    VLOG(3) << "File cache now using " << cacheBytes << " bytes";
+    evict();
+
+    VLOG(2) << "End " << __PRETTY_FUNCTION__;
+}
+
+}
@@ -0,0 +1,326 @@
+/*
+ * Copyright 2017-present Keith Mendoza
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <cerrno>
+#include <cstring>
+
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#ifdef HAVE_LIBURING
+#include <liburing.h>
+#endif
+
+#include <glog/logging.h>
+#include <folly/FileUtil.h>
+#include <folly/executors/CPUThreadPoolExecutor.h>
+#include <folly/io/async/EventBaseLocal.h>
+
+#include "FileIOService.h"
+
+using namespace std;
+using namespace folly;
+
+namespace mimeographer
+{
+
+bool FileIOService::useRing = true;
+unsigned int FileIOService::ringEntries = 256;
+unsigned int FileIOService::poolThreads = 4;
+
+struct FileIOService::Op
+{
+    bool isWrite;
+    int fd;
+    off_t offset;
+
+    // Bytes asked for by a read. The buffer can have more room than this
+    size_t length = 0;
+
+    // Buffer being read into, or the data being written
+    unique_ptr<IOBuf> buf;
+
+    // Bytes of buf already written
+    size_t written = 0;
+
+    ReadCallback readCallback;
+    WriteCallback writeCallback;
+};
+
+FileIOService::Completions::Completions(FileIOService &parent, int fd) :
+    EventHandler(&parent.evb, NetworkSocket::fromFd(fd)), parent(parent)
+{}
+
+void FileIOService::Completions::handlerReady(uint16_t /*events*/) noexcept
+{
+    parent.reap();
+}
+
+FileIOService::FileIOService(EventBase &evb) : evb(evb)
+{
+    VLOG(2) << "Start " << __PRETTY_FUNCTION__;
+
+#ifdef HAVE_LIBURING
+    if(useRing)
+    {
+        auto newRing = new struct io_uring;
+        auto rslt = io_uring_queue_init(ringEntries, newRing, 0);
+        if(rslt < 0)
+        {
+            LOG(WARNING) << "io_uring not available, file I/O goes to the "
+                "thread pool. Cause: " << strerror(-rslt);
+            delete newRing;
+        }
+        else
+        {
+            ringEvent = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+            if(ringEvent < 0 ||
+                (rslt = io_uring_register_eventfd(newRing, ringEvent)) < 0)
+            {
+                int err = ringEvent < 0 ? errno : -rslt;
+                LOG(WARNING) << "Failed to set up io_uring completion "
+                    "notification, file I/O goes to the thread pool. Cause: "
+                    << strerror(err);
+                io_uring_queue_exit(newRing);
+                delete newRing;
+                if(ringEvent >= 0)
+                    close(ringEvent);
+                ringEvent = -1;
+            }
+            else
+            {
+                ring = newRing;
+                completions = make_unique<Completions>(*this, ringEvent);
+                completions->registerHandler(
+                    EventHandler::READ | EventHandler::PERSIST);
+                VLOG(1) << "io_uring with " << ringEntries << " entries ready";
+            }
+        }
+    }
+    else
+        VLOG(1) << "io_uring disabled, file I/O goes to the thread pool";
+#else
+    VLOG(1) << "Built without io_uring, file I/O goes to the thread pool";
+#endif
+
+    VLOG(2) << "End " << __PRETTY_FUNCTION__;
+}
+
+FileIOService::~FileIOService()
+{
+    VLOG(2) << "Start " << __PRETTY_FUNCTION__;
+
+    if(inFlight)
+        LOG(WARNING) << inFlight << " file operations still in flight";
+
+#ifdef HAVE_LIBURING
+    if(ring)
+    {
+        completions->unregisterHandler();
+        completions.reset();
+        io_uring_queue_exit(ring);
+        delete ring;
+        close(ringEvent);
+    }
+#endif
+
+    VLOG(2) << "End " << __PRETTY_FUNCTION__;
+}
+
+void FileIOService::init(const Config &config)
+{
+    VLOG(2) << "Start " << __PRETTY_FUNCTION__;
+
+    useRing = config.ioUring;
+    ringEntries = config.ioRingEntries;
+    poolThreads = config.fileIOThreads;
+
+    VLOG(2) << "End " << __PRETTY_FUNCTION__;
+}
+
+FileIOService &FileIOService::get(EventBase *evb)
+{
+    static EventBaseLocal<FileIOService> services;
+    return services.getOrCreate(*evb, *evb);
+}
+
+Executor &FileIOService::pool()
+{
+    // Separate from the global CPU executor so slow disks don't hold up
+    // anything else
+    static CPUThreadPoolExecutor executor(poolThreads,
+        make_shared<NamedThreadFactory>("FileIO"));
+    return executor;
+}
+
+void FileIOService::read(int fd, size_t length, off_t offset,
+    ReadCallback callback)
+{
+    VLOG(2) << "Start " << __PRETTY_FUNCTION__;
+
+    auto op = new Op;
+    op->isWrite = false;
+    op->fd = fd;
+    op->offset = offset;
+    op->length = length;
+    op->buf = IOBuf::create(length);
+    op->readCallback = move(callback);
+    submit(op);
+
+    VLOG(2) << "End " << __PRETTY_FUNCTION__;
+}
+
+void FileIOService::write(int fd, unique_ptr<IOBuf> data, off_t offset,
+    WriteCallback callback)
+{
+    VLOG(2) << "Start " << __PRETTY_FUNCTION__;
+
+    auto op = new Op;
+    op->isWrite = true;
+    op->fd = fd;
+    op->offset = offset;
+    op->buf = move(data);
+    op->buf->coalesce();
+    op->writeCallback = move(callback);
+    submit(op);
+
+    VLOG(2) << "End " << __PRETTY_FUNCTION__;
+}
+
+void FileIOService::submit(Op *op)
+{
+    VLOG(2) << "Start " << __PRETTY_FUNCTION__;
+
+    inFlight++;
+
+#ifdef HAVE_LIBURING
+    if(ring)
+    {
+        auto sqe = io_uring_get_sqe(ring);
+        if(!sqe)
+        {
+            VLOG(1) << "Submission queue full, flush it and try again";
+            io_uring_submit(ring);
+            sqe = io_uring_get_sqe(ring);
+        }
+
+        if(sqe)
+        {
+            if(op->isWrite)
+                io_uring_prep_write(sqe, op->fd, op->buf->data() + op->written,
+                    op->buf->length() - op->written, op->offset + op->written);
+            else
+                io_uring_prep_read(sqe, op->fd, op->buf->writableTail(),
+                    op->length, op->offset);
+            io_uring_sqe_set_data(sqe, op);
+
+            // If this fails the entry stays queued and goes in with the
+            // next submit
+            auto rslt = io_uring_submit(ring);
+            if(rslt < 0)
+                LOG(WARNING) << "io_uring_submit failed. Cause: "
+                    << strerror(-rslt);
+
+            VLOG(2) << "End " << __PRETTY_FUNCTION__;
+            return;
+        }
+        LOG(WARNING) << "io_uring still full, send request to thread pool";
+    }
+#endif
+
+    auto evbPtr = &evb;
+    pool().add([this, evbPtr, op]()
+        {
+            ssize_t rslt;
+            if(op->isWrite)
+                rslt = pwriteFull(op->fd, op->buf->data() + op->written,
+                    op->buf->length() - op->written, op->offset + op->written);
+            else
+                rslt = preadNoInt(op->fd, op->buf->writableTail(),
+                    op->length, op->offset);
+            int result = rslt < 0 ? -errno : rslt;
+
+            evbPtr->runInEventBaseThread([this, op, result]
+                {
+                    complete(op, result);
+                });
+        });
+
+    VLOG(2) << "End " << __PRETTY_FUNCTION__;
+}
+
+void FileIOService::reap()
+{
+    VLOG(2) << "Start " << __PRETTY_FUNCTION__;
+
+#ifdef HAVE_LIBURING
+    uint64_t count;
+    if(readNoInt(ringEvent, &count, sizeof(count)) < 0 && errno != EAGAIN)
+    {
+        int err = errno;
+        LOG(ERROR) << "Failed to read io_uring eventfd. Cause: "
+            << strerror(err);
+    }
+
+    struct io_uring_cqe *cqe;
+    while(io_uring_peek_cqe(ring, &cqe) == 0)
+    {
+        auto op = static_cast<Op *>(io_uring_cqe_get_data(cqe));
+        auto result = cqe->res;
+        io_uring_cqe_seen(ring, cqe);
+        complete(op, result);
+    }
+#endif
+
+    VLOG(2) << "End " << __PRETTY_FUNCTION__;
+}
+
+void FileIOService::complete(Op *op, int result)
+{
+    VLOG(2) << "Start " << __PRETTY_FUNCTION__;
+
+    inFlight--;
+    unique_ptr<Op> done(op);
+    if(op->isWrite)
+    {
+        if(result > 0 && op->written + result < op->buf->length())
+        {
+            VLOG(3) << "Short write of " << result << " bytes, write the rest";
+            op->written += result;
+            submit(done.release());
+
+            VLOG(2) << "End " << __PRETTY_FUNCTION__;
+            return;
+        }
+
+        int err = result < 0 ? -result : (result == 0 ? EIO : 0);
+        if(err)
+            VLOG(1) << "Write failed: " << strerror(err);
+        op->writeCallback(err);
+    }
+    else
+    {
+        if(result > 0)
+            op->buf->append(result);
+        else if(result < 0)
+            VLOG(1) << "Read failed: " << strerror(-result);
+        op->readCallback(move(op->buf), result < 0 ? -result : 0);
+    }
+
+    VLOG(2) << "End " << __PRETTY_FUNCTION__;
+}
+
+}
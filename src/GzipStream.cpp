@@ -0,0 +1,109 @@
+/*
+ * Copyright 2017-present Keith Mendoza
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+#include <glog/logging.h>
+
+#include "GzipStream.h"
+
+using namespace std;
+using namespace folly;
+
+namespace mimeographer
+{
+
+GzipStream::GzipStream(int level)
+{
+    VLOG(2) << "Start " << __PRETTY_FUNCTION__;
+
+    memset(&stream, 0, sizeof(stream));
+
+    // 16 added to the window bits gets zlib to write a gzip wrapper
+    auto rslt = deflateInit2(&stream, level, Z_DEFLATED, 15 + 16, 8,
+        Z_DEFAULT_STRATEGY);
+    if(rslt != Z_OK)
+    {
+        LOG(ERROR) << "Failed to initialize deflate. Cause: " << rslt;
+        throw runtime_error("Failed to initialize gzip stream");
+    }
+
+    VLOG(2) << "End " << __PRETTY_FUNCTION__;
+}
+
+GzipStream::~GzipStream()
+{
+    deflateEnd(&stream);
+}
+
+unique_ptr<IOBuf> GzipStream::compress(const IOBuf &data, bool finish)
+{
+    VLOG(2) << "Start " << __PRETTY_FUNCTION__;
+
+    if(finished)
+    {
+        LOG(ERROR) << "Gzip stream already finished";
+        throw logic_error("Gzip stream already finished");
+    }
+
+    // Deflate output is rarely bigger than the input; anything that doesn't
+    // fit goes into more buffers chained after this one
+    const size_t bufSize = data.computeChainDataLength() / 2 + 64;
+    unique_ptr<IOBuf> retVal = IOBuf::create(bufSize);
+    IOBuf *out = retVal.get();
+
+    auto deflateRange = [this, &out, &retVal, bufSize](ByteRange in, int flush)
+    {
+        stream.next_in = const_cast<unsigned char *>(in.data());
+        stream.avail_in = in.size();
+        do
+        {
+            if(!out->tailroom())
+            {
+                VLOG(3) << "Add another output buffer";
+                retVal->prependChain(IOBuf::create(bufSize));
+                out = retVal->prev();
+            }
+
+            stream.next_out = out->writableTail();
+            stream.avail_out = out->tailroom();
+            auto rslt = deflate(&stream, flush);
+            if(rslt != Z_OK && rslt != Z_STREAM_END && rslt != Z_BUF_ERROR)
+            {
+                LOG(ERROR) << "deflate failed. Cause: " << rslt;
+                throw runtime_error("Failed to compress response");
+            }
+            out->append(out->tailroom() - stream.avail_out);
+        } while(stream.avail_in || !stream.avail_out);
+    };
+
+    for(auto range : data)
+    {
+        VLOG(3) << "Compress " << range.size() << " bytes";
+        deflateRange(range, Z_NO_FLUSH);
+    }
+    deflateRange(ByteRange(), finish ? Z_FINISH : Z_SYNC_FLUSH);
+    finished = finish;
+
+    VLOG(3) << "Compressed " << data.computeChainDataLength() << " bytes to "
+        << retVal->computeChainDataLength();
+    VLOG(2) << "End " << __PRETTY_FUNCTION__;
+    return retVal;
+}
+
+}
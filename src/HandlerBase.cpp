@@ -19,13 +19,26 @@
 #include <utility>
 #include <uuid/uuid.h>
 #include <cstring>
+#include <cstdlib>
+#include <fcntl.h>
+#include <unistd.h>
 
 #include <glog/logging.h>
+#include <boost/algorithm/string.hpp>
+#include <folly/io/async/EventBaseManager.h>
+#include <folly/ssl/OpenSSLHash.h>
+#include <proxygen/lib/utils/Base64.h>
 
 #include "HandlerBase.h"
+#include "FileIOService.h"
 #include "HandlerError.h"
+#include "HeaderUtil.h"
 #include "HandlerRedirect.h"
+#include "PageCache.h"
 #include "SiteTemplates.h"
+#include "UploadLimiter.h"
+#include "UploadStore.h"
+#include "UrlCodec.h"
 
 using namespace std;
 using namespace proxygen;
@@ -41,7 +54,7 @@ void HandlerBase::PostBodyCallback::onParam(const std::string& name,
     
     VLOG(3)<< "Param name: " << name
         << " value: " << value << " bytes processed: " << postBytesProcessed;
-    parent.postParams[name] = {
+    findOrInsert(parent.postParams, name) = {
         PostParamType::VALUE,
         value
     };
@@ -59,6 +72,16 @@ int HandlerBase::PostBodyCallback::onFileStart(const std::string& name,
         << " Filename: " << filename
         << " Content-Type: "
         << msg->getHeaders().getSingleOrEmpty(proxygen::HTTPHeaderCode::HTTP_HEADER_CONTENT_TYPE);
+
+    uploadFileParam = name;
+    saveOffset = 0;
+    if(!acceptFiles)
+    {
+        VLOG(1) << "Throwing away upload for \"" << name << "\"";
+        skipFile = true;
+        VLOG(2) << "End " << __PRETTY_FUNCTION__;
+        return 0;
+    }
     
     uuid_t uuid;
     uuid_generate_random(uuid);
@@ -66,23 +89,51 @@ int HandlerBase::PostBodyCallback::onFileStart(const std::string& name,
     uuid_unparse_lower(uuid, fileuuid);
     VLOG(3) << "File UUID: " << fileuuid;
 
+    // Hidden until UploadStore gives it its content-addressed name
     localFilename = parent.config.uploadDest
         + (*(parent.config.uploadDest.end()-1) != '/' ? "/" : "")
-        + fileuuid + "_" + filename;
+        + "." + fileuuid + ".part";
     VLOG(3) << "Local filename to use: " << localFilename;
 
-    saveFile.open(localFilename, ios_base::out | ios_base::binary);
-    if(!saveFile.is_open())
+    try
+    {
+        saveFile = make_shared<File>(localFilename,
+            O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC);
+        allocated = 0;
+        tempFiles.push_back(localFilename);
+    }
+    catch(const system_error &e)
     {
         LOG(ERROR) << "Failed to open " << localFilename
-            << " to store upload file for parameter \"" << name << "\"";
+            << " to store upload file for parameter \"" << name << "\". Cause: "
+            << e.what();
         return -1;
     }
 
-    uploadFileParam = name;
-    parent.postParams[uploadFileParam] = {
+    // The rest of the body is as big as the file can be. Allocating that
+    // now keeps the file in one piece; onFileEnd() trims what's left over
+    const uint64_t minAllocate = 64 * 1024;
+    if(bodyLength > postBytesProcessed + minAllocate)
+    {
+        auto length = min<uint64_t>(bodyLength - postBytesProcessed,
+            parent.config.uploadMaxSize);
+        if(fallocate(saveFile->fd(), 0, 0, length) == 0)
+        {
+            VLOG(1) << "Allocated " << length << " bytes for " << localFilename;
+            allocated = length;
+        }
+        else
+        {
+            auto err = errno;
+            VLOG(1) << "Not allocating space for " << localFilename << ": "
+                << strerror(err);
+        }
+    }
+
+    findOrInsert(parent.postParams, uploadFileParam) = {
         PostParamType::FILE_UPLOAD, "", filename, localFilename 
     };
+    digest.hash_init(EVP_sha256());
 
     VLOG(1) << "File " << localFilename << " opened to store file for \""
         << name << "\"";
@@ -96,20 +147,98 @@ int HandlerBase::PostBodyCallback::onFileData(std::unique_ptr<folly::IOBuf> data
 {
     VLOG(2) << "Start " << __PRETTY_FUNCTION__;
 
+    auto length = data->computeChainDataLength();
+    if(skipFile)
+    {
+        // Still held to the size limit, since it's still read
+        if(saveOffset + length > parent.config.uploadMaxSize)
+        {
+            LOG(INFO) << "Ignored upload for field " << uploadFileParam
+                << " is over " << parent.config.uploadMaxSize << " bytes";
+            overLimit = true;
+            return -1;
+        }
+        saveOffset += length;
+
+        VLOG(2) << "End " << __PRETTY_FUNCTION__;
+        return 0;
+    }
+
     if(!saveFile)
     {
         LOG(ERROR) << "Received upload file data when local file not open";
         return -1;
     }
 
-    saveFile.write((const char *)data->data(), data->length());
-    if(!saveFile)
+    if(writes->failedParams.count(uploadFileParam))
+    {
+        LOG(ERROR) << "Earlier write to save file " << localFilename
+            << " for field " << uploadFileParam << " failed";
+        return -1;
+    }
+
+    if(saveOffset + length > parent.config.uploadMaxSize)
     {
-        LOG(ERROR) << "Error encountered writing to save file "
-            << localFilename << " for field " << uploadFileParam;
+        LOG(INFO) << "Upload for field " << uploadFileParam << " is over "
+            << parent.config.uploadMaxSize << " bytes";
+        overLimit = true;
+        writes->failedParams.insert(uploadFileParam);
         return -1;
     }
-    VLOG(1) << "File data saved";
+
+    digest.hash_update(*data);
+
+    // The write completes on this thread. The callback holds on to the file
+    // and the shared state in case the handler is gone by then
+    writes->pending++;
+    writes->buffered += length;
+    FileIOService::get(EventBaseManager::get()->getEventBase()).write(
+        saveFile->fd(), move(data), saveOffset,
+        [writes = writes, file = saveFile, param = uploadFileParam, length,
+            resumeAt = parent.config.uploadMaxBuffered / 2](int err)
+        {
+            writes->pending--;
+            writes->buffered -= length;
+            if(writes->paused && writes->buffered <= resumeAt)
+            {
+                VLOG(1) << "Upload writes caught up, resuming ingress";
+                writes->paused = false;
+                if(writes->onResume)
+                    writes->onResume();
+            }
+
+            if(err)
+            {
+                LOG(ERROR) << "Error encountered writing upload for field "
+                    << param << ": " << strerror(err);
+                writes->failedParams.insert(param);
+            }
+
+            if(!writes->pending && writes->onDrained)
+            {
+                VLOG(1) << "Upload writes done";
+                auto callback = move(writes->onDrained);
+                writes->onDrained = nullptr;
+                callback();
+            }
+        });
+    saveOffset += length;
+    VLOG(1) << "File data sent to disk";
+
+    // Stop reading the body until the disk catches up rather than letting
+    // the upload pile up in memory
+    if(!writes->paused && writes->buffered > parent.config.uploadMaxBuffered
+        && parent.downstream_)
+    {
+        VLOG(1) << writes->buffered << " bytes of upload waiting to be "
+            "written, pausing ingress";
+        writes->paused = true;
+        writes->onResume = [this]()
+        {
+            parent.downstream_->resumeIngress();
+        };
+        parent.downstream_->pauseIngress();
+    }
 
     VLOG(2) << "End " << __PRETTY_FUNCTION__;
     return 0;
@@ -119,81 +248,180 @@ void HandlerBase::PostBodyCallback::onFileEnd(bool end, uint64_t postBytesProces
 {
     VLOG(2) << "Start " << __PRETTY_FUNCTION__;
 
-    if(!saveFile)
+    if(skipFile)
+    {
+        VLOG(1) << "Done throwing away upload for " << uploadFileParam;
+        skipFile = false;
+    }
+    else if(!saveFile)
         LOG(ERROR) << "Received file upload complete when local file not open";
     else if(end)
     {
-        VLOG(1) << "Done saving " << uploadFileParam << " data to " << localFilename;
-        saveFile.close();
+        // The file gets closed once the last write is done
+        VLOG(1) << "Done receiving " << uploadFileParam << " data for "
+            << localFilename;
+        if(allocated > saveOffset && ftruncate(saveFile->fd(), saveOffset))
+        {
+            auto err = errno;
+            LOG(WARNING) << "Failed to trim " << localFilename << " to "
+                << saveOffset << " bytes: " << strerror(err);
+        }
+        saveFile.reset();
+
+        unsigned char hash[32];
+        digest.hash_final(MutableByteRange(hash, sizeof(hash)));
+        auto entry = parent.postParams.find(uploadFileParam);
+        if(entry != parent.postParams.end())
+        {
+            entry->second.sha256 = UploadStore::hex(ByteRange(hash,
+                sizeof(hash)));
+            entry->second.size = saveOffset;
+            VLOG(3) << "SHA-256 of " << uploadFileParam << ": "
+                << entry->second.sha256;
+        }
     }
     else
     {
         LOG(WARNING) << "Error encountered receiving upload file for "
             << uploadFileParam;
-        parent.postParams.erase(uploadFileParam);
+        auto entry = parent.postParams.find(uploadFileParam);
+        if(entry != parent.postParams.end())
+            parent.postParams.erase(entry);
+        saveFile.reset();
     }
 
     VLOG(2) << "End " << __PRETTY_FUNCTION__;
 }
 
-unique_ptr<IOBuf> HandlerBase::buildPageHeader() 
+HandlerBase::PostBodyCallback::~PostBodyCallback()
 {
-    VLOG(2) << "Start " << __PRETTY_FUNCTION__;
+    // Outstanding writes mustn't call back into a deleted handler
+    writes->onDrained = nullptr;
+    writes->onResume = nullptr;
+    removeTempFiles();
+}
 
-    string templateHeader = SiteTemplates::getTemplate("header") + 
-        SiteTemplates::getTemplate("navbase");
+void HandlerBase::PostBodyCallback::removeTempFiles()
+{
+    VLOG(2) << "Start " << __PRETTY_FUNCTION__;
 
-    if(session.userAuthenticated())
+    // Uploads the handler stored were moved out from under these names.
+    // Writes still in flight go to the unlinked file and are lost with it
+    for(auto &name : tempFiles)
     {
-        VLOG(1) << "User authenticated, add editor menu items";
-        templateHeader +=
-            SiteTemplates::getTemplate("editnav") + 
-            SiteTemplates::getTemplate("usernav");
+        if(unlink(name.c_str()) == 0)
+            VLOG(1) << "Removed unstored upload " << name;
+        else if(errno != ENOENT)
+        {
+            auto err = errno;
+            LOG(WARNING) << "Failed to remove " << name << ": "
+                << strerror(err);
+        }
     }
-    else
+    tempFiles.clear();
+
+    VLOG(2) << "End " << __PRETTY_FUNCTION__;
+}
+
+void HandlerBase::PostBodyCallback::reset()
+{
+    VLOG(2) << "Start " << __PRETTY_FUNCTION__;
+
+    // In-flight writes keep the old state alive on their own
+    writes->onDrained = nullptr;
+    writes->onResume = nullptr;
+    removeTempFiles();
+    writes = make_shared<UploadWrites>();
+    saveFile.reset();
+    saveOffset = 0;
+    allocated = 0;
+    bodyLength = 0;
+    overLimit = false;
+    acceptFiles = true;
+    skipFile = false;
+    localFilename.clear();
+    uploadFileParam.clear();
+
+    VLOG(2) << "End " << __PRETTY_FUNCTION__;
+}
+
+bool HandlerBase::PostBodyCallback::waitForUploads(function<void()> callback)
+{
+    VLOG(2) << "Start " << __PRETTY_FUNCTION__;
+
+    if(!writes->pending)
     {
-        VLOG(1) << "User not authenticated";
-        templateHeader += SiteTemplates::getTemplate("login");
+        VLOG(1) << "No upload writes in flight";
+        dropFailedUploads();
+
+        VLOG(2) << "End " << __PRETTY_FUNCTION__;
+        return false;
     }
 
-    templateHeader += SiteTemplates::getTemplate("navclose") +
-        SiteTemplates::getTemplate("contentopen");
+    VLOG(1) << "Wait for " << writes->pending << " upload writes";
+    writes->onDrained = [this, callback]()
+    {
+        dropFailedUploads();
+        callback();
+    };
 
-    // NOTE: Any other sections of the page should be its own IOBuf and
-    // appended to response outside of this section
     VLOG(2) << "End " << __PRETTY_FUNCTION__;
-    return move(IOBuf::copyBuffer(templateHeader));
+    return true;
 }
 
-void HandlerBase::parseCookies(const string &cookies) noexcept
+void HandlerBase::PostBodyCallback::dropFailedUploads()
 {
     VLOG(2) << "Start " << __PRETTY_FUNCTION__;
 
-    char *cookiePartSave;
-    auto cookie = strtok_r(const_cast<char *>(cookies.c_str()), "; ", &cookiePartSave);
-    while(cookie)
+    for(auto &param : writes->failedParams)
     {
-        VLOG(3) << "Cookie part: " << cookie;
-        char *nameValSave;
-        auto name = strtok_r(cookie, "=", &nameValSave);
-        auto val = strtok_r(nullptr, "=", &nameValSave);
-        VLOG(3) << "Cookie name: " << name << " value: " << val;
-        cookieJar[name] = val;
-        cookie = strtok_r(nullptr, "; ", &cookiePartSave);
+        auto entry = parent.postParams.find(param);
+        if(entry == parent.postParams.end())
+            continue;
+
+        LOG(WARNING) << "Dropping upload for " << param;
+        unlink(entry->second.localFilename.c_str());
+        parent.postParams.erase(entry);
     }
+    writes->failedParams.clear();
+
+    VLOG(2) << "End " << __PRETTY_FUNCTION__;
+}
+
+unique_ptr<IOBuf> HandlerBase::buildPageHeader() 
+{
+    VLOG(2) << "Start " << __PRETTY_FUNCTION__;
+
+    // NOTE: Any other sections of the page should be its own IOBuf and
+    // appended to response outside of this section
+    auto retVal = IOBuf::copyBuffer(
+        SiteTemplates::buildPageHeader(session.userAuthenticated()));
 
     VLOG(2) << "End " << __PRETTY_FUNCTION__;
+    return retVal;
 }
 
 const string HandlerBase::makeMenuButtons(const vector<pair<string, string>> &links) const
 {
     VLOG(2) << "Start " << __PRETTY_FUNCTION__;
+    static const string linkStart = "<a href=\"";
+    static const string linkMiddle = "\" class=\"btn btn-primary\">";
+    static const string linkEnd = "</a>";
+
+    size_t size = 0;
+    for(auto &i : links)
+        size += 1 + linkStart.size() + i.first.size() + linkMiddle.size()
+            + i.second.size() + linkEnd.size();
+
     string retVal;
-    for(auto i : links)
+    retVal.reserve(size);
+    for(auto &i : links)
     {
         VLOG(1) << "Creating button for " << i.first << "/" << i.second << "pair";
-        retVal += string(retVal.size() ? "\n" : "") + "<a href=\"" + i.first + "\" class=\"btn btn-primary\">"
-            + i.second + "</a>";
+        if(retVal.size())
+            retVal += '\n';
+        retVal.append(linkStart).append(i.first).append(linkMiddle)
+            .append(i.second).append(linkEnd);
     }
     
     VLOG(1) << "Done crating button set";
@@ -203,7 +431,9 @@ const string HandlerBase::makeMenuButtons(const vector<pair<string, string>> &li
 }
 
 HandlerBase::HandlerBase(const Config &config) :
+    postParams(ArenaAllocator<char>(arena)),
     pbCallback(*this),
+    cookieJar(ArenaAllocator<char>(arena)),
     config(config),
     db(config.dbUser, config.dbPass, config.dbHost, config.dbName,
         config.dbPort),
@@ -213,6 +443,51 @@ HandlerBase::HandlerBase(const Config &config) :
     VLOG(2) << "End " << __PRETTY_FUNCTION__;
 }
 
+bool HandlerBase::reset() noexcept
+{
+    VLOG(2) << "Start " << __PRETTY_FUNCTION__;
+
+    // The parser refers to pbCallback, and the maps have to be empty
+    // before the arena goes
+    postParser.reset();
+    formParser.reset();
+    bodyRefused = false;
+    releaseUploadSlot();
+    pbCallback.reset();
+    postParams.clear();
+    cookieJar.clear();
+    arena.reset();
+
+    handlerResponse.reset();
+    context.clear();
+    requestHeaders.reset();
+    streamingAllowed = false;
+    headersSent = false;
+    egressPaused = false;
+    bodyProducer = nullptr;
+    etag.clear();
+    publicResponse = false;
+
+    gzip.reset();
+    cacheResponse = false;
+    // Hang on to the buffers unless a big page made them big
+    const size_t keepCapacity = 64 * 1024;
+    plainCopy.clear();
+    if(plainCopy.capacity() > keepCapacity)
+        string().swap(plainCopy);
+    gzipCopy.clear();
+    if(gzipCopy.capacity() > keepCapacity)
+        string().swap(gzipCopy);
+
+    session.reset();
+    route = RouteMatch();
+
+    auto retVal = db.checkConnection();
+
+    VLOG(2) << "End " << __PRETTY_FUNCTION__;
+    return retVal;
+}
+
 void HandlerBase::onRequest(unique_ptr<HTTPMessage> headers) noexcept 
 {
     VLOG(2) << "Start " << __PRETTY_FUNCTION__;
@@ -224,6 +499,8 @@ void HandlerBase::onRequest(unique_ptr<HTTPMessage> headers) noexcept
         << " " << headers->getMethodString()
         << " " << headers->getPath();
 
+    // Bodies over the limits are turned away once the session is known
+    bool bodyTooLarge = false;
     auto method = headers->getMethod();
     if(method && method == HTTPMethod::POST)
     {
@@ -238,8 +515,43 @@ void HandlerBase::onRequest(unique_ptr<HTTPMessage> headers) noexcept
             auto boundary = val.substr(val.find("boundary=")+9);
             VLOG(3) << "Boundary: " << boundary;
 
-            postParser = make_unique<RFC1867Codec>(boundary);
-            postParser->setCallback(&pbCallback);
+            auto length = headers->getHeaders().getSingleOrEmpty(
+                HTTPHeaderCode::HTTP_HEADER_CONTENT_LENGTH);
+            auto bodyLength = length.empty() ? 0 :
+                strtoull(length.c_str(), nullptr, 10);
+            if(bodyLength > config.uploadMaxSize + config.formMaxSize)
+            {
+                LOG(INFO) << "Multipart body of " << length
+                    << " bytes is over the limit";
+                bodyTooLarge = true;
+            }
+            else
+            {
+                postParser = make_unique<RFC1867Codec>(boundary);
+                postParser->setCallback(&pbCallback);
+                pbCallback.setBodyLength(bodyLength);
+            }
+        }
+        else if(val.find("application/x-www-form-urlencoded") == 0)
+        {
+            VLOG(1) << "Content type is application/x-www-form-urlencoded";
+
+            // Turn away a body that's declared too big before it comes in
+            auto length = headers->getHeaders().getSingleOrEmpty(
+                HTTPHeaderCode::HTTP_HEADER_CONTENT_LENGTH);
+            if(!length.empty() && strtoull(length.c_str(), nullptr, 10)
+                > config.formMaxSize)
+            {
+                LOG(INFO) << "Form body of " << length
+                    << " bytes is over the limit";
+                bodyTooLarge = true;
+            }
+            else
+            {
+                formParser = make_unique<UrlEncodedParser>(
+                    config.formMaxSize, config.formMaxParams);
+                formParser->setCallback(&pbCallback);
+            }
         }
         else
             LOG(INFO) << "Not processing POST request with Content-Type " << val;
@@ -247,28 +559,133 @@ void HandlerBase::onRequest(unique_ptr<HTTPMessage> headers) noexcept
     else
         VLOG(1) << "Not POST request";
 
-    VLOG(1) << "Collect cookies";
-    headers->getHeaders().forEachValueOfHeader(HTTPHeaderCode::HTTP_HEADER_COOKIE,
-        [this](const string &val)
-        {
-            parseCookies(val);
-            return false;
-        });
     this->requestHeaders = move(headers);
+    context.parse(*requestHeaders);
+
+    if(acceptsGzip(requestHeaders->getHeaders().getSingleOrEmpty(
+        HTTP_HEADER_ACCEPT_ENCODING)))
+    {
+        VLOG(1) << "Client accepts gzip";
+        try
+        {
+            gzip = make_unique<GzipStream>(config.compressionLevel);
+        }
+        catch(const exception &e)
+        {
+            LOG(WARNING) << "Sending response uncompressed: " << e.what();
+        }
+    }
 
     VLOG(1) << "Initialize session";
+    auto publicPage = config.proxyCache && isPublicPage();
     auto uuid = getCookie("session");
     if(uuid)
     {
         VLOG(1) << "Session cookie available";
         session.initSession(*uuid);
     }
+    else if(publicPage)
+        VLOG(1) << "Anonymous request for public page, no session needed";
     else
     {
         VLOG(1) << "Session cookie not available";
         session.initSession();
     }
-    addCookie("session", session.getUUID());
+
+    if(publicPage && !session.userAuthenticated())
+    {
+        VLOG(1) << "Response can go to shared caches";
+        publicResponse = true;
+    }
+    else
+        addCookie("session", session.getUUID());
+
+    // Decide whether the uploads get written before any of them come in
+    if(bodyTooLarge)
+        refuseBody(413, "Payload Too Large");
+    else if(postParser)
+    {
+        auto user = session.getUserId();
+        if(!user)
+        {
+            // The other fields can still be a login or some other form
+            // that doesn't need a user
+            LOG(INFO) << "Not accepting uploads from anonymous user";
+            pbCallback.refuseFiles();
+        }
+        else if(UploadLimiter::acquire(*user))
+            uploadUser = user;
+        else
+            refuseBody(429, "Too Many Requests");
+    }
+
+    VLOG(2) << "End " << __PRETTY_FUNCTION__;
+}
+
+void HandlerBase::onBody(unique_ptr<IOBuf> body) noexcept
+{
+    VLOG(2) << "Start " << __PRETTY_FUNCTION__;
+
+    if(postParser)
+    {
+        postParser->onIngress(move(body));
+        if(pbCallback.isOverLimit())
+            refuseBody(413, "Payload Too Large");
+    }
+    else if(formParser)
+    {
+        formParser->onIngress(move(body));
+        if(formParser->isOverLimit())
+            refuseBody(413, "Payload Too Large");
+    }
+    else
+        VLOG(1) << "Ignoring request body";
+
+    VLOG(2) << "End " << __PRETTY_FUNCTION__;
+}
+
+void HandlerBase::refuseBody(unsigned short code, const string &msg) noexcept
+{
+    VLOG(2) << "Start " << __PRETTY_FUNCTION__;
+
+    LOG(INFO) << "Refusing request body: " << code << " " << msg;
+    bodyRefused = true;
+
+    // Nothing more of the body is parsed or written, and what was written
+    // is thrown away
+    postParser.reset();
+    formParser.reset();
+    pbCallback.reset();
+    postParams.clear();
+    releaseUploadSlot();
+
+    // Paused before the response goes out, since the transaction can be
+    // done with as soon as it does
+    downstream_->pauseIngress();
+    try
+    {
+        auto response = buildPageHeader();
+        response->prependChain(IOBuf::copyBuffer("<p>" + htmlEscape(msg) + "</p>"));
+        response->prependChain(
+            IOBuf::copyBuffer(SiteTemplates::getTemplate("contentclose"))
+        );
+
+        // The connection can't be used for another request with the rest
+        // of this body still in it
+        ResponseBuilder(downstream_)
+            .status(code, msg)
+            .header(HTTP_HEADER_CONTENT_TYPE, "text/html")
+            .header(HTTP_HEADER_X_XSS_PROTECTION, "1; mode=block")
+            .closeConnection()
+            .body(move(response))
+            .sendWithEOM();
+    }
+    catch(const exception &e)
+    {
+        LOG(ERROR) << "Exception encountered refusing request body: "
+            << e.what();
+        downstream_->sendAbort();
+    }
 
     VLOG(2) << "End " << __PRETTY_FUNCTION__;
 }
@@ -277,7 +694,14 @@ void HandlerBase::onEOM() noexcept
 {
     VLOG(2) << "Start " << __PRETTY_FUNCTION__;
 
-    for(auto i = postParams.begin(); i != postParams.end(); i++)
+    if(bodyRefused)
+    {
+        VLOG(1) << "Response already sent";
+        VLOG(2) << "End " << __PRETTY_FUNCTION__;
+        return;
+    }
+
+    for(auto i = postParams.begin(); VLOG_IS_ON(3) && i != postParams.end(); i++)
     {
         ostringstream str;
         str << "POST param: " << i->first;
@@ -298,12 +722,68 @@ void HandlerBase::onEOM() noexcept
         VLOG(3) << str.str();
     }
 
-    ResponseBuilder builder(downstream_);
-    try 
+    try
     {
         if(postParser)
             postParser->onIngressEOM();
+        else if(formParser)
+            formParser->onIngressEOM();
+    }
+    catch(const HandlerError &err)
+    {
+        LOG(WARNING) << "HandlerError encountered finishing request body: "
+            << err.what();
+        refuseBody(err.getCode(), err.what());
+        VLOG(2) << "End " << __PRETTY_FUNCTION__;
+        return;
+    }
+    catch(const exception &e)
+    {
+        LOG(ERROR) << "Exception encountered finishing request body: "
+            << e.what();
+        refuseBody(500, "Internal error");
+        VLOG(2) << "End " << __PRETTY_FUNCTION__;
+        return;
+    }
+
+    if(pbCallback.isOverLimit() || (formParser && formParser->isOverLimit()))
+    {
+        refuseBody(413, "Payload Too Large");
+        VLOG(2) << "End " << __PRETTY_FUNCTION__;
+        return;
+    }
+
+    if(!pbCallback.waitForUploads([this]() { respond(); }))
+        respond();
+
+    VLOG(2) << "End " << __PRETTY_FUNCTION__;
+}
+
+void HandlerBase::respond() noexcept
+{
+    VLOG(2) << "Start " << __PRETTY_FUNCTION__;
+
+    ResponseBuilder builder(downstream_);
+    try 
+    {
+        if(sendNotModified() || sendCachedPage())
+        {
+            VLOG(2) << "End " << __PRETTY_FUNCTION__;
+            return;
+        }
+
+        streamingAllowed = true;
         processRequest();
+        streamingAllowed = false;
+
+        if(headersSent)
+        {
+            VLOG(1) << "Finish streamed response";
+            produceBody();
+
+            VLOG(2) << "End " << __PRETTY_FUNCTION__;
+            return;
+        }
 
         auto response = buildPageHeader();
         if(handlerResponse)
@@ -314,43 +794,35 @@ void HandlerBase::onEOM() noexcept
                 SiteTemplates::getTemplate("contentclose")
         )));
 
-        // Send the response that everything worked out well
-        builder.status(200, "OK")
-            .header(HTTP_HEADER_CONTENT_TYPE, "text/html")
-            .header(HTTP_HEADER_X_FRAME_OPTIONS, "DENY")
-            .header(HTTP_HEADER_X_CONTENT_TYPE_OPTIONS, "nosniff")
-            .header(HTTP_HEADER_PRAGMA, "no-cache")
-            .header(HTTP_HEADER_X_XSS_PROTECTION, "1; mode=block")
-            .header(HTTP_HEADER_CACHE_CONTROL, "no-cache, no-store, must-revalidate");
-
-        VLOG(1) << "Send cookies";
-        for(auto i : cookieJar)
+        if(gzip && response->computeChainDataLength() < config.compressionMinSize)
         {
-            VLOG(3) << "Add cookie " << i.first << "=" << i.second;
-            string cookie = i.first + "=" + i.second
-                + "; Secure; HttpOnly; Path=/; Domain=" + config.hostName;
-            VLOG(3) << "Cookie string: " << cookie;
-            builder.header(HTTP_HEADER_SET_COOKIE, cookie);
+            VLOG(1) << "Response too small to compress";
+            gzip.reset();
         }
+
+        // Send the response that everything worked out well
+        builder.status(200, "OK");
+        addPageHeaders(builder);
         
         VLOG(1) << "Send response body";
-        builder.body(std::move(response))
-            .sendWithEOM();
+        sendBody(builder, move(response), true);
     }
     catch (const HandlerRedirect &e)
     {
-        LOG(INFO) << "Redirecting user to " << e.getLocation();
-        builder.status(e.getCode(), e.getStatusText());
-
-        VLOG(1) << "Send cookies";
-        for(auto i : cookieJar)
+        if(headersSent)
         {
-            VLOG(3) << "Add cookie " << i.first << "=" << i.second;
-            string cookie = i.first + "=" + i.second
-                + "; Secure; HttpOnly; Path=/; Domain=" + config.hostName;
-            VLOG(3) << "Cookie string: " << cookie;
-            builder.header(HTTP_HEADER_SET_COOKIE, cookie);
+            LOG(ERROR) << "Redirect to " << e.getLocation()
+                << " requested after response started";
+            finishStreamedResponse("<p><a href=\"" + e.getLocation()
+                + "\">Continue</a></p>");
+
+            VLOG(2) << "End " << __PRETTY_FUNCTION__;
+            return;
         }
+
+        LOG(INFO) << "Redirecting user to " << e.getLocation();
+        builder.status(e.getCode(), e.getStatusText());
+        addCookieHeaders(builder);
             
         VLOG(1) << "Send redirect header";
         builder.header(HTTP_HEADER_LOCATION, e.getLocation())
@@ -361,9 +833,17 @@ void HandlerBase::onEOM() noexcept
     {
         LOG(WARNING) << "HandlerError encountered: " << err.what();
 
-        auto response = buildPageHeader();
         ostringstream msg;
         msg << "<p>" << err.what() << "</p>";
+        if(headersSent)
+        {
+            finishStreamedResponse(msg.str());
+
+            VLOG(2) << "End " << __PRETTY_FUNCTION__;
+            return;
+        }
+
+        auto response = buildPageHeader();
         response->prependChain(IOBuf::copyBuffer(msg.str()));
         response->prependChain(
             IOBuf::copyBuffer(SiteTemplates::getTemplate("contentclose"))
@@ -382,6 +862,14 @@ void HandlerBase::onEOM() noexcept
         LOG(ERROR) << "Exception encountered processing request: "
             << e.what();
 
+        if(headersSent)
+        {
+            finishStreamedResponse("<p>Something went really wrong</p>");
+
+            VLOG(2) << "End " << __PRETTY_FUNCTION__;
+            return;
+        }
+
         auto response = buildPageHeader();
         response->prependChain(IOBuf::copyBuffer("<p>Something went really wrong</p>"));
         response->prependChain(
@@ -401,14 +889,417 @@ void HandlerBase::onEOM() noexcept
     VLOG(2) << "End " << __PRETTY_FUNCTION__;
 }
 
+void HandlerBase::addPageHeaders(ResponseBuilder &builder)
+{
+    VLOG(2) << "Start " << __PRETTY_FUNCTION__;
+
+    builder.header(HTTP_HEADER_CONTENT_TYPE, "text/html")
+        .header(HTTP_HEADER_X_FRAME_OPTIONS, "DENY")
+        .header(HTTP_HEADER_X_CONTENT_TYPE_OPTIONS, "nosniff")
+        .header(HTTP_HEADER_X_XSS_PROTECTION, "1; mode=block");
+
+    if(gzip)
+    {
+        VLOG(1) << "Response is gzip compressed";
+        builder.header(HTTP_HEADER_CONTENT_ENCODING, "gzip");
+    }
+    addCacheHeaders(builder);
+
+    VLOG(2) << "End " << __PRETTY_FUNCTION__;
+}
+
+void HandlerBase::addCacheHeaders(ResponseBuilder &builder)
+{
+    VLOG(2) << "Start " << __PRETTY_FUNCTION__;
+
+    if(etag.size())
+    {
+        VLOG(1) << "Page can be revalidated";
+
+        // The compressed page is a different representation, so it needs
+        // its own strong ETag
+        builder.header(HTTP_HEADER_ETAG,
+            gzip ? etag.substr(0, etag.size() - 1) + "-gz\"" : etag);
+    }
+
+    if(publicResponse)
+    {
+        VLOG(1) << "Page can be stored by shared caches";
+        builder.header(HTTP_HEADER_CACHE_CONTROL, "public, s-maxage="
+                + to_string(config.proxyMaxAge) + ", stale-while-revalidate="
+                + to_string(config.proxyStaleWhileRevalidate))
+            .header(HTTP_HEADER_VARY, "Cookie, Accept-Encoding");
+    }
+    else if(etag.size())
+    {
+        builder.header(HTTP_HEADER_CACHE_CONTROL, "private, no-cache")
+            .header(HTTP_HEADER_VARY, "Accept-Encoding");
+    }
+    else
+    {
+        VLOG(1) << "Page can't be cached";
+        builder.header(HTTP_HEADER_PRAGMA, "no-cache")
+            .header(HTTP_HEADER_CACHE_CONTROL,
+                "no-cache, no-store, must-revalidate")
+            .header(HTTP_HEADER_VARY, "Accept-Encoding");
+    }
+
+    addCookieHeaders(builder);
+
+    VLOG(2) << "End " << __PRETTY_FUNCTION__;
+}
+
+bool HandlerBase::sendNotModified()
+{
+    VLOG(2) << "Start " << __PRETTY_FUNCTION__;
+
+    auto method = requestHeaders->getMethod();
+    if(!method || (*method != HTTPMethod::GET && *method != HTTPMethod::HEAD))
+    {
+        VLOG(1) << "Only GET and HEAD pages get an ETag";
+        VLOG(2) << "End " << __PRETTY_FUNCTION__;
+        return false;
+    }
+
+    auto version = getResourceVersion();
+    if(!version)
+    {
+        VLOG(1) << "No resource version for " << getPath();
+        VLOG(2) << "End " << __PRETTY_FUNCTION__;
+        return false;
+    }
+
+    auto tagSource = *version + "|" + SiteTemplates::getVersion() + "|"
+        + (session.userAuthenticated() ? "auth" : "anon");
+    VLOG(3) << "ETag source: " << tagSource;
+    unsigned char hash[32];
+    ssl::OpenSSLHash::sha256(MutableByteRange(hash, 32),
+        ByteRange((const unsigned char *)tagSource.c_str(), tagSource.size()));
+    etag = "\"" + Base64::urlEncode(ByteRange(hash, 32)) + "\"";
+    VLOG(3) << "ETag: " << etag;
+
+    auto ifNoneMatch = requestHeaders->getHeaders().getSingleOrEmpty(
+        HTTP_HEADER_IF_NONE_MATCH);
+    if(!HeaderUtil::etagMatches(ifNoneMatch, etag) &&
+        !HeaderUtil::etagMatches(ifNoneMatch,
+        etag.substr(0, etag.size() - 1) + "-gz\""))
+    {
+        VLOG(1) << "Client copy is stale or missing";
+        VLOG(2) << "End " << __PRETTY_FUNCTION__;
+        return false;
+    }
+
+    LOG(INFO) << "Page not modified";
+    ResponseBuilder builder(downstream_);
+    builder.status(304, "Not Modified");
+    addCacheHeaders(builder);
+    builder.sendWithEOM();
+
+    VLOG(2) << "End " << __PRETTY_FUNCTION__;
+    return true;
+}
+
+void HandlerBase::addCookieHeaders(ResponseBuilder &builder)
+{
+    VLOG(2) << "Start " << __PRETTY_FUNCTION__;
+
+    VLOG(1) << "Send cookies";
+    static const string attributes = "; Secure; HttpOnly; Path=/; Domain=";
+    for(auto &i : cookieJar)
+    {
+        VLOG(3) << "Add cookie " << i.first << "=" << i.second;
+        string cookie;
+        cookie.reserve(i.first.size() + 1 + i.second.size()
+            + attributes.size() + config.hostName.size());
+        cookie.append(i.first.data(), i.first.size()).append(1, '=')
+            .append(i.second.data(), i.second.size()).append(attributes)
+            .append(config.hostName);
+        VLOG(3) << "Cookie string: " << cookie;
+        builder.header(HTTP_HEADER_SET_COOKIE, cookie);
+    }
+
+    VLOG(2) << "End " << __PRETTY_FUNCTION__;
+}
+
+void HandlerBase::startStreaming()
+{
+    VLOG(2) << "Start " << __PRETTY_FUNCTION__;
+
+    if(!streamingAllowed || headersSent)
+    {
+        VLOG(1) << "Not streaming response";
+        VLOG(2) << "End " << __PRETTY_FUNCTION__;
+        return;
+    }
+
+    LOG(INFO) << "Streaming response";
+    ResponseBuilder builder(downstream_);
+    builder.status(200, "OK");
+    addPageHeaders(builder);
+
+    // Anything the handler built up before it knew it can stream goes out
+    // right after the page header
+    auto response = buildPageHeader();
+    if(handlerResponse)
+        response->prependChain(move(handlerResponse));
+
+    sendBody(builder, move(response), false);
+    headersSent = true;
+
+    VLOG(2) << "End " << __PRETTY_FUNCTION__;
+}
+
+void HandlerBase::setBodyProducer(function<bool()> producer)
+{
+    VLOG(2) << "Start " << __PRETTY_FUNCTION__;
+
+    if(headersSent)
+    {
+        VLOG(1) << "Defer body production to egress";
+        bodyProducer = move(producer);
+    }
+    else
+    {
+        VLOG(1) << "Not streaming, produce entire body";
+        while(producer());
+    }
+
+    VLOG(2) << "End " << __PRETTY_FUNCTION__;
+}
+
+void HandlerBase::produceBody()
+{
+    VLOG(2) << "Start " << __PRETTY_FUNCTION__;
+
+    try
+    {
+        while(bodyProducer && !egressPaused)
+        {
+            if(!bodyProducer())
+            {
+                VLOG(1) << "Body producer done";
+                bodyProducer = nullptr;
+            }
+        }
+    }
+    catch(const HandlerError &err)
+    {
+        LOG(WARNING) << "HandlerError encountered producing body: "
+            << err.what();
+        bodyProducer = nullptr;
+        finishStreamedResponse(string("<p>") + err.what() + "</p>");
+
+        VLOG(2) << "End " << __PRETTY_FUNCTION__;
+        return;
+    }
+    catch(const exception &e)
+    {
+        LOG(ERROR) << "Exception encountered producing body: " << e.what();
+        bodyProducer = nullptr;
+        finishStreamedResponse("<p>Something went really wrong</p>");
+
+        VLOG(2) << "End " << __PRETTY_FUNCTION__;
+        return;
+    }
+
+    if(!bodyProducer)
+    {
+        VLOG(1) << "Send page trailer";
+        ResponseBuilder builder(downstream_);
+        sendBody(builder,
+            IOBuf::copyBuffer(SiteTemplates::getTemplate("contentclose")), true);
+    }
+    else
+        VLOG(1) << "Egress paused, wait for resume";
+
+    VLOG(2) << "End " << __PRETTY_FUNCTION__;
+}
+
+void HandlerBase::sendBody(ResponseBuilder &builder, unique_ptr<IOBuf> body,
+    bool eom)
+{
+    VLOG(2) << "Start " << __PRETTY_FUNCTION__;
+
+    if(cacheResponse)
+    {
+        for(auto range : *body)
+            plainCopy.append((const char *)range.data(), range.size());
+    }
+
+    if(gzip)
+    {
+        VLOG(1) << "Compress body";
+        body = gzip->compress(*body, eom);
+        if(cacheResponse)
+        {
+            for(auto range : *body)
+                gzipCopy.append((const char *)range.data(), range.size());
+        }
+    }
+
+    builder.body(move(body));
+    if(eom)
+    {
+        builder.sendWithEOM();
+        if(cacheResponse)
+            storeCachedPage();
+    }
+    else
+        builder.send();
+
+    VLOG(2) << "End " << __PRETTY_FUNCTION__;
+}
+
+bool HandlerBase::sendCachedPage()
+{
+    VLOG(2) << "Start " << __PRETTY_FUNCTION__;
+
+    if(!publicResponse || etag.empty())
+    {
+        VLOG(1) << "Page is not cacheable";
+        VLOG(2) << "End " << __PRETTY_FUNCTION__;
+        return false;
+    }
+
+    auto page = PageCache::find(etag);
+    if(!page)
+    {
+        VLOG(1) << "Add page to cache once it's built";
+        cacheResponse = true;
+
+        VLOG(2) << "End " << __PRETTY_FUNCTION__;
+        return false;
+    }
+
+    if(gzip && !page->gzip)
+    {
+        VLOG(1) << "Cached page too small to compress";
+        gzip.reset();
+    }
+
+    LOG(INFO) << "Sending page from cache";
+    ResponseBuilder builder(downstream_);
+    builder.status(200, "OK");
+    addPageHeaders(builder);
+    builder.body(PageCache::toIOBuf(gzip ? page->gzip : page->plain))
+        .sendWithEOM();
+
+    VLOG(2) << "End " << __PRETTY_FUNCTION__;
+    return true;
+}
+
+void HandlerBase::storeCachedPage()
+{
+    VLOG(2) << "Start " << __PRETTY_FUNCTION__;
+
+    PageCache::Page page;
+    page.plain = make_shared<const string>(move(plainCopy));
+    if(gzip)
+    {
+        VLOG(1) << "Keep compressed page that was sent";
+        page.gzip = make_shared<const string>(move(gzipCopy));
+    }
+    else if(page.plain->size() >= config.compressionMinSize)
+    {
+        VLOG(1) << "Compress page for clients that accept gzip";
+        try
+        {
+            GzipStream compressor(config.compressionLevel);
+            auto compressed = compressor.compress(
+                *IOBuf::wrapBuffer(page.plain->data(), page.plain->size()),
+                true);
+            string gzipPage;
+            for(auto range : *compressed)
+                gzipPage.append((const char *)range.data(), range.size());
+            page.gzip = make_shared<const string>(move(gzipPage));
+        }
+        catch(const exception &e)
+        {
+            LOG(WARNING) << "Caching page without compressed copy: "
+                << e.what();
+        }
+    }
+    PageCache::store(etag, move(page));
+    cacheResponse = false;
+
+    VLOG(2) << "End " << __PRETTY_FUNCTION__;
+}
+
+bool HandlerBase::acceptsGzip(const string &acceptEncoding)
+{
+    return HeaderUtil::acceptsCoding(acceptEncoding, "gzip") ||
+        HeaderUtil::acceptsCoding(acceptEncoding, "x-gzip");
+}
+
+string HandlerBase::htmlEscape(StringPiece text)
+{
+    VLOG(2) << "Start " << __PRETTY_FUNCTION__;
+
+    string retVal;
+    retVal.reserve(text.size());
+    for(auto c : text)
+    {
+        switch(c)
+        {
+        case '&':
+            retVal += "&amp;";
+            break;
+        case '<':
+            retVal += "&lt;";
+            break;
+        case '>':
+            retVal += "&gt;";
+            break;
+        case '"':
+            retVal += "&quot;";
+            break;
+        case '\'':
+            retVal += "&#39;";
+            break;
+        default:
+            retVal += c;
+        }
+    }
+
+    VLOG(2) << "End " << __PRETTY_FUNCTION__;
+    return retVal;
+}
+
+void HandlerBase::sendBodyChunk(unique_ptr<IOBuf> chunk)
+{
+    VLOG(2) << "Start " << __PRETTY_FUNCTION__;
+
+    ResponseBuilder builder(downstream_);
+    sendBody(builder, move(chunk), false);
+
+    VLOG(2) << "End " << __PRETTY_FUNCTION__;
+}
+
+void HandlerBase::finishStreamedResponse(const string &msg)
+{
+    VLOG(2) << "Start " << __PRETTY_FUNCTION__;
+
+    LOG(WARNING) << "Closing out streamed response early";
+    cacheResponse = false;
+    auto response = IOBuf::copyBuffer(msg);
+    response->prependChain(
+        IOBuf::copyBuffer(SiteTemplates::getTemplate("contentclose"))
+    );
+    ResponseBuilder builder(downstream_);
+    sendBody(builder, move(response), true);
+
+    VLOG(2) << "End " << __PRETTY_FUNCTION__;
+}
+
 void HandlerBase::requestComplete() noexcept 
 {
     VLOG(2) << "Start " << __PRETTY_FUNCTION__;
 
     LOG(INFO) << "Done processing";
+    releaseUploadSlot();
 
     VLOG(2) << "End " << __PRETTY_FUNCTION__;
-    delete this;
+    recycle();
 }
 
 void HandlerBase::onError(ProxygenError ) noexcept 
@@ -416,25 +1307,79 @@ void HandlerBase::onError(ProxygenError ) noexcept
     VLOG(2) << "Start " << __PRETTY_FUNCTION__;
 
     LOG(INFO) << "Error encountered while processing request";
+    releaseUploadSlot();
 
     VLOG(2) << "End " << __PRETTY_FUNCTION__;
-    delete this;
+    recycle();
 }
 
-boost::optional<const HandlerBase::PostParam &> HandlerBase::getPostParam(const std::string &name) const
+void HandlerBase::releaseUploadSlot()
 {
     VLOG(2) << "Start " << __PRETTY_FUNCTION__;
 
-    boost::optional<const HandlerBase::PostParam &> retVal = boost::none;
-    try
+    if(uploadUser)
     {
-        VLOG(1) << "Check if params exists";
-        retVal = postParams.at(name);
+        UploadLimiter::release(*uploadUser);
+        uploadUser = boost::none;
     }
-    catch(out_of_range &e)
+
+    VLOG(2) << "End " << __PRETTY_FUNCTION__;
+}
+
+void HandlerBase::onEgressPaused() noexcept
+{
+    VLOG(2) << "Start " << __PRETTY_FUNCTION__;
+
+    VLOG(1) << "Egress paused";
+    egressPaused = true;
+
+    VLOG(2) << "End " << __PRETTY_FUNCTION__;
+}
+
+void HandlerBase::onEgressResumed() noexcept
+{
+    VLOG(2) << "Start " << __PRETTY_FUNCTION__;
+
+    VLOG(1) << "Egress resumed";
+    egressPaused = false;
+    if(bodyProducer)
+        produceBody();
+
+    VLOG(2) << "End " << __PRETTY_FUNCTION__;
+}
+
+boost::optional<string> HandlerBase::getQueryParam(const string &name) const
+{
+    VLOG(2) << "Start " << __PRETTY_FUNCTION__;
+
+    boost::optional<string> retVal = boost::none;
+    auto value = context.getQueryParam(name);
+    if(value)
     {
-        LOG(WARNING) << "POST param " << name << " does not exist";
+        string decoded;
+        if(UrlCodec::decode(*value, decoded))
+            retVal = move(decoded);
+        else
+            LOG(INFO) << "Malformed query param " << name;
     }
+    else
+        VLOG(1) << "No query param " << name;
+
+    VLOG(2) << "End " << __PRETTY_FUNCTION__;
+    return retVal;
+}
+
+boost::optional<const HandlerBase::PostParam &> HandlerBase::getPostParam(const std::string &name) const
+{
+    VLOG(2) << "Start " << __PRETTY_FUNCTION__;
+
+    boost::optional<const HandlerBase::PostParam &> retVal = boost::none;
+    VLOG(1) << "Check if params exists";
+    auto entry = postParams.find(name);
+    if(entry != postParams.end())
+        retVal = entry->second;
+    else
+        LOG(WARNING) << "POST param " << name << " does not exist";
 
     VLOG(2) << "End " << __PRETTY_FUNCTION__;
     return retVal;
@@ -0,0 +1,63 @@
+/*
+ * Copyright 2017-present Keith Mendoza
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <glog/logging.h>
+
+#include "HandlerPool.h"
+
+namespace mimeographer
+{
+
+size_t HandlerPoolBase::maxFree = 0;
+size_t HandlerPoolBase::maxConnections = 0;
+std::atomic<size_t> HandlerPoolBase::idleConnections(0);
+
+void HandlerPoolBase::init(const Config &config)
+{
+    VLOG(2) << "Start " << __PRETTY_FUNCTION__;
+
+    maxFree = config.handlerPoolSize;
+    maxConnections = config.handlerPoolConnections;
+    VLOG(1) << "Idle handlers per thread and type: " << maxFree;
+    VLOG(1) << "Idle DB connections kept in all: " << maxConnections;
+
+    VLOG(2) << "End " << __PRETTY_FUNCTION__;
+}
+
+bool HandlerPoolBase::takeConnection() noexcept
+{
+    VLOG(2) << "Start " << __PRETTY_FUNCTION__;
+
+    bool retVal = false;
+    auto count = idleConnections.load();
+    while(count < maxConnections &&
+        !(retVal = idleConnections.compare_exchange_weak(count, count + 1)));
+    VLOG(3) << "Idle DB connections: " << (retVal ? count + 1 : count);
+
+    VLOG(2) << "End " << __PRETTY_FUNCTION__;
+    return retVal;
+}
+
+void HandlerPoolBase::giveConnections(size_t count) noexcept
+{
+    VLOG(2) << "Start " << __PRETTY_FUNCTION__;
+
+    idleConnections -= count;
+    VLOG(3) << "Idle DB connections: " << idleConnections.load();
+
+    VLOG(2) << "End " << __PRETTY_FUNCTION__;
+}
+
+}
@@ -0,0 +1,96 @@
+/*
+ * Copyright 2017-present Keith Mendoza
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include <boost/algorithm/string.hpp>
+#include <glog/logging.h>
+
+#include "HeaderUtil.h"
+
+using namespace std;
+
+namespace mimeographer
+{
+
+bool HeaderUtil::etagMatches(const string &ifNoneMatch, const string &etag)
+{
+    VLOG(2) << "Start " << __PRETTY_FUNCTION__;
+
+    bool retVal = false;
+    string::size_type start = 0;
+    while(!retVal && start < ifNoneMatch.size())
+    {
+        auto end = ifNoneMatch.find(',', start);
+        if(end == string::npos)
+            end = ifNoneMatch.size();
+
+        auto tag = ifNoneMatch.substr(start, end - start);
+        tag.erase(0, tag.find_first_not_of(" \t"));
+        tag.erase(tag.find_last_not_of(" \t") + 1);
+
+        // If-None-Match uses the weak comparison
+        if(tag.compare(0, 2, "W/") == 0)
+            tag.erase(0, 2);
+        VLOG(3) << "Compare against " << tag;
+
+        retVal = (tag == "*" || tag == etag);
+        start = end + 1;
+    }
+
+    VLOG(2) << "End " << __PRETTY_FUNCTION__;
+    return retVal;
+}
+
+bool HeaderUtil::acceptsCoding(const string &acceptEncoding,
+    const string &coding)
+{
+    VLOG(2) << "Start " << __PRETTY_FUNCTION__;
+
+    bool retVal = false;
+    vector<string> codings;
+    boost::algorithm::split(codings, acceptEncoding,
+        boost::algorithm::is_any_of(","));
+    for(auto entry : codings)
+    {
+        string params;
+        auto paramStart = entry.find(';');
+        if(paramStart != string::npos)
+        {
+            params = entry.substr(paramStart + 1);
+            entry.erase(paramStart);
+        }
+        boost::algorithm::trim(entry);
+        boost::algorithm::to_lower(entry);
+        VLOG(3) << "Coding: " << entry << " params: " << params;
+
+        if(entry != coding)
+            continue;
+
+        // q=0 means the client refuses the coding
+        boost::algorithm::erase_all(params, " ");
+        auto q = params.find("q=");
+        retVal = (q == string::npos || strtod(params.c_str() + q + 2, nullptr) > 0);
+        break;
+    }
+
+    VLOG(2) << "End " << __PRETTY_FUNCTION__;
+    return retVal;
+}
+
+}
@@ -0,0 +1,290 @@
+/*
+ * Copyright 2017-present Keith Mendoza
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <cctype>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+
+#include <unistd.h>
+
+#ifdef HAVE_VIPS
+#include <vips/vips8>
+#endif
+
+#include <glog/logging.h>
+
+#include "ImagePipeline.h"
+#include "UploadStore.h"
+
+using namespace std;
+using namespace folly;
+
+#ifdef HAVE_VIPS
+using namespace vips;
+#endif
+
+namespace mimeographer
+{
+
+#ifdef HAVE_VIPS
+namespace
+{
+
+////
+/// Saver options for a copy. Each saver only takes its own options, so
+/// they're picked by the extension the saver is picked by
+/// \param path Path of the copy
+/// \param quality JPEG and WebP quality
+////
+VOption *saveOptions(const string &path, int quality)
+{
+    auto retVal = VImage::option();
+
+    // The copies are already turned and converted to sRGB, so none of the
+    // metadata is needed
+#if VIPS_MAJOR_VERSION > 8 || \
+    (VIPS_MAJOR_VERSION == 8 && VIPS_MINOR_VERSION >= 15)
+    retVal->set("keep", VIPS_FOREIGN_KEEP_NONE);
+#else
+    retVal->set("strip", true);
+#endif
+
+    auto extension = path.substr(path.rfind('.') + 1);
+    if(extension == "jpg" || extension == "jpeg")
+        retVal->set("Q", quality)->set("optimize_coding", true);
+    else if(extension == "webp")
+        retVal->set("Q", quality);
+    return retVal;
+}
+
+}
+#endif
+
+unique_ptr<Config> ImagePipeline::config;
+unique_ptr<CPUThreadPoolExecutor> ImagePipeline::executor;
+
+void ImagePipeline::init(const Config &config)
+{
+    VLOG(2) << "Start " << __PRETTY_FUNCTION__;
+
+#ifdef HAVE_VIPS
+    if(config.imageVariantWidths.empty() || config.imageThreads == 0)
+    {
+        LOG(INFO) << "Image variants turned off";
+        VLOG(2) << "End " << __PRETTY_FUNCTION__;
+        return;
+    }
+
+    if(VIPS_INIT("mimeographer"))
+    {
+        LOG(ERROR) << "Failed to start libvips: " << vips_error_buffer();
+        vips_error_clear();
+        VLOG(2) << "End " << __PRETTY_FUNCTION__;
+        return;
+    }
+
+    // The pool is where the parallelism comes from, and every image is
+    // only read once
+    vips_concurrency_set(1);
+    vips_cache_set_max(0);
+
+    ImagePipeline::config.reset(new Config(config));
+    executor.reset(new CPUThreadPoolExecutor(config.imageThreads,
+        make_shared<NamedThreadFactory>("ImagePipeline")));
+    LOG(INFO) << "Making image variants with " << config.imageThreads
+        << " threads";
+#else
+    LOG(INFO) << "Built without libvips, image variants not available";
+#endif
+
+    VLOG(2) << "End " << __PRETTY_FUNCTION__;
+}
+
+bool ImagePipeline::isImage(StringPiece path)
+{
+    VLOG(2) << "Start " << __PRETTY_FUNCTION__;
+
+    static const StringPiece extensions[] = { "jpg", "jpeg", "png", "webp" };
+
+    bool retVal = false;
+    auto dot = path.rfind('.');
+    if(dot != StringPiece::npos)
+    {
+        string extension;
+        for(auto c : path.subpiece(dot + 1))
+            extension += tolower(static_cast<unsigned char>(c));
+        for(auto &i : extensions)
+            retVal = retVal || i == extension;
+    }
+    VLOG(3) << path << (retVal ? " is" : " is not") << " an image";
+
+    VLOG(2) << "End " << __PRETTY_FUNCTION__;
+    return retVal;
+}
+
+void ImagePipeline::submit(const string &uploadDest, const string &path,
+    const string &sha256)
+{
+    VLOG(2) << "Start " << __PRETTY_FUNCTION__;
+
+    if(executor && isImage(path))
+    {
+        VLOG(1) << "Queueing " << path << " for image variants";
+        executor->add([uploadDest, path, sha256]()
+            {
+                makeVariants(uploadDest, path, sha256);
+            });
+    }
+
+    VLOG(2) << "End " << __PRETTY_FUNCTION__;
+}
+
+DBConn &ImagePipeline::connection()
+{
+    VLOG(2) << "Start " << __PRETTY_FUNCTION__;
+
+    static thread_local unique_ptr<DBConn> db;
+    if(!db || !db->checkConnection())
+    {
+        VLOG(1) << "Connecting image worker to the database";
+        db.reset(new DBConn(config->dbUser, config->dbPass, config->dbHost,
+            config->dbName, config->dbPort));
+    }
+
+    VLOG(2) << "End " << __PRETTY_FUNCTION__;
+    return *db;
+}
+
+void ImagePipeline::makeVariants(const string &uploadDest, const string &path,
+    const string &sha256)
+{
+    VLOG(2) << "Start " << __PRETTY_FUNCTION__;
+
+#ifdef HAVE_VIPS
+    auto base = uploadDest;
+    if(base.size() && base.back() == '/')
+        base.pop_back();
+    auto source = base + "/" + path;
+    VLOG(1) << "Making variants of " << source;
+
+    int width, height;
+    try
+    {
+        // Only the header is read here
+        auto original = VImage::new_from_file(source.c_str(),
+            VImage::option()->set("access", VIPS_ACCESS_SEQUENTIAL));
+        width = original.width();
+        height = original.height();
+
+        // Browsers show the image turned the way its EXIF says, and the
+        // copies come out already turned
+        if(original.get_typeof(VIPS_META_ORIENTATION) &&
+            original.get_int(VIPS_META_ORIENTATION) >= 5)
+            swap(width, height);
+        VLOG(3) << source << " is " << width << "x" << height;
+
+        connection().setUploadDimensions(sha256, width, height);
+    }
+    catch(const VError &e)
+    {
+        LOG(WARNING) << "Failed to read " << source << ": " << e.what();
+        VLOG(2) << "End " << __PRETTY_FUNCTION__;
+        return;
+    }
+    catch(const DBConn::DBError &e)
+    {
+        LOG(ERROR) << "Failed to save size of " << source << ": "
+            << e.what();
+        VLOG(2) << "End " << __PRETTY_FUNCTION__;
+        return;
+    }
+
+    // One copy failing doesn't stop the others
+    for(auto variantWidth : config->imageVariantWidths)
+    {
+        if(variantWidth >= static_cast<unsigned int>(width))
+            VLOG(1) << "No " << variantWidth << " wide variant of a "
+                << width << " wide image";
+        else
+            makeVariant(base, path, sha256, variantWidth);
+    }
+#else
+    VLOG(1) << "Built without libvips, " << path << " left as is";
+#endif
+
+    VLOG(2) << "End " << __PRETTY_FUNCTION__;
+}
+
+bool ImagePipeline::makeVariant(const string &base, const string &path,
+    const string &sha256, unsigned int width)
+{
+    VLOG(2) << "Start " << __PRETTY_FUNCTION__;
+
+    bool retVal = false;
+#ifdef HAVE_VIPS
+    auto source = base + "/" + path;
+    auto variant = UploadStore::variantPath(path, width);
+    auto slash = variant.rfind('/') + 1;
+    auto hidden = base + "/" + variant.substr(0, slash) + "." +
+        variant.substr(slash);
+    auto dest = base + "/" + variant;
+    VLOG(3) << "Writing " << hidden;
+
+    try
+    {
+        // The height is left unbounded so portrait images come out as wide
+        // as asked too
+        auto thumb = VImage::thumbnail(source.c_str(), width,
+            VImage::option()
+                ->set("height", VIPS_MAX_COORD)
+                ->set("size", VIPS_SIZE_DOWN));
+        thumb.write_to_file(hidden.c_str(), saveOptions(variant,
+            static_cast<int>(config->imageQuality)));
+
+        // Written under a hidden name so a half-written copy is never
+        // served or indexed
+        if(rename(hidden.c_str(), dest.c_str()))
+        {
+            auto err = errno;
+            LOG(ERROR) << "Failed to move " << hidden << " to " << dest
+                << ": " << strerror(err);
+            unlink(hidden.c_str());
+        }
+        else
+        {
+            connection().addUploadVariant(sha256, thumb.width(),
+                thumb.height(), variant);
+            LOG(INFO) << "Image variant stored as " << dest;
+            retVal = true;
+        }
+    }
+    catch(const VError &e)
+    {
+        LOG(WARNING) << "Failed to make " << variant << ": " << e.what();
+        unlink(hidden.c_str());
+    }
+    catch(const DBConn::DBError &e)
+    {
+        LOG(ERROR) << "Failed to save " << variant << ": " << e.what();
+    }
+#endif
+
+    VLOG(2) << "End " << __PRETTY_FUNCTION__;
+    return retVal;
+}
+
+}
@@ -0,0 +1,66 @@
+/*
+ * Copyright 2017-present Keith Mendoza
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <glog/logging.h>
+
+#include "MimeTypes.h"
+
+namespace mimeographer
+{
+
+constexpr MimeTypes::Entry MimeTypes::table[];
+constexpr size_t MimeTypes::tableSize;
+constexpr size_t MimeTypes::maxExtension;
+constexpr const char *MimeTypes::defaultType;
+
+const char *MimeTypes::find(const char *fileName, size_t length)
+{
+    static_assert(sorted(), "MIME table has to be sorted for binary search");
+
+    // The extension follows the last dot in the last path component
+    auto dot = length;
+    while(dot && fileName[dot - 1] != '.' && fileName[dot - 1] != '/')
+        dot--;
+    auto ext = fileName + dot;
+    auto extLength = length - dot;
+    if(!dot || fileName[dot - 1] != '.' || !extLength ||
+        extLength > maxExtension)
+    {
+        VLOG(3) << "No usable extension";
+        return defaultType;
+    }
+
+    size_t low = 0, high = tableSize;
+    while(low < high)
+    {
+        auto mid = low + (high - low) / 2;
+        auto rslt = compare(ext, extLength, table[mid].extension);
+        if(rslt == 0)
+        {
+            VLOG(3) << "Mime type: " << table[mid].type;
+            return table[mid].type;
+        }
+        else if(rslt < 0)
+            high = mid;
+        else
+            low = mid + 1;
+    }
+
+    VLOG(3) << "Unknown extension, use " << defaultType;
+    return defaultType;
+}
+
+}
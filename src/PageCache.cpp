@@ -0,0 +1,132 @@
+/*
+ * Copyright 2017-present Keith Mendoza
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <glog/logging.h>
+
+#include "PageCache.h"
+
+using namespace std;
+using namespace folly;
+
+namespace mimeographer
+{
+
+mutex PageCache::cacheLock;
+PageCache::PageList PageCache::pages;
+unordered_map<string, PageCache::PageList::iterator> PageCache::index;
+size_t PageCache::cacheBytes = 0;
+size_t PageCache::maxBytes = 0;
+
+void PageCache::init(const Config &config)
+{
+    VLOG(2) << "Start " << __PRETTY_FUNCTION__;
+
+    lock_guard<mutex> guard(cacheLock);
+    maxBytes = config.pageCacheBytes;
+    VLOG(1) << "Page cache size: " << maxBytes;
+    evict();
+
+    VLOG(2) << "End " << __PRETTY_FUNCTION__;
+}
+
+void PageCache::evict()
+{
+    VLOG(2) << "Start " << __PRETTY_FUNCTION__;
+
+    while(cacheBytes > maxBytes && pages.size())
+    {
+        auto &victim = pages.back();
+        VLOG(1) << "Evict page " << victim.first;
+        cacheBytes -= victim.second.plain->size() +
+            (victim.second.gzip ? victim.second.gzip->size() : 0);
+        index.erase(victim.first);
+        pages.pop_back();
+    }
+
+    VLOG(2) << "End " << __PRETTY_FUNCTION__;
+}
+
+boost::optional<PageCache::Page> PageCache::find(const string &key)
+{
+    VLOG(2) << "Start " << __PRETTY_FUNCTION__;
+
+    boost::optional<Page> retVal = boost::none;
+    lock_guard<mutex> guard(cacheLock);
+    auto entry = index.find(key);
+    if(entry != index.end())
+    {
+        VLOG(1) << "Page cache hit for " << key;
+        pages.splice(pages.begin(), pages, entry->second);
+        retVal = entry->second->second;
+    }
+    else
+        VLOG(1) << "Page cache miss for " << key;
+
+    VLOG(2) << "End " << __PRETTY_FUNCTION__;
+    return retVal;
+}
+
+void PageCache::store(const string &key, Page page)
+{
+    VLOG(2) << "Start " << __PRETTY_FUNCTION__;
+
+    if(!page.plain)
+    {
+        LOG(WARNING) << "Not caching page " << key << " without content";
+        VLOG(2) << "End " << __PRETTY_FUNCTION__;
+        return;
+    }
+
+    auto size = page.plain->size() + (page.gzip ? page.gzip->size() : 0);
+    lock_guard<mutex> guard(cacheLock);
+    if(size > maxBytes)
+    {
+        VLOG(1) << "Page " << key << " is bigger than the cache";
+        VLOG(2) << "End " << __PRETTY_FUNCTION__;
+        return;
+    }
+
+    auto entry = index.find(key);
+    if(entry != index.end())
+    {
+        VLOG(1) << "Replace cached page " << key;
+        auto &old = entry->second->second;
+        cacheBytes -= old.plain->size() + (old.gzip ? old.gzip->size() : 0);
+        pages.erase(entry->second);
+    }
+
+    pages.emplace_front(key, move(page));
+    index[key] = pages.begin();
+    cacheBytes += size;
+    VLOG(3) << "Page cache now using " << cacheBytes << " bytes";
+    evict();
+
+    VLOG(2) << "End " << __PRETTY_FUNCTION__;
+}
+
+unique_ptr<IOBuf> PageCache::toIOBuf(shared_ptr<const string> content)
+{
+    auto data = const_cast<char *>(content->data());
+    auto size = content->size();
+    return IOBuf::takeOwnership(data, size,
+        [](void *, void *userData)
+        {
+            delete static_cast<shared_ptr<const string> *>(userData);
+        },
+        new shared_ptr<const string>(move(content)));
+}
+
+}
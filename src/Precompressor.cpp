@@ -0,0 +1,203 @@
+/*
+ * Copyright 2017-present Keith Mendoza
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <atomic>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <boost/algorithm/string.hpp>
+#include <boost/filesystem.hpp>
+#include <glog/logging.h>
+
+#include "Precompressor.h"
+#include "GzipStream.h"
+#include "MimeTypes.h"
+
+using namespace std;
+using namespace folly;
+
+namespace mimeographer
+{
+
+bool Precompressor::compressible(const string &fileName)
+{
+    string type = MimeTypes::find(fileName);
+    return type.compare(0, 5, "text/") == 0 || type == "image/svg+xml" ||
+        boost::algorithm::ends_with(type, "json") ||
+        boost::algorithm::ends_with(type, "xml");
+}
+
+bool Precompressor::isFresh(const struct stat &sidecar,
+    const struct stat &source)
+{
+    return sidecar.st_mtim.tv_sec > source.st_mtim.tv_sec ||
+        (sidecar.st_mtim.tv_sec == source.st_mtim.tv_sec &&
+        sidecar.st_mtim.tv_nsec > source.st_mtim.tv_nsec);
+}
+
+bool Precompressor::writeGzip(const string &fileName, int level)
+{
+    VLOG(2) << "Start " << __PRETTY_FUNCTION__;
+
+    auto sidecar = fileName + ".gz";
+    struct stat srcInfo, gzInfo;
+    if(stat(fileName.c_str(), &srcInfo) != 0)
+    {
+        int err = errno;
+        LOG(ERROR) << "Failed to stat " << fileName << ". Cause: "
+            << strerror(err);
+        VLOG(2) << "End " << __PRETTY_FUNCTION__;
+        return false;
+    }
+    if(stat(sidecar.c_str(), &gzInfo) == 0 && isFresh(gzInfo, srcInfo))
+    {
+        VLOG(1) << sidecar << " is up to date";
+        VLOG(2) << "End " << __PRETTY_FUNCTION__;
+        return true;
+    }
+
+    string content;
+    {
+        ifstream in(fileName, ifstream::binary);
+        if(!in.is_open())
+        {
+            int err = errno;
+            LOG(ERROR) << "Failed to open " << fileName << ". Cause: "
+                << strerror(err);
+            VLOG(2) << "End " << __PRETTY_FUNCTION__;
+            return false;
+        }
+        ostringstream buf;
+        buf << in.rdbuf();
+        content = buf.str();
+    }
+
+    unique_ptr<IOBuf> compressed;
+    try
+    {
+        GzipStream gzip(level);
+        compressed = gzip.compress(
+            *IOBuf::wrapBuffer(content.data(), content.size()), true);
+    }
+    catch(const exception &e)
+    {
+        LOG(ERROR) << "Failed to compress " << fileName << ": " << e.what();
+        VLOG(2) << "End " << __PRETTY_FUNCTION__;
+        return false;
+    }
+
+    auto compressedSize = compressed->computeChainDataLength();
+    VLOG(3) << fileName << ": " << content.size() << " -> " << compressedSize;
+    if(compressedSize >= content.size())
+    {
+        LOG(INFO) << "Compressing doesn't shrink " << fileName
+            << ", no sidecar written";
+        unlink(sidecar.c_str());
+        VLOG(2) << "End " << __PRETTY_FUNCTION__;
+        return true;
+    }
+
+    // Write to a temp name first so StaticHandler never sees half a file
+    auto tmpName = sidecar + ".tmp";
+    {
+        ofstream out(tmpName, ofstream::binary | ofstream::trunc);
+        for(auto range : *compressed)
+            out.write((const char *)range.data(), range.size());
+        if(!out.good())
+        {
+            LOG(ERROR) << "Failed to write " << tmpName;
+            out.close();
+            unlink(tmpName.c_str());
+            VLOG(2) << "End " << __PRETTY_FUNCTION__;
+            return false;
+        }
+    }
+    if(rename(tmpName.c_str(), sidecar.c_str()) != 0)
+    {
+        int err = errno;
+        LOG(ERROR) << "Failed to rename " << tmpName << " to " << sidecar
+            << ". Cause: " << strerror(err);
+        unlink(tmpName.c_str());
+        VLOG(2) << "End " << __PRETTY_FUNCTION__;
+        return false;
+    }
+
+    LOG(INFO) << "Wrote " << sidecar << " (" << content.size() << " -> "
+        << compressedSize << " bytes)";
+    VLOG(2) << "End " << __PRETTY_FUNCTION__;
+    return true;
+}
+
+bool Precompressor::run(const string &dir, int level, size_t threads)
+{
+    VLOG(2) << "Start " << __PRETTY_FUNCTION__;
+
+    vector<string> fileNames;
+    try
+    {
+        using namespace boost::filesystem;
+        for(recursive_directory_iterator i(dir), end; i != end; ++i)
+        {
+            auto name = i->path().string();
+            if(is_regular_file(i->status()) && compressible(name))
+            {
+                VLOG(3) << "Found " << name;
+                fileNames.push_back(name);
+            }
+        }
+    }
+    catch(const boost::filesystem::filesystem_error &e)
+    {
+        LOG(ERROR) << "Failed to list " << dir << ": " << e.what();
+        VLOG(2) << "End " << __PRETTY_FUNCTION__;
+        return false;
+    }
+    LOG(INFO) << "Precompressing " << fileNames.size() << " files in " << dir;
+
+    atomic<size_t> next{0}, failed{0};
+    auto worker = [&]()
+    {
+        for(auto i = next++; i < fileNames.size(); i = next++)
+        {
+            if(!writeGzip(fileNames[i], level))
+                failed++;
+        }
+    };
+
+    vector<thread> workers;
+    for(size_t i = 1; i < max<size_t>(threads, 1); i++)
+        workers.emplace_back(worker);
+    worker();
+    for(auto &t : workers)
+        t.join();
+
+    if(failed)
+        LOG(ERROR) << failed << " of " << fileNames.size()
+            << " files failed to compress";
+
+    VLOG(2) << "End " << __PRETTY_FUNCTION__;
+    return failed == 0;
+}
+
+}
@@ -16,15 +16,16 @@
 #include <string>
 #include <exception>
 #include <utility>
-#include <regex>
 #include <sstream>
 #include <cstdlib>
+#include <vector>
 
 #include <glog/logging.h>
 #include <cmark.h>
 
 #include "PrimaryHandler.h"
 #include "HandlerError.h"
+#include "UploadStore.h"
 
 using namespace std;
 using namespace proxygen;
@@ -33,10 +34,63 @@ using namespace folly;
 namespace mimeographer 
 {
 
+namespace
+{
+
+// Headlines fetched per query when building the archive page
+const size_t archivePageSize = 50;
+
+}
+
+StringPiece PrimaryHandler::uploadHash(StringPiece url)
+{
+    VLOG(2) << "Start " << __PRETTY_FUNCTION__;
+
+    StringPiece retVal;
+    if(url.removePrefix("/uploads/"))
+        retVal = UploadStore::blobHash(url);
+
+    VLOG(2) << "End " << __PRETTY_FUNCTION__;
+    return retVal;
+}
+
+string PrimaryHandler::imageAttributes(const string &url)
+{
+    VLOG(2) << "Start " << __PRETTY_FUNCTION__;
+
+    auto hash = uploadHash(url);
+    auto image = hash.empty() ? images.end() : images.find(hash.str());
+    if(image == images.end())
+    {
+        VLOG(1) << "Size of " << url << " not known";
+        VLOG(2) << "End " << __PRETTY_FUNCTION__;
+        return "";
+    }
+
+    auto width = to_string(get<0>(image->second));
+    string retVal;
+    auto &variants = get<2>(image->second);
+    if(variants.size())
+    {
+        retVal = " srcset=\"";
+        for(auto &variant : variants)
+            retVal += "/uploads/" + get<1>(variant) + " " +
+                to_string(get<0>(variant)) + "w, ";
+        retVal += url + " " + width + "w\" sizes=\"(max-width: " + width +
+            "px) 100vw, " + width + "px\"";
+    }
+    retVal += " width=\"" + width + "\" height=\"" +
+        to_string(get<1>(image->second)) + "\"";
+    VLOG(3) << "Image attributes:" << retVal;
+
+    VLOG(2) << "End " << __PRETTY_FUNCTION__;
+    return retVal;
+}
+
 void PrimaryHandler::renderArticle(const string &data)
 {
     VLOG(2) << "Start " << __PRETTY_FUNCTION__;
-    unique_ptr<cmark_node, function<void(cmark_node*)>> rootNode(
+    shared_ptr<cmark_node> rootNode(
         cmark_parse_document(data.c_str(), data.size(),
             CMARK_OPT_DEFAULT),
         [](cmark_node *node)
@@ -55,12 +109,59 @@ void PrimaryHandler::renderArticle(const string &data)
             }
     ));
 
-    bool inItem = false;
+    // Look up every uploaded image up front so the whole article costs one
+    // query. Only stored uploads can have copies, so nothing else is asked
+    // about
+    vector<string> hashes;
+    {
+        auto walker = cmark_iter_new(rootNode.get());
+        cmark_event_type evType;
+        while((evType = cmark_iter_next(walker)) != CMARK_EVENT_DONE)
+        {
+            auto node = cmark_iter_get_node(walker);
+            if(evType != CMARK_EVENT_ENTER ||
+                cmark_node_get_type(node) != CMARK_NODE_IMAGE)
+                continue;
+
+            auto hash = uploadHash(cmark_node_get_url(node));
+            if(hash.size())
+                hashes.push_back(hash.str());
+        }
+        cmark_iter_free(walker);
+    }
+    VLOG(1) << "Uploaded images in article: " << hashes.size();
+
+    images.clear();
+    try
+    {
+        images = db.getImageVariants(hashes);
+    }
+    catch(const DBConn::DBError &e)
+    {
+        // The images still show without them
+        LOG(WARNING) << "Failed to get image variants: " << e.what();
+    }
+
+    auto inItem = make_shared<bool>(false);
+    setBodyProducer([this, rootNode, iterator, inItem]()
+        {
+            return renderBlock(rootNode.get(), iterator.get(), *inItem);
+        }
+    );
+
+    VLOG(2) << "End " << __PRETTY_FUNCTION__;
+}
+
+bool PrimaryHandler::renderBlock(cmark_node *rootNode, cmark_iter *iterator,
+    bool &inItem)
+{
+    VLOG(2) << "Start " << __PRETTY_FUNCTION__;
+
     string body;
     cmark_event_type evType;
-    while((evType = cmark_iter_next(iterator.get())) != CMARK_EVENT_DONE)
+    while((evType = cmark_iter_next(iterator)) != CMARK_EVENT_DONE)
     {
-        auto node = cmark_iter_get_node(iterator.get());
+        auto node = cmark_iter_get_node(iterator);
         auto nodeType = cmark_node_get_type(node);
         ostringstream chunk;
         if(evType == CMARK_EVENT_ENTER)
@@ -121,8 +222,16 @@ void PrimaryHandler::renderArticle(const string &data)
                 break;
             case CMARK_NODE_IMAGE:
                 VLOG(1) << "Begin 1st part of image tag";
-                chunk << "<img class=\"mx-auto d-block\" "
-                    << "src=\"" << cmark_node_get_url(node) << "\"";
+                {
+                    string url = cmark_node_get_url(node);
+                    auto sizeAttrs = imageAttributes(url);
+
+                    // Keep an image given its full width and height from
+                    // overflowing or stretching
+                    chunk << "<img class=\"mx-auto d-block"
+                        << (sizeAttrs.size() ? " img-fluid" : "") << "\" "
+                        << "src=\"" << url << "\"" << sizeAttrs;
+                }
                 {
                     string title = cmark_node_get_title(node);
                     if(title.size())
@@ -259,17 +368,33 @@ void PrimaryHandler::renderArticle(const string &data)
             VLOG(2) << "Append chunk to buffer";
             body += chunk.str();
         }
+
+        // Code blocks, HTML blocks and thematic breaks don't have exit
+        // events
+        if(cmark_node_parent(node) == rootNode && (evType == CMARK_EVENT_EXIT ||
+            nodeType == CMARK_NODE_CODE_BLOCK ||
+            nodeType == CMARK_NODE_HTML_BLOCK ||
+            nodeType == CMARK_NODE_THEMATIC_BREAK))
+        {
+            VLOG(1) << "Top-level block rendered";
+            break;
+        }
     }
 
-    VLOG(3) << "Body to prepend: \"" << body << "\"";
-    prependResponse(body);
+    if(body.size())
+    {
+        VLOG(3) << "Body to prepend: \"" << body << "\"";
+        prependResponse(body);
+    }
 
     VLOG(2) << "End " << __PRETTY_FUNCTION__;
+    return evType != CMARK_EVENT_DONE;
 }
 
 void PrimaryHandler::buildFrontPage()
 {
     VLOG(2) << "Start " << __PRETTY_FUNCTION__;
+    startStreaming();
     renderArticle(db.getLatestArticle());
     VLOG(2) << "End " << __PRETTY_FUNCTION__;
 }
@@ -278,27 +403,51 @@ void PrimaryHandler::buildArchive()
 {
     VLOG(2) << "Start " << __PRETTY_FUNCTION__;
 
-    string data;
-    for(auto article : db.getHeadlines())
-    {
-        ostringstream line;
-        line << "<h1><a href=\"/article/" << get<0>(article) << + "\">"
-            << get<1>(article) << "</a></h1>\n<div class=\"col col-12\" >"
-            << get<2>(article) << "\n</div>\n";
+    startStreaming();
 
-        if((data.capacity() - data.size()) < line.str().size())
-        {
-            VLOG(2) << "Loading existing list to buffer";
-            prependResponse(data);
-            data = line.str();
-        }
-        else
+    // Only a page of headlines is held at a time, so a slow client doesn't
+    // keep the whole archive in memory
+    struct Listing
+    {
+        DBConn::headline page;
+        DBConn::headline::size_type row = 0;
+        boost::optional<int> last;
+        bool lastPage = false;
+    };
+    auto listing = make_shared<Listing>();
+    setBodyProducer([this, listing]()
         {
-            VLOG(2) << "Append line to data buffer";
-            data = data + line.str();
+            if(listing->row >= listing->page.size())
+            {
+                if(listing->lastPage)
+                {
+                    VLOG(1) << "No more articles to list";
+                    return false;
+                }
+
+                listing->page = db.getHeadlines(listing->last,
+                    archivePageSize);
+                listing->row = 0;
+                listing->lastPage = listing->page.size() < archivePageSize;
+                VLOG(1) << "Got " << listing->page.size() << " headlines";
+                if(listing->page.empty())
+                {
+                    VLOG(1) << "No articles to list";
+                    return false;
+                }
+            }
+
+            auto &article = listing->page[listing->row++];
+            listing->last = get<0>(article);
+            ostringstream line;
+            line << "<h1><a href=\"/article/" << get<0>(article) << + "\">"
+                << get<1>(article) << "</a></h1>\n<div class=\"col col-12\" >"
+                << get<2>(article) << "\n</div>\n";
+            prependResponse(line.str());
+
+            return listing->row < listing->page.size() || !listing->lastPage;
         }
-    }
-    prependResponse(data);
+    );
     VLOG(1) << "Archive page processed";
 
     VLOG(2) << "End " << __PRETTY_FUNCTION__;
@@ -308,27 +457,32 @@ void PrimaryHandler::buildArticlePage()
 {
     VLOG(2) << "Start " << __PRETTY_FUNCTION__;
 
-    static regex parser("/article/(\\d+)");
-    smatch match;
-    if(regex_match(getPath(), match, parser))
+    auto param = route.param("id");
+    if(param)
     {
-        ssub_match id = match[1];
-        VLOG(2) << "Article id: " << id.str();
+        auto id = param->str();
+        VLOG(2) << "Article id: " << id;
+        string article;
         try
         {
-            renderArticle(db.getArticle(id.str()));
+            article = db.getArticle(id);
         }
         catch(const range_error &)
         {
             LOG(INFO) << "Caught unexpected number of articles";
 
             VLOG(2) << "End " << __PRETTY_FUNCTION__;
-            throw HandlerError(404, "Article " + id.str() + " not found");
+            throw HandlerError(404, "Article " + id + " not found");
         }
+
+        // Wait until the article is known to exist so a bad ID still gets
+        // a 404
+        startStreaming();
+        renderArticle(article);
     }
     else
     {
-        LOG(WARNING) << "path didn't parse";
+        LOG(WARNING) << "No article id in route";
 
         VLOG(2) << "End " << __PRETTY_FUNCTION__;
         throw HandlerError(404, "File not found");
@@ -337,34 +491,73 @@ void PrimaryHandler::buildArticlePage()
     VLOG(2) << "End " << __PRETTY_FUNCTION__;
 }
 
+boost::optional<string> PrimaryHandler::getResourceVersion()
+{
+    VLOG(2) << "Start " << __PRETTY_FUNCTION__;
+
+    boost::optional<string> retVal = boost::none;
+    switch(route.route)
+    {
+    case Route::FRONT_PAGE:
+        VLOG(1) << "Front page version";
+        retVal = db.getLatestArticleVersion();
+        break;
+    case Route::ARCHIVES:
+        VLOG(1) << "Archive version";
+        retVal = db.getArchiveVersion();
+        break;
+    case Route::ARTICLE:
+        VLOG(1) << "Article version";
+        retVal = db.getArticleVersion(route.param("id")->str());
+        break;
+    default:
+        VLOG(1) << "No version for " << getPath();
+    }
+
+    if(retVal)
+        retVal = getPath() + "|" + *retVal;
+
+    VLOG(2) << "End " << __PRETTY_FUNCTION__;
+    return retVal;
+}
+
+bool PrimaryHandler::isPublicPage() const
+{
+    VLOG(2) << "Start " << __PRETTY_FUNCTION__;
+
+    auto method = getMethod();
+    auto retVal = (method == "GET" || method == "HEAD") &&
+        (route.route == Route::FRONT_PAGE || route.route == Route::ARCHIVES ||
+         route.route == Route::ARTICLE);
+    VLOG(1) << getPath() << (retVal ? " is" : " is not") << " a public page";
+
+    VLOG(2) << "End " << __PRETTY_FUNCTION__;
+    return retVal;
+}
+
 void PrimaryHandler::processRequest() 
 {
     VLOG(2) << "Start " << __PRETTY_FUNCTION__;
 
-    auto path = getPath();
-    VLOG(2) << "path.substr(9): " << path.substr(0,9);
-    if(path == "/")
+    switch(route.route)
     {
+    case Route::FRONT_PAGE:
         VLOG(1) << "Process front page";
         buildFrontPage();
-    }
-    else if(path == "/archives")
-    {
+        break;
+    case Route::ARCHIVES:
         VLOG(1) << "Process archive";
         buildArchive();
-    }
-    else if(path.substr(0,9) == "/article/")
-    {
+        break;
+    case Route::ARTICLE:
         VLOG(1) << "Process article";
         buildArticlePage();
-    }
-    else
-    {
-        LOG(INFO) << path << " not handled";
+        break;
+    default:
+        LOG(INFO) << getPath() << " not handled";
 
         VLOG(2) << "End " << __PRETTY_FUNCTION__;
         throw HandlerError(404, "File not found");
-
     }
 
     VLOG(2) << "End " << __PRETTY_FUNCTION__;
@@ -0,0 +1,128 @@
+/*
+ * Copyright 2017-present Keith Mendoza
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <algorithm>
+#include <cstdlib>
+#include <new>
+
+#include <glog/logging.h>
+
+#include "RequestArena.h"
+
+using namespace std;
+
+namespace mimeographer
+{
+
+constexpr size_t RequestArena::inlineSize;
+constexpr size_t RequestArena::minBlockSize;
+constexpr size_t RequestArena::maxBlockSize;
+
+RequestArena::~RequestArena()
+{
+    VLOG(2) << "Start " << __PRETTY_FUNCTION__;
+
+    VLOG(1) << "Releasing " << allocated << " bytes of request arena";
+    while(blocks)
+    {
+        auto next = blocks->next;
+        free(blocks);
+        blocks = next;
+    }
+    free(spare);
+
+    VLOG(2) << "End " << __PRETTY_FUNCTION__;
+}
+
+void RequestArena::reset() noexcept
+{
+    VLOG(2) << "Start " << __PRETTY_FUNCTION__;
+
+    VLOG(1) << "Resetting request arena after " << allocated << " bytes";
+    while(blocks)
+    {
+        auto next = blocks->next;
+        if(blocks == current)
+        {
+            free(spare);
+            spare = current;
+        }
+        else
+            free(blocks);
+        blocks = next;
+    }
+
+    current = nullptr;
+    pos = inlineBlock;
+    end = inlineBlock + inlineSize;
+    nextBlockSize = minBlockSize;
+    allocated = 0;
+
+    VLOG(2) << "End " << __PRETTY_FUNCTION__;
+}
+
+void *RequestArena::allocateSlow(size_t size, size_t align)
+{
+    VLOG(2) << "Start " << __PRETTY_FUNCTION__;
+
+    // Room for the header and for aligning the start of the allocation
+    auto header = (sizeof(Block) + alignof(max_align_t) - 1) &
+        ~(alignof(max_align_t) - 1);
+    auto needed = size + max(align, alignof(max_align_t));
+    bool ownBlock = needed > nextBlockSize / 4;
+    auto blockSize = ownBlock ? needed : nextBlockSize;
+
+    Block *block;
+    if(!ownBlock && spare && spare->size >= blockSize)
+    {
+        VLOG(1) << "Reusing " << spare->size << " byte arena block";
+        block = spare;
+        blockSize = spare->size;
+        spare = nullptr;
+    }
+    else
+    {
+        block = static_cast<Block *>(malloc(header + blockSize));
+        if(!block)
+        {
+            LOG(ERROR) << "Failed to allocate " << header + blockSize
+                << " byte arena block";
+            throw bad_alloc();
+        }
+        block->size = blockSize;
+        VLOG(1) << "New " << blockSize << " byte arena block";
+    }
+    block->next = blocks;
+    blocks = block;
+
+    auto data = reinterpret_cast<char *>(block) + header;
+    auto start = reinterpret_cast<char *>(
+        (reinterpret_cast<uintptr_t>(data) + align - 1) & ~(align - 1));
+    allocated += size;
+
+    // A dedicated block is used up. Otherwise carry on from this one
+    if(!ownBlock)
+    {
+        current = block;
+        pos = start + size;
+        end = data + blockSize;
+        nextBlockSize = min(blockSize * 2, maxBlockSize);
+    }
+
+    VLOG(2) << "End " << __PRETTY_FUNCTION__;
+    return start;
+}
+
+}
@@ -0,0 +1,166 @@
+/*
+ * Copyright 2017-present Keith Mendoza
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <string>
+
+#include <glog/logging.h>
+
+#include "RequestContext.h"
+
+using namespace std;
+using namespace folly;
+using namespace proxygen;
+
+namespace mimeographer
+{
+
+namespace
+{
+
+StringPiece trimSpace(StringPiece str)
+{
+    while(!str.empty() && (str.front() == ' ' || str.front() == '\t'))
+        str.pop_front();
+    while(!str.empty() && (str.back() == ' ' || str.back() == '\t'))
+        str.pop_back();
+    return str;
+}
+
+}
+
+void RequestContext::parseCookies(StringPiece header, Fields &fields)
+{
+    VLOG(2) << "Start " << __PRETTY_FUNCTION__;
+
+    while(!header.empty())
+    {
+        auto end = header.find(';');
+        auto pair = header.subpiece(0, end);
+        if(end == StringPiece::npos)
+            header.clear();
+        else
+            header.advance(end + 1);
+
+        auto equal = pair.find('=');
+        if(equal == StringPiece::npos)
+        {
+            VLOG(1) << "Skipping cookie without a value";
+            continue;
+        }
+
+        auto name = trimSpace(pair.subpiece(0, equal));
+        auto value = trimSpace(pair.subpiece(equal + 1));
+        if(value.size() >= 2 && value.front() == '"' && value.back() == '"')
+        {
+            value.pop_front();
+            value.pop_back();
+        }
+
+        if(name.empty())
+        {
+            VLOG(1) << "Skipping cookie without a name";
+            continue;
+        }
+
+        VLOG(3) << "Cookie name: " << name << " value: " << value;
+        fields.emplace_back(name, value);
+    }
+
+    VLOG(2) << "End " << __PRETTY_FUNCTION__;
+}
+
+void RequestContext::parseQuery(StringPiece query, Fields &fields)
+{
+    VLOG(2) << "Start " << __PRETTY_FUNCTION__;
+
+    while(!query.empty())
+    {
+        auto end = query.find('&');
+        auto pair = query.subpiece(0, end);
+        if(end == StringPiece::npos)
+            query.clear();
+        else
+            query.advance(end + 1);
+
+        if(pair.empty())
+            continue;
+
+        auto equal = pair.find('=');
+        StringPiece name = pair.subpiece(0, equal);
+        StringPiece value;
+        if(equal != StringPiece::npos)
+            value = pair.subpiece(equal + 1);
+
+        VLOG(3) << "Query param name: " << name << " value: " << value;
+        fields.emplace_back(name, value);
+    }
+
+    VLOG(2) << "End " << __PRETTY_FUNCTION__;
+}
+
+boost::optional<StringPiece> RequestContext::find(const Fields &fields,
+    StringPiece name)
+{
+    VLOG(2) << "Start " << __PRETTY_FUNCTION__;
+
+    boost::optional<StringPiece> retVal = boost::none;
+    for(auto &i : fields)
+    {
+        if(i.first == name)
+        {
+            retVal = i.second;
+            break;
+        }
+    }
+
+    VLOG(2) << "End " << __PRETTY_FUNCTION__;
+    return retVal;
+}
+
+void RequestContext::parse(const HTTPMessage &message)
+{
+    VLOG(2) << "Start " << __PRETTY_FUNCTION__;
+
+    clear();
+    path = message.getPath();
+    query = message.getQueryString();
+    parseQuery(query, queryParams);
+
+    // HTTP/2 clients can send each cookie in a header of its own
+    message.getHeaders().forEachValueOfHeader(HTTP_HEADER_COOKIE,
+        [this](const string &value)
+        {
+            parseCookies(value, cookies);
+            return false;
+        });
+    VLOG(1) << "Request has " << cookies.size() << " cookies and "
+        << queryParams.size() << " query params";
+
+    VLOG(2) << "End " << __PRETTY_FUNCTION__;
+}
+
+void RequestContext::clear()
+{
+    VLOG(2) << "Start " << __PRETTY_FUNCTION__;
+
+    path.clear();
+    query.clear();
+    cookies.clear();
+    queryParams.clear();
+
+    VLOG(2) << "End " << __PRETTY_FUNCTION__;
+}
+
+}
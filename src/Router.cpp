@@ -0,0 +1,345 @@
+/*
+ * Copyright 2017-present Keith Mendoza
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <limits>
+#include <stdexcept>
+#include <string>
+
+#include <glog/logging.h>
+
+#include "Router.h"
+
+using namespace std;
+using namespace folly;
+
+namespace mimeographer
+{
+
+constexpr size_t RouteMatch::maxParams;
+
+boost::optional<StringPiece> RouteMatch::param(StringPiece name) const
+{
+    VLOG(2) << "Start " << __PRETTY_FUNCTION__;
+
+    boost::optional<StringPiece> retVal = boost::none;
+    for(size_t i = 0; i < paramCount; i++)
+    {
+        if(params[i].name == name)
+        {
+            retVal = params[i].value;
+            break;
+        }
+    }
+
+    VLOG(2) << "End " << __PRETTY_FUNCTION__;
+    return retVal;
+}
+
+boost::optional<int64_t> RouteMatch::intParam(StringPiece name) const
+{
+    VLOG(2) << "Start " << __PRETTY_FUNCTION__;
+
+    boost::optional<int64_t> retVal = boost::none;
+    for(size_t i = 0; i < paramCount; i++)
+    {
+        if(params[i].name == name)
+        {
+            retVal = params[i].intValue;
+            break;
+        }
+    }
+
+    VLOG(2) << "End " << __PRETTY_FUNCTION__;
+    return retVal;
+}
+
+Router::Router(initializer_list<Definition> routes)
+{
+    VLOG(2) << "Start " << __PRETTY_FUNCTION__;
+
+    for(auto &i : routes)
+        add(i);
+
+    VLOG(2) << "End " << __PRETTY_FUNCTION__;
+}
+
+Router::Node &Router::addParam(Node &node, StringPiece segment, bool last)
+{
+    VLOG(2) << "Start " << __PRETTY_FUNCTION__;
+
+    // Strip the braces
+    segment.advance(1);
+    segment.subtract(1);
+
+    StringPiece name = segment;
+    StringPiece type;
+    auto colon = segment.find(':');
+    if(colon != StringPiece::npos)
+    {
+        name = segment.subpiece(0, colon);
+        type = segment.subpiece(colon + 1);
+    }
+    if(name.empty())
+        throw invalid_argument("Route param without a name");
+
+    unique_ptr<Node> *child;
+    if(type.empty() || type == "str")
+        child = &node.stringChild;
+    else if(type == "int")
+        child = &node.intChild;
+    else if(type == "*")
+    {
+        if(!last)
+            throw invalid_argument("{" + name.str() +
+                ":*} has to be the last segment");
+        child = &node.restChild;
+    }
+    else
+        throw invalid_argument("Unknown route param type " + type.str());
+
+    if(!*child)
+    {
+        child->reset(new Node);
+        (*child)->param = name.str();
+    }
+    else if((*child)->param != name.str())
+    {
+        // The captured value only has one name to go by
+        throw invalid_argument("Route param " + name.str() +
+            " conflicts with " + (*child)->param);
+    }
+
+    VLOG(2) << "End " << __PRETTY_FUNCTION__;
+    return **child;
+}
+
+void Router::add(const Definition &definition)
+{
+    VLOG(2) << "Start " << __PRETTY_FUNCTION__;
+
+    StringPiece pattern(definition.pattern);
+    VLOG(1) << "Adding route " << definition.pattern;
+    if(pattern.empty() || pattern.front() != '/')
+        throw invalid_argument(string("Route ") + definition.pattern +
+            " doesn't start with /");
+    pattern.advance(1);
+
+    Node *node = &root;
+    size_t params = 0;
+    while(!pattern.empty())
+    {
+        auto slash = pattern.find('/');
+        auto segment = pattern.subpiece(0, slash);
+        if(slash == StringPiece::npos)
+            pattern.clear();
+        else
+            pattern.advance(slash + 1);
+
+        if(segment.empty())
+            throw invalid_argument(string("Route ") + definition.pattern +
+                " has an empty segment");
+
+        if(segment.front() == '{' && segment.back() == '}')
+        {
+            if(++params > RouteMatch::maxParams)
+                throw invalid_argument(string("Route ") + definition.pattern
+                    + " has too many params");
+            node = &addParam(*node, segment, pattern.empty());
+        }
+        else
+        {
+            Node *next = nullptr;
+            for(auto &i : node->literals)
+            {
+                if(i.first == segment.str())
+                {
+                    next = i.second.get();
+                    break;
+                }
+            }
+
+            if(!next)
+            {
+                node->literals.emplace_back(segment.str(),
+                    unique_ptr<Node>(new Node));
+                next = node->literals.back().second.get();
+            }
+            node = next;
+        }
+    }
+
+    if(node->terminal)
+        throw invalid_argument(string("Route ") + definition.pattern +
+            " is defined twice");
+
+    node->terminal = true;
+    node->route = definition.route;
+    node->handler = definition.handler;
+
+    VLOG(2) << "End " << __PRETTY_FUNCTION__;
+}
+
+bool Router::parseInt(StringPiece segment, int64_t &value) noexcept
+{
+    VLOG(2) << "Start " << __PRETTY_FUNCTION__;
+
+    if(segment.empty() ||
+        segment.size() > numeric_limits<int64_t>::digits10)
+    {
+        VLOG(2) << "End " << __PRETTY_FUNCTION__;
+        return false;
+    }
+
+    int64_t retVal = 0;
+    for(auto c : segment)
+    {
+        if(c < '0' || c > '9')
+        {
+            VLOG(2) << "End " << __PRETTY_FUNCTION__;
+            return false;
+        }
+        retVal = retVal * 10 + (c - '0');
+    }
+    value = retVal;
+
+    VLOG(2) << "End " << __PRETTY_FUNCTION__;
+    return true;
+}
+
+bool Router::matchNode(const Node &node, StringPiece rest,
+    RouteMatch &result) const noexcept
+{
+    VLOG(2) << "Start " << __PRETTY_FUNCTION__;
+
+    if(rest.empty() || (rest.size() == 1 && rest.front() == '/'))
+    {
+        if(node.terminal)
+        {
+            result.route = node.route;
+            result.handler = node.handler;
+        }
+
+        VLOG(2) << "End " << __PRETTY_FUNCTION__;
+        return node.terminal;
+    }
+
+    rest.advance(1);
+    auto slash = rest.find('/');
+    auto segment = rest.subpiece(0, slash);
+    auto after = slash == StringPiece::npos ?
+        StringPiece(rest.end(), rest.end()) : rest.subpiece(slash);
+
+    for(auto &i : node.literals)
+    {
+        if(StringPiece(i.first) == segment &&
+            matchNode(*i.second, after, result))
+        {
+            VLOG(2) << "End " << __PRETTY_FUNCTION__;
+            return true;
+        }
+    }
+
+    // Captures. Each one takes the next param slot and gives it back if
+    // the rest of the path doesn't match under it. add() made sure there
+    // is a slot left for any capture in the trie
+    auto slot = result.paramCount;
+    int64_t intValue;
+    if(node.intChild && parseInt(segment, intValue))
+    {
+        result.params[slot] = { node.intChild->param, segment, intValue };
+        result.paramCount++;
+        if(matchNode(*node.intChild, after, result))
+        {
+            VLOG(2) << "End " << __PRETTY_FUNCTION__;
+            return true;
+        }
+        result.paramCount--;
+    }
+
+    if(node.stringChild && !segment.empty())
+    {
+        result.params[slot] = { node.stringChild->param, segment, 0 };
+        result.paramCount++;
+        if(matchNode(*node.stringChild, after, result))
+        {
+            VLOG(2) << "End " << __PRETTY_FUNCTION__;
+            return true;
+        }
+        result.paramCount--;
+    }
+
+    if(node.restChild && !rest.empty())
+    {
+        result.params[slot] = { node.restChild->param, rest, 0 };
+        result.paramCount++;
+        result.route = node.restChild->route;
+        result.handler = node.restChild->handler;
+
+        VLOG(2) << "End " << __PRETTY_FUNCTION__;
+        return true;
+    }
+
+    VLOG(2) << "End " << __PRETTY_FUNCTION__;
+    return false;
+}
+
+RouteMatch Router::match(StringPiece path) const noexcept
+{
+    VLOG(2) << "Start " << __PRETTY_FUNCTION__;
+
+    RouteMatch retVal;
+    if(!matchNode(root, path, retVal))
+    {
+        VLOG(1) << "No route for " << path;
+        retVal = RouteMatch();
+    }
+
+    VLOG(2) << "End " << __PRETTY_FUNCTION__;
+    return retVal;
+}
+
+const Router &Router::site()
+{
+    static const Router router({
+        { "/", Route::FRONT_PAGE, RouteHandler::PRIMARY },
+        { "/archives", Route::ARCHIVES, RouteHandler::PRIMARY },
+        { "/article/{id:int}", Route::ARTICLE, RouteHandler::PRIMARY },
+
+        // Unknown /edit and /user pages still go to their handler so the
+        // login redirect happens before the 404
+        { "/edit", Route::EDIT_HOME, RouteHandler::EDIT },
+        { "/edit/new", Route::EDIT_NEW, RouteHandler::EDIT },
+        { "/edit/savearticle", Route::EDIT_SAVE_ARTICLE, RouteHandler::EDIT },
+        { "/edit/article", Route::EDIT_ARTICLE_LIST, RouteHandler::EDIT },
+        { "/edit/article/{id:int}", Route::EDIT_ARTICLE, RouteHandler::EDIT },
+        { "/edit/upload", Route::EDIT_UPLOAD, RouteHandler::EDIT },
+        { "/edit/viewupload", Route::EDIT_VIEW_UPLOAD, RouteHandler::EDIT },
+        { "/edit/{path:*}", Route::EDIT_UNKNOWN, RouteHandler::EDIT },
+
+        { "/user/login", Route::USER_LOGIN, RouteHandler::USER },
+        { "/user/logout", Route::USER_LOGOUT, RouteHandler::USER },
+        { "/user/changepass", Route::USER_CHANGE_PASS, RouteHandler::USER },
+        { "/user/add", Route::USER_ADD, RouteHandler::USER },
+        { "/user/{path:*}", Route::USER_UNKNOWN, RouteHandler::USER },
+
+        { "/static/{path:*}", Route::STATIC_FILE, RouteHandler::STATIC },
+        { "/uploads/{path:*}", Route::UPLOAD_FILE, RouteHandler::STATIC },
+        { "/favicon.ico", Route::FAVICON, RouteHandler::STATIC }
+    });
+
+    return router;
+}
+
+}
@@ -20,15 +20,20 @@
 #include <sstream>
 
 #include <glog/logging.h>
+#include <folly/ssl/OpenSSLHash.h>
+#include <proxygen/lib/utils/Base64.h>
 
 #include "SiteTemplates.h"
 
 using namespace std;
+using namespace folly;
+using namespace proxygen;
 
 namespace mimeographer
 {
 
 std::map<string, string> SiteTemplates::templateItems;
+string SiteTemplates::templateVersion;
 
 void SiteTemplates::init(const Config &config)
 {
@@ -90,6 +95,17 @@ void SiteTemplates::init(const Config &config)
         templateItems[i] = data;
     } //for(auto i in templateNames)
 
+    VLOG(1) << "Calculate template version";
+    string allTemplates;
+    for(auto i : templateItems)
+        allTemplates += i.first + "\n" + i.second;
+    unsigned char hash[32];
+    ssl::OpenSSLHash::sha256(MutableByteRange(hash, 32),
+        ByteRange((const unsigned char *)allTemplates.c_str(),
+            allTemplates.size()));
+    templateVersion = Base64::urlEncode(ByteRange(hash, 32));
+    VLOG(3) << "Template version: " << templateVersion;
+
     VLOG(2) << "End " << __PRETTY_FUNCTION__;
 }
 
@@ -98,4 +114,30 @@ const string &SiteTemplates::getTemplate(const string &name)
     return templateItems.at(name);
 }
 
+const string &SiteTemplates::getVersion()
+{
+    return templateVersion;
+}
+
+string SiteTemplates::buildPageHeader(bool authenticated)
+{
+    VLOG(2) << "Start " << __PRETTY_FUNCTION__;
+
+    string retVal = getTemplate("header") + getTemplate("navbase");
+    if(authenticated)
+    {
+        VLOG(1) << "User authenticated, add editor menu items";
+        retVal += getTemplate("editnav") + getTemplate("usernav");
+    }
+    else
+    {
+        VLOG(1) << "User not authenticated";
+        retVal += getTemplate("login");
+    }
+    retVal += getTemplate("navclose") + getTemplate("contentopen");
+
+    VLOG(2) << "End " << __PRETTY_FUNCTION__;
+    return retVal;
+}
+
 } //namespace
@@ -13,17 +13,32 @@
  * See the License for the specific language governing permissions and
  * limitations under the License.
  */
-#include <regex>
+#include <cerrno>
+#include <cstring>
+#include <ctime>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <uuid/uuid.h>
+
+#include <boost/algorithm/string.hpp>
 
 #include <proxygen/httpserver/RequestHandler.h>
 #include <proxygen/httpserver/ResponseBuilder.h>
 #include <folly/io/async/EventBaseManager.h>
 #include <folly/FileUtil.h>
-#include <folly/executors/GlobalExecutor.h>
 
 #include "StaticHandler.h"
+#include "FdCache.h"
+#include "FileCache.h"
+#include "FileIOService.h"
 #include "HandlerError.h"
+#include "HeaderUtil.h"
+#include "MimeTypes.h"
+#include "PageCache.h"
+#include "Precompressor.h"
 #include "SiteTemplates.h"
+#include "UploadStore.h"
+#include "UrlCodec.h"
 
 using namespace std;
 using namespace proxygen;
@@ -31,66 +46,225 @@ using namespace folly;
 
 namespace mimeographer {
 
-void StaticHandler::readFile(folly::EventBase* evb) 
+void StaticHandler::readNext()
 {
     VLOG(2) << "Start " << __PRETTY_FUNCTION__;
 
-    folly::IOBufQueue buf;
-    while (file_ && !paused_)
+    while(file_ && !paused_ && !readFileScheduled_)
     {
-        // read 4k-ish chunks and foward each one to the client
-        auto data = buf.preallocate(4000, 4000);
-        auto rc = folly::readNoInt(file_->fd(), data.first, data.second);
-        if (rc < 0)
+        if(segment_ == segments_.size())
         {
-            // error
-            VLOG(4) << "Read error=" << rc;
+            // done
             file_.reset();
-            evb->runInEventBaseThread(
-                [this] {
-                    LOG(ERROR) << "Error reading file";
-                    downstream_->sendAbort();
-                }
-            );
+            VLOG(1) << "All segments read";
+            if(cacheFill_)
+            {
+                VLOG(1) << "Add " << fileName << " to file cache";
+                FileCache::store(fileName, fileInfo_, contentType_,
+                    move(cacheCopy_));
+                cacheFill_ = false;
+            }
+            ResponseBuilder(downstream_)
+                .sendWithEOM();
             break;
         }
-        else if (rc == 0)
+
+        auto &segment = segments_[segment_];
+        if(!prefixSent_)
         {
-            // done
-            file_.reset();
-            VLOG(1) << "Read EOF";
-            evb->runInEventBaseThread(
-                [this] {
-                    ResponseBuilder(downstream_)
-                        .sendWithEOM();
-                }
-            );
-            break;
+            prefixSent_ = true;
+            if(segment.prefix.size())
+            {
+                VLOG(3) << "Send segment prefix";
+                ResponseBuilder(downstream_)
+                    .body(IOBuf::copyBuffer(segment.prefix))
+                    .send();
+                continue;
+            }
         }
-        else
+
+        size_t remaining = segment.length - segmentOffset_;
+        if(!remaining)
         {
-            buf.postallocate(rc);
-            evb->runInEventBaseThread(
-                [this, body=buf.move()] () mutable {
-                    ResponseBuilder(downstream_)
-                        .body(std::move(body))
-                        .send();
-                }
-            );
+            VLOG(3) << "Segment " << segment_ << " done";
+            segment_++;
+            segmentOffset_ = 0;
+            prefixSent_ = false;
+            continue;
         }
-    }
 
-    // Notify the request thread that we terminated the readFile loop
-    evb->runInEventBaseThread(
-        [this] {
-            readFileScheduled_ = false;
-            if (!checkForCompletion() && !paused_) 
+        // The completion comes back on this thread, and onRead() picks up
+        // from there
+        auto readSize = min<size_t>(remaining, 64 * 1024);
+        readFileScheduled_ = true;
+        FileIOService::get(EventBaseManager::get()->getEventBase()).read(
+            file_->fd(), readSize, segment.offset + segmentOffset_,
+            [this](unique_ptr<IOBuf> data, int err)
             {
-                VLOG(1) << "Resuming deferred readFile";
-                onEgressResumed();
-            }
+                onRead(move(data), err);
+            });
+    }
+
+    VLOG(2) << "End " << __PRETTY_FUNCTION__;
+}
+
+void StaticHandler::onRead(unique_ptr<IOBuf> data, int err)
+{
+    VLOG(2) << "Start " << __PRETTY_FUNCTION__;
+
+    readFileScheduled_ = false;
+    if(checkForCompletion())
+    {
+        VLOG(2) << "End " << __PRETTY_FUNCTION__;
+        return;
+    }
+
+    if(err || !data->length())
+    {
+        // error, or the file got shorter since it was stat()ed
+        LOG(ERROR) << "Error reading " << fileName << ": "
+            << (err ? strerror(err) : "unexpected end of file");
+        file_.reset();
+        downstream_->sendAbort();
+
+        VLOG(2) << "End " << __PRETTY_FUNCTION__;
+        return;
+    }
+
+    segmentOffset_ += data->length();
+    if(cacheFill_)
+        cacheCopy_.append((const char *)data->data(), data->length());
+    ResponseBuilder(downstream_)
+        .body(move(data))
+        .send();
+    readNext();
+
+    VLOG(2) << "End " << __PRETTY_FUNCTION__;
+}
+
+bool StaticHandler::mapFile()
+{
+    VLOG(2) << "Start " << __PRETTY_FUNCTION__;
+
+    size_t size = fileInfo_.st_size;
+    if(!size)
+    {
+        VLOG(1) << "Nothing to map in empty file";
+        VLOG(2) << "End " << __PRETTY_FUNCTION__;
+        return false;
+    }
+
+    // Touching a mapped page past the end of a file that got cut short
+    // raises SIGBUS, and the slices can still be queued on the transport
+    // long after this. Only uploads stored by their hash are never
+    // rewritten in place, so everything else is read
+    if(contentHash_.empty())
+    {
+        VLOG(1) << fileName << " can change while it's sent, read it instead";
+        VLOG(2) << "End " << __PRETTY_FUNCTION__;
+        return false;
+    }
+
+    // Copying a mapping faults if the file is cut short meanwhile, so small
+    // files headed for the cache are read instead
+    if(cacheFill_)
+    {
+        VLOG(1) << "Read " << fileName << " into the file cache instead";
+        VLOG(2) << "End " << __PRETTY_FUNCTION__;
+        return false;
+    }
+
+    auto addr = mmap(nullptr, size, PROT_READ, MAP_SHARED, file_->fd(), 0);
+    if(addr == MAP_FAILED)
+    {
+        int err = errno;
+        LOG(WARNING) << "Failed to mmap " << fileName << ". Cause: "
+            << strerror(err);
+        VLOG(2) << "End " << __PRETTY_FUNCTION__;
+        return false;
+    }
+
+    // Pages past the end of a file that shrank since it was stat()ed can't
+    // be touched, so don't send from a mapping of the wrong size
+    struct stat info;
+    if(fstat(file_->fd(), &info) || info.st_size != fileInfo_.st_size)
+    {
+        LOG(WARNING) << fileName << " changed since it was opened, not mapped";
+        munmap(addr, size);
+        VLOG(2) << "End " << __PRETTY_FUNCTION__;
+        return false;
+    }
+    madvise(addr, size, segments_.size() == 1 && segments_[0].length == fileInfo_.st_size ?
+        MADV_SEQUENTIAL : MADV_RANDOM);
+
+    // Slices sent to the client share this buffer, so the region gets
+    // unmapped once the last of them is written out
+    mapped_ = IOBuf::takeOwnership(addr, size,
+        [](void *buf, void *userData)
+        {
+            munmap(buf, reinterpret_cast<size_t>(userData));
+        },
+        reinterpret_cast<void *>(size));
+    file_.reset();
+    VLOG(1) << "Mapped " << size << " bytes of " << fileName;
+
+    VLOG(2) << "End " << __PRETTY_FUNCTION__;
+    return true;
+}
+
+void StaticHandler::sendMapped()
+{
+    VLOG(2) << "Start " << __PRETTY_FUNCTION__;
+
+    const size_t sliceSize = 64 * 1024;
+    while(mapped_ && !paused_)
+    {
+        unique_ptr<IOBuf> body;
+        auto &segment = segments_[segment_];
+        if(!prefixSent_)
+        {
+            prefixSent_ = true;
+            if(segment.prefix.size())
+                body = IOBuf::copyBuffer(segment.prefix);
+        }
+
+        size_t remaining = segment.length - segmentOffset_;
+        if(remaining)
+        {
+            auto slice = mapped_->cloneOne();
+            slice->trimStart(segment.offset + segmentOffset_);
+            slice->trimEnd(slice->length() - min(remaining, sliceSize));
+            segmentOffset_ += slice->length();
+            VLOG(3) << "Send mapped slice ending at "
+                << segment.offset + segmentOffset_;
+
+            if(body)
+                body->prependChain(move(slice));
+            else
+                body = move(slice);
         }
-    );
+
+        if(segmentOffset_ == segment.length)
+        {
+            VLOG(3) << "Segment " << segment_ << " done";
+            segment_++;
+            segmentOffset_ = 0;
+            prefixSent_ = false;
+        }
+
+        ResponseBuilder builder(downstream_);
+        if(body)
+            builder.body(move(body));
+
+        if(segment_ == segments_.size())
+        {
+            VLOG(1) << "Last mapped slice";
+            mapped_.reset();
+            builder.sendWithEOM();
+            break;
+        }
+        builder.send();
+    }
 
     VLOG(2) << "End " << __PRETTY_FUNCTION__;
 }
@@ -101,8 +275,8 @@ bool StaticHandler::checkForCompletion()
 
     if (finished_ && !readFileScheduled_)
     {
-        VLOG(1) << "deleting StaticHandler";
-        delete this;
+        VLOG(1) << "Releasing StaticHandler";
+        HandlerPool<StaticHandler>::release(this);
 
         VLOG(2) << "End " << __PRETTY_FUNCTION__;
         return true;
@@ -131,135 +305,479 @@ void StaticHandler::onRequest(std::unique_ptr<HTTPMessage> headers) noexcept
         return;
     }
 
-    VLOG(1) << "Collect cookies";
-    headers->getHeaders().forEachValueOfHeader(HTTPHeaderCode::HTTP_HEADER_COOKIE,
-        [this](const string &val)
-        {
-            parseCookies(val);
-            return false;
-        });
-
-    VLOG(1) << "Initialize session";
-    auto uuid = getCookie("session");
-    if(uuid)
-    {
-        VLOG(2) << "Session cookie available";
-        session.initSession(*uuid);
-    }
-    else
-    {
-        VLOG(2) << "Session cookie not available";
-        session.initSession();
-    }
-    addCookie("session", session.getUUID());
-
-    string contentType;
+    boost::optional<FileCache::File> cached;
     try
     {
-        // coverity[fun_call_w_exception]
-        static regex parser("/(static|uploads)/(.+)");
-        smatch match;
-        string path = parsePath(headers->getPath());
-        VLOG(3) << "Static file path: " << path;
-        if(regex_match(path, match, parser))
+        switch(route_.route)
+        {
+        case Route::STATIC_FILE:
+        case Route::UPLOAD_FILE:
         {
-            auto dir = match[1].str();
-            VLOG(3) << "Value of dir: " << dir;
-            if(dir == "static")
+            if(route_.route == Route::STATIC_FILE)
                 fileName = config.staticBase;
-            else if(dir == "uploads")
-                fileName = config.uploadDest;
             else
             {
-                LOG(ERROR) << "Unexpected dir '" << dir << "'";
-                throw HandlerError(500, "Internal Server Error");
+                fileName = config.uploadDest;
+                upload_ = true;
             }
 
-            fileName += "/" + match[2].str();
+            // The route is matched on the raw path so an encoded '/' can't
+            // change which route the request takes. parsePath() turns away
+            // decoded paths that would leave the directory
+            string path = parsePath(*route_.param("path"));
+            VLOG(3) << "Static file path: " << path;
+            if(upload_)
+                contentHash_ = UploadStore::blobHash(path).str();
+            fileName += "/" + path;
             VLOG(3) << "Local fileName: " << fileName;
-            file_ = std::make_unique<folly::File>(fileName.c_str());
-            contentType = findMimeType(fileName);
-        }
-        else if(path == "/favicon.ico")
-        {
-            contentType = "image/x-icon";
-            file_ = std::make_unique<folly::File>(config.staticBase + "/favicon.ico");
+            contentType_ = MimeTypes::find(fileName);
+            break;
         }
-        else
-        {
+        case Route::FAVICON:
+            contentType_ = "image/x-icon";
+            fileName = config.staticBase + "/favicon.ico";
+            break;
+        default:
             LOG(WARNING) << "File path not handled";
             throw HandlerError(404, "File Not Found");
         }
+
+        auto opened = FdCache::open(fileName);
+        if(!S_ISREG(opened.info.st_mode))
+            throw system_error(EISDIR, system_category(), "Not a file");
+        file_ = opened.file;
+        fileInfo_ = opened.info;
+
+        if(!upload_ && Precompressor::compressible(fileName))
+        {
+            varyEncoding_ = true;
+
+            // Byte ranges would have to be of the encoded file. Not worth
+            // it for the text files that have sidecars
+            if(headers->getHeaders().getSingleOrEmpty(HTTP_HEADER_RANGE).empty())
+                findSidecar(headers->getHeaders().getSingleOrEmpty(
+                    HTTP_HEADER_ACCEPT_ENCODING));
+        }
+
+        cached = FileCache::find(fileName, fileInfo_);
+        if(cached)
+            file_.reset();
+        else
+            cacheFill_ = FileCache::cacheable(fileInfo_.st_size);
     }
     catch (const std::system_error& ex) 
     {
         // coverity[fun_call_w_exception]
         LOG(WARNING) << "Error encountered opening file " << fileName
             << ". Cause: " << folly::to<string>(folly::exceptionStr(ex));
+        sendErrorPage(404, "Not Found", "File not found");
+        return;
+    }
+    catch (const HandlerError &err)
+    {
+        LOG(ERROR) << "Bad request for " << headers->getPath();
+        sendErrorPage(err.getCode(), err.what(), err.what());
 
-        auto response = buildPageHeader();
-        string msg("<p>File not found</p>");
-        response->prependChain(folly::IOBuf::copyBuffer(msg));
-        response->prependChain(
-            IOBuf::copyBuffer(SiteTemplates::getTemplate("contentclose"))
-        );
+        VLOG(2) << "End " << __PRETTY_FUNCTION__;
+        return;
+    }
+ 
+    // coverity[fun_call_w_exception]
+    ResponseBuilder builder(downstream_);
+    builder.header(HTTP_HEADER_X_FRAME_OPTIONS, "DENY")
+        .header(HTTP_HEADER_X_CONTENT_TYPE_OPTIONS, "nosniff")
+        .header(HTTP_HEADER_X_XSS_PROTECTION, "1; mode=block");
+    addCacheHeaders(builder);
 
-        ResponseBuilder(downstream_)
-            .status(404, "Not Found")
-            .header(HTTP_HEADER_CONTENT_TYPE, "text/html")
-            .header(HTTP_HEADER_X_XSS_PROTECTION, "1; mode=block")
-            .body(move(response))
+    if(notModified(*headers))
+    {
+        LOG(INFO) << fileName << " not modified";
+        file_.reset();
+        builder.status(304, "Not Modified")
             .sendWithEOM();
+
+        VLOG(2) << "End " << __PRETTY_FUNCTION__;
         return;
     }
-    catch (const HandlerError &err)
+
+    if(contentEncoding_.size())
+        builder.header(HTTP_HEADER_CONTENT_ENCODING, contentEncoding_);
+    if(cached)
+        contentType_ = cached->mimeType;
+    if(!planBody(*headers, builder))
     {
-        LOG(ERROR) << "Bad request for " << headers->getPath();
-        auto response = buildPageHeader();
-        ostringstream msg;
-        msg << "<p>" << err.what() << "</p>";
-        response->prependChain(folly::IOBuf::copyBuffer(msg.str()));
-        response->prependChain(
-            IOBuf::copyBuffer(SiteTemplates::getTemplate("contentclose"))
-        );
+        VLOG(2) << "End " << __PRETTY_FUNCTION__;
+        return;
+    }
+    builder.send();
+
+    if(cached)
+    {
+        VLOG(1) << "Send " << fileName << " from file cache";
+        auto content = PageCache::toIOBuf(cached->content);
+        auto body = IOBuf::create(0);
+        for(auto &segment : segments_)
+        {
+            if(segment.prefix.size())
+                body->prependChain(IOBuf::copyBuffer(segment.prefix));
+            if(segment.length)
+            {
+                auto slice = content->cloneOne();
+                slice->trimStart(segment.offset);
+                slice->trimEnd(slice->length() - segment.length);
+                body->prependChain(move(slice));
+            }
+        }
 
         ResponseBuilder(downstream_)
-            .status(err.getCode(), err.what())
-            .header(HTTP_HEADER_CONTENT_TYPE, "text/html")
-            .header(HTTP_HEADER_X_XSS_PROTECTION, "1; mode=block")
-            .body(move(response))
+            .body(move(body))
             .sendWithEOM();
 
         VLOG(2) << "End " << __PRETTY_FUNCTION__;
         return;
     }
- 
-    // coverity[fun_call_w_exception]
-    ResponseBuilder(downstream_)
-        .status(200, "Ok")
-        .header(HTTP_HEADER_CONTENT_TYPE, contentType)
-        .header(HTTP_HEADER_X_FRAME_OPTIONS, "DENY")
-        .header(HTTP_HEADER_X_CONTENT_TYPE_OPTIONS, "nosniff")
-        .header(HTTP_HEADER_CACHE_CONTROL, "no-cache, no-store, must-revalidate")
-        .header(HTTP_HEADER_PRAGMA, "no-cache")
-        .header(HTTP_HEADER_X_XSS_PROTECTION, "1; mode=block")
-        .send();
 
-    // use a CPU executor since read(2) of a file can block
-    readFileScheduled_ = true;
-    folly::getCPUExecutor()->add(
-        std::bind(&StaticHandler::readFile, this,
-        folly::EventBaseManager::get()->getEventBase())
-    );
+    // Over plaintext HTTP/1.x the mapped pages of an upload go from the page
+    // cache to the socket without being read into our own buffers first.
+    // TLS stays on the read path: whether the kernel took over the
+    // encryption is up to OpenSSL for each connection and can't be seen
+    // from here, and a mapping encrypted in userspace saves nothing. h2
+    // needs to frame every byte in userspace anyway
+    auto protocol = headers->getProtocolString();
+    if(!headers->isSecure() && (protocol == "1.1" || protocol == "1.0") &&
+        mapFile())
+    {
+        VLOG(1) << "Send mapped file";
+        sendMapped();
+
+        VLOG(2) << "End " << __PRETTY_FUNCTION__;
+        return;
+    }
+
+    readNext();
+
+    VLOG(2) << "End " << __PRETTY_FUNCTION__;
+}
+
+bool StaticHandler::planBody(const HTTPMessage &headers,
+    ResponseBuilder &builder)
+{
+    VLOG(2) << "Start " << __PRETTY_FUNCTION__;
+
+    off_t size = fileInfo_.st_size;
+    builder.header(HTTP_HEADER_ACCEPT_RANGES, "bytes");
+
+    // If-Range has either the ETag or the Last-Modified date, and either
+    // has to match exactly
+    boost::optional<ByteRanges> ranges = boost::none;
+    auto &range = headers.getHeaders().getSingleOrEmpty(HTTP_HEADER_RANGE);
+    auto &ifRange = headers.getHeaders().getSingleOrEmpty(HTTP_HEADER_IF_RANGE);
+    if(range.empty())
+        VLOG(1) << "Send entire file";
+    else if(ifRange.size() && ifRange != etag_ &&
+        ifRange != httpDate(fileInfo_.st_mtim.tv_sec))
+        VLOG(1) << "File changed since " << ifRange << ", send entire file";
+    else
+        ranges = parseRange(range, size);
+
+    segments_.clear();
+    segment_ = 0;
+    segmentOffset_ = 0;
+    prefixSent_ = false;
+    if(!ranges)
+    {
+        builder.status(200, "Ok")
+            .header(HTTP_HEADER_CONTENT_TYPE, contentType_)
+            .header(HTTP_HEADER_CONTENT_LENGTH, to_string(size));
+        segments_.push_back({ "", 0, size });
+    }
+    else if(ranges->empty())
+    {
+        LOG(INFO) << "Range " << range << " not satisfiable";
+        cacheFill_ = false;
+        file_.reset();
+        builder.status(416, "Range Not Satisfiable")
+            .header(HTTP_HEADER_CONTENT_RANGE, "bytes */" + to_string(size))
+            .sendWithEOM();
+
+        VLOG(2) << "End " << __PRETTY_FUNCTION__;
+        return false;
+    }
+    else
+    {
+        // Only whole files go into the cache
+        cacheFill_ = false;
+        builder.status(206, "Partial Content");
+        auto contentRange = [size](const pair<off_t, off_t> &r)
+        {
+            return "bytes " + to_string(r.first) + "-"
+                + to_string(r.first + r.second - 1) + "/" + to_string(size);
+        };
+
+        if(ranges->size() == 1)
+        {
+            VLOG(1) << "Send single range";
+            auto &r = ranges->front();
+            builder.header(HTTP_HEADER_CONTENT_TYPE, contentType_)
+                .header(HTTP_HEADER_CONTENT_RANGE, contentRange(r))
+                .header(HTTP_HEADER_CONTENT_LENGTH, to_string(r.second));
+            segments_.push_back({ "", r.first, r.second });
+        }
+        else
+        {
+            VLOG(1) << "Send " << ranges->size() << " ranges";
+            uuid_t uuid;
+            uuid_generate_random(uuid);
+            char boundary[37];
+            uuid_unparse_lower(uuid, boundary);
+
+            off_t length = 0;
+            for(auto &r : *ranges)
+            {
+                string prefix = string(segments_.empty() ? "" : "\r\n")
+                    + "--" + boundary + "\r\nContent-Type: " + contentType_
+                    + "\r\nContent-Range: " + contentRange(r) + "\r\n\r\n";
+                length += prefix.size() + r.second;
+                segments_.push_back({ move(prefix), r.first, r.second });
+            }
+            string trailer = string("\r\n--") + boundary + "--\r\n";
+            length += trailer.size();
+            segments_.push_back({ move(trailer), 0, 0 });
+
+            builder.header(HTTP_HEADER_CONTENT_TYPE,
+                    string("multipart/byteranges; boundary=") + boundary)
+                .header(HTTP_HEADER_CONTENT_LENGTH, to_string(length));
+        }
+    }
+
+    VLOG(2) << "End " << __PRETTY_FUNCTION__;
+    return true;
+}
+
+boost::optional<StaticHandler::ByteRanges> StaticHandler::parseRange(
+    const string &range, off_t size)
+{
+    VLOG(2) << "Start " << __PRETTY_FUNCTION__;
+
+    // More ranges than this is more likely abuse than a real client
+    const size_t maxRanges = 16;
+
+    static const string unit = "bytes=";
+    if(range.compare(0, unit.size(), unit) != 0)
+    {
+        LOG(INFO) << "Ignoring range with unknown unit: " << range;
+        VLOG(2) << "End " << __PRETTY_FUNCTION__;
+        return boost::none;
+    }
+
+    vector<string> specs;
+    auto specList = range.substr(unit.size());
+    boost::algorithm::split(specs, specList, boost::algorithm::is_any_of(","));
+    if(specs.size() > maxRanges)
+    {
+        LOG(INFO) << "Ignoring range with " << specs.size() << " parts";
+        VLOG(2) << "End " << __PRETTY_FUNCTION__;
+        return boost::none;
+    }
+
+    // Parse a non-empty string of digits
+    auto toOffset = [](const string &str) -> boost::optional<off_t>
+    {
+        if(str.empty() || str.size() > 18 ||
+            str.find_first_not_of("0123456789") != string::npos)
+            return boost::none;
+        return (off_t)stoll(str);
+    };
+
+    ByteRanges retVal;
+    for(auto spec : specs)
+    {
+        boost::algorithm::trim(spec);
+        auto dash = spec.find('-');
+        if(dash == string::npos)
+        {
+            LOG(INFO) << "Ignoring malformed range: " << range;
+            VLOG(2) << "End " << __PRETTY_FUNCTION__;
+            return boost::none;
+        }
+
+        auto first = spec.substr(0, dash);
+        auto last = spec.substr(dash + 1);
+        off_t start, end;
+        if(first.empty())
+        {
+            // Suffix range: the last N bytes
+            auto suffix = toOffset(last);
+            if(!suffix)
+            {
+                LOG(INFO) << "Ignoring malformed range: " << range;
+                VLOG(2) << "End " << __PRETTY_FUNCTION__;
+                return boost::none;
+            }
+            if(!*suffix || !size)
+            {
+                VLOG(3) << "Unsatisfiable suffix range " << spec;
+                continue;
+            }
+            start = *suffix < size ? size - *suffix : 0;
+            end = size - 1;
+        }
+        else
+        {
+            auto startVal = toOffset(first);
+            auto endVal = last.empty() ? boost::optional<off_t>(size - 1) :
+                toOffset(last);
+            if(!startVal || !endVal || *endVal < *startVal)
+            {
+                LOG(INFO) << "Ignoring malformed range: " << range;
+                VLOG(2) << "End " << __PRETTY_FUNCTION__;
+                return boost::none;
+            }
+            if(*startVal >= size)
+            {
+                VLOG(3) << "Unsatisfiable range " << spec;
+                continue;
+            }
+            start = *startVal;
+            end = min(*endVal, size - 1);
+        }
+
+        VLOG(3) << "Range " << start << "-" << end;
+        retVal.push_back(make_pair(start, end - start + 1));
+    }
+
+    VLOG(2) << "End " << __PRETTY_FUNCTION__;
+    return retVal;
+}
+
+void StaticHandler::addCacheHeaders(ResponseBuilder &builder)
+{
+    VLOG(2) << "Start " << __PRETTY_FUNCTION__;
+
+    if(contentHash_.size())
+        etag_ = "\"" + contentHash_ + "\"";
+    else
+    {
+        ostringstream etag;
+        etag << "\"" << hex << fileInfo_.st_ino << "-" << fileInfo_.st_size
+            << "-" << fileInfo_.st_mtim.tv_sec << "."
+            << fileInfo_.st_mtim.tv_nsec << "\"";
+        etag_ = etag.str();
+    }
+    VLOG(3) << "ETag: " << etag_;
+
+    string cacheControl = "public, max-age=" +
+        to_string(upload_ ? config.uploadMaxAge : config.staticMaxAge);
+    if(contentHash_.size() || (upload_ && config.uploadImmutable))
+    {
+        // Stored uploads are named after their content, and older uploads
+        // are UUID-prefixed, so a changed file is a new URL
+        cacheControl += ", immutable";
+    }
+    VLOG(3) << "Cache-Control: " << cacheControl;
+
+    builder.header(HTTP_HEADER_ETAG, etag_)
+        .header(HTTP_HEADER_LAST_MODIFIED, httpDate(fileInfo_.st_mtim.tv_sec))
+        .header(HTTP_HEADER_CACHE_CONTROL, cacheControl);
+    if(varyEncoding_)
+        builder.header(HTTP_HEADER_VARY, "Accept-Encoding");
 
     VLOG(2) << "End " << __PRETTY_FUNCTION__;
 }
 
+bool StaticHandler::notModified(const HTTPMessage &headers) const
+{
+    VLOG(2) << "Start " << __PRETTY_FUNCTION__;
+
+    bool retVal = false;
+    auto &ifNoneMatch =
+        headers.getHeaders().getSingleOrEmpty(HTTP_HEADER_IF_NONE_MATCH);
+    auto &ifModifiedSince =
+        headers.getHeaders().getSingleOrEmpty(HTTP_HEADER_IF_MODIFIED_SINCE);
+    if(ifNoneMatch.size())
+    {
+        VLOG(1) << "Check If-None-Match";
+        retVal = HeaderUtil::etagMatches(ifNoneMatch, etag_);
+    }
+    else if(ifModifiedSince.size())
+    {
+        VLOG(1) << "Check If-Modified-Since";
+        struct tm tmVal = {};
+        auto end = strptime(ifModifiedSince.c_str(),
+            "%a, %d %b %Y %H:%M:%S GMT", &tmVal);
+        if(!end || *end)
+            LOG(INFO) << "Ignoring bad If-Modified-Since " << ifModifiedSince;
+        else
+            retVal = fileInfo_.st_mtim.tv_sec <= timegm(&tmVal);
+    }
+
+    VLOG(2) << "End " << __PRETTY_FUNCTION__;
+    return retVal;
+}
+
+void StaticHandler::findSidecar(const string &acceptEncoding)
+{
+    VLOG(2) << "Start " << __PRETTY_FUNCTION__;
+
+    // In order of preference
+    static const vector<pair<string, string>> sidecars = {
+        { "br", ".br" },
+        { "gzip", ".gz" }
+    };
+
+    for(auto &sidecar : sidecars)
+    {
+        if(!HeaderUtil::acceptsCoding(acceptEncoding, sidecar.first))
+            continue;
+
+        auto sidecarName = fileName + sidecar.second;
+        FdCache::Entry opened;
+        try
+        {
+            opened = FdCache::open(sidecarName);
+        }
+        catch(const system_error &)
+        {
+            VLOG(3) << "No " << sidecarName;
+            continue;
+        }
+        if(!S_ISREG(opened.info.st_mode))
+        {
+            VLOG(3) << sidecarName << " is not a file";
+            continue;
+        }
+        if(!Precompressor::isFresh(opened.info, fileInfo_))
+        {
+            LOG(WARNING) << sidecarName << " isn't newer than " << fileName
+                << ", not using it";
+            continue;
+        }
+
+        VLOG(1) << "Send " << sidecarName << " instead of " << fileName;
+        fileName = sidecarName;
+        file_ = opened.file;
+        fileInfo_ = opened.info;
+        contentEncoding_ = sidecar.first;
+        break;
+    }
+
+    VLOG(2) << "End " << __PRETTY_FUNCTION__;
+}
+
+string StaticHandler::httpDate(time_t time)
+{
+    struct tm tmVal;
+    gmtime_r(&time, &tmVal);
+    char buf[64];
+    auto len = strftime(buf, sizeof(buf), "%a, %d %b %Y %H:%M:%S GMT", &tmVal);
+    return string(buf, len);
+}
+
 void StaticHandler::onEgressPaused() noexcept 
 {
     VLOG(2) << "Start " << __PRETTY_FUNCTION__;
 
-    // This will terminate readFile soon
+    // readNext() stops at the next piece, and onRead() won't start another
     VLOG(4) << "StaticHandler paused";
     paused_ = true;
     
@@ -272,22 +790,52 @@ void StaticHandler::onEgressResumed() noexcept
 
     VLOG(4) << "StaticHandler resumed";
     paused_ = false;
-    // If readFileScheduled_, it will reschedule itself
-    if (!readFileScheduled_ && file_)
+    if(mapped_)
     {
-        readFileScheduled_ = true;
-        folly::getCPUExecutor()->add(
-        std::bind(&StaticHandler::readFile, this,
-        folly::EventBaseManager::get()->getEventBase()));
+        VLOG(1) << "Resume sending mapped file";
+        sendMapped();
     }
+    // If a read is in flight, onRead() carries on once it's done
+    else if (!readFileScheduled_ && file_)
+        readNext();
     else
     {
-        VLOG(4) << "Deferred scheduling readFile";
+        VLOG(4) << "Deferred scheduling readNext";
     }
     
     VLOG(2) << "End " << __PRETTY_FUNCTION__;
 }
 
+bool StaticHandler::reset() noexcept
+{
+    VLOG(2) << "Start " << __PRETTY_FUNCTION__;
+
+    route_ = RouteMatch();
+    file_.reset();
+    readFileScheduled_ = false;
+    paused_ = false;
+    finished_ = false;
+    fileName.clear();
+    fileInfo_ = {};
+    contentType_.clear();
+    etag_.clear();
+    upload_ = false;
+    contentHash_.clear();
+    contentEncoding_.clear();
+    varyEncoding_ = false;
+    cacheFill_ = false;
+    // A cache fill copy is at most fileCacheMaxEntry so it's worth keeping
+    cacheCopy_.clear();
+    segments_.clear();
+    segment_ = 0;
+    segmentOffset_ = 0;
+    prefixSent_ = false;
+    mapped_.reset();
+
+    VLOG(2) << "End " << __PRETTY_FUNCTION__;
+    return true;
+}
+
 void StaticHandler::requestComplete() noexcept 
 {
     VLOG(2) << "Start " << __PRETTY_FUNCTION__;
@@ -299,102 +847,63 @@ void StaticHandler::requestComplete() noexcept
     VLOG(2) << "End " << __PRETTY_FUNCTION__;
 }
 
-string StaticHandler::parsePath(const string &path)
+string StaticHandler::parsePath(StringPiece path)
 {
     VLOG(2) << "Start " << __PRETTY_FUNCTION__;
 
     string retVal;
-    for(auto p = path.begin(); p != path.end(); p++)
+    if(!UrlCodec::decode(path, retVal))
     {
-        VLOG(3) << "Value of p: " << *p;
-        if(*p == '+')
-        {
-            VLOG(3) << "Replacing '+' with <space>";
-            retVal += ' ';
-        }
-        else if(*p == '%')
-        {
-            VLOG(3) << "Handle hex-encoded char";
-            p++;
-            string tmp;
-            tmp += *p;
-            p++;
-            tmp += *p;
-            VLOG(3) << "Value of tmp: " << tmp;
-            size_t pos;
-            try
-            {
-                char chr = stoi(tmp, &pos, 16);
-                VLOG(3) << "Value of chr: " << (int)chr;
-                VLOG(3) << "Value of pos: " << pos;
-                if(pos != 2)
-                    throw logic_error("Failed to convert " + tmp);
-                retVal += chr;
-            }
-            catch (const logic_error &e)
-            {
-                LOG(INFO) << "Failed to convert " << tmp << " to integer";
-                VLOG(2) << "End " << __PRETTY_FUNCTION__;
-                throw HandlerError(400, "Bad Request");
-            }
-        }
-        else
+        LOG(INFO) << "Malformed %-escape in path";
+        VLOG(2) << "End " << __PRETTY_FUNCTION__;
+        throw HandlerError(400, "Bad Request");
+    }
+
+    VLOG(3) << "Decoded path: " << retVal;
+
+    // The decoded path goes after staticBase or uploadDest as is, so it
+    // can't be allowed to climb out of them
+    if(retVal.find('\0') != string::npos)
+    {
+        LOG(INFO) << "NUL in path";
+        VLOG(2) << "End " << __PRETTY_FUNCTION__;
+        throw HandlerError(400, "Bad Request");
+    }
+
+    StringPiece rest(retVal);
+    while(rest.size())
+    {
+        if(rest.split_step('/') == "..")
         {
-            VLOG(3) << "Append char";
-            retVal += *p;
+            LOG(INFO) << "Parent directory in path " << retVal;
+            VLOG(2) << "End " << __PRETTY_FUNCTION__;
+            throw HandlerError(404, "File Not Found");
         }
     }
 
-    VLOG(3) << "Value to return: " << retVal;
     VLOG(2) << "End " << __PRETTY_FUNCTION__;
-    return move(retVal);
+    return retVal;
 }
 
-string StaticHandler::findMimeType(const string &fileName)
+void StaticHandler::sendErrorPage(int code, const string &status,
+    const string &msg)
 {
-    static map<string, string> mimeMap = {
-        { "bmp", "image/bmp" },
-        { "cod", "image/cis-cod" },
-        { "gif", "image/gif" },
-        { "ief", "image/ief" },
-        { "jpe", "image/jpeg" },
-        { "jpeg", "image/jpeg" },
-        { "jpg", "image/jpeg" },
-        { "jfif", "image/pipeg" },
-        { "svg", "image/svg+xml" },
-        { "tif", "image/tiff" },
-        { "tiff", "image/tiff" },
-        { "ras", "image/x-cmu-raster" },
-        { "cmx", "image/x-cmx" },
-        { "ico", "image/x-icon" },
-        { "pnm", "image/x-portable-anymap" },
-        { "pbm", "image/x-portable-bitmap" },
-        { "pgm", "image/x-portable-graymap" },
-        { "ppm", "image/x-portable-pixmap" },
-        { "rgb", "image/x-rgb" },
-        { "xbm", "image/x-xbitmap" },
-        { "xpm", "image/x-xpixmap" },
-        { "xwd", "image/x-xwindowdump" }
-    };
+    VLOG(2) << "Start " << __PRETTY_FUNCTION__;
 
-    auto dotPos = fileName.rfind(".");
-    VLOG(3) << "Value of dotPos: " << dotPos;
-    auto extension = fileName.substr(dotPos+1);
-    VLOG(3) << "Value of extension: " << extension;
-    string retVal;
-    try
-    {
-        retVal = mimeMap.at(extension);
-        VLOG(1) << "Mime type found for " << extension;
-    }
-    catch(out_of_range &e)
-    {
-        VLOG(1) << "No mime type for " << extension;
-        retVal = "application/octet-stream";
-    }
+    auto response = IOBuf::copyBuffer(SiteTemplates::buildPageHeader(false));
+    response->prependChain(IOBuf::copyBuffer("<p>" + msg + "</p>"));
+    response->prependChain(
+        IOBuf::copyBuffer(SiteTemplates::getTemplate("contentclose"))
+    );
 
-    VLOG(3) << "Mime type to return: " << retVal;
-    return retVal;
+    ResponseBuilder(downstream_)
+        .status(code, status)
+        .header(HTTP_HEADER_CONTENT_TYPE, "text/html")
+        .header(HTTP_HEADER_X_XSS_PROTECTION, "1; mode=block")
+        .body(move(response))
+        .sendWithEOM();
+
+    VLOG(2) << "End " << __PRETTY_FUNCTION__;
 }
 
 void StaticHandler::onError(ProxygenError /*err*/) noexcept
@@ -0,0 +1,85 @@
+/*
+ * Copyright 2017-present Keith Mendoza
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <glog/logging.h>
+
+#include "UploadLimiter.h"
+
+using namespace std;
+
+namespace mimeographer
+{
+
+mutex UploadLimiter::lock;
+unordered_map<int, unsigned int> UploadLimiter::active;
+unsigned int UploadLimiter::perUser = 2;
+
+void UploadLimiter::init(const Config &config)
+{
+    VLOG(2) << "Start " << __PRETTY_FUNCTION__;
+
+    perUser = config.uploadsPerUser;
+    VLOG(1) << "Uploads each user can have going at once: " << perUser;
+
+    VLOG(2) << "End " << __PRETTY_FUNCTION__;
+}
+
+bool UploadLimiter::acquire(int userId)
+{
+    VLOG(2) << "Start " << __PRETTY_FUNCTION__;
+
+    bool retVal = false;
+    {
+        // Refused users don't get an entry left behind
+        lock_guard<mutex> guard(lock);
+        auto entry = active.find(userId);
+        unsigned int count = entry == active.end() ? 0 : entry->second;
+        if(count < perUser)
+        {
+            if(entry == active.end())
+                active.emplace(userId, 1);
+            else
+                entry->second++;
+            count++;
+            retVal = true;
+        }
+        VLOG(3) << "User " << userId << " has " << count
+            << " uploads going";
+    }
+
+    if(!retVal)
+        LOG(INFO) << "User " << userId << " is at the limit of " << perUser
+            << " uploads at once";
+
+    VLOG(2) << "End " << __PRETTY_FUNCTION__;
+    return retVal;
+}
+
+void UploadLimiter::release(int userId)
+{
+    VLOG(2) << "Start " << __PRETTY_FUNCTION__;
+
+    lock_guard<mutex> guard(lock);
+    auto entry = active.find(userId);
+    if(entry == active.end())
+        LOG(ERROR) << "User " << userId << " has no upload slot to release";
+    else if(--entry->second == 0)
+        active.erase(entry);
+
+    VLOG(2) << "End " << __PRETTY_FUNCTION__;
+}
+
+}
@@ -0,0 +1,288 @@
+/*
+ * Copyright 2017-present Keith Mendoza
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <cctype>
+#include <cerrno>
+#include <cstring>
+
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include <boost/filesystem.hpp>
+#include <glog/logging.h>
+
+#include "ImagePipeline.h"
+#include "UploadStore.h"
+
+using namespace std;
+using namespace folly;
+using namespace boost::filesystem;
+
+namespace mimeographer
+{
+
+string UploadStore::hex(ByteRange hash)
+{
+    static const char hexDigits[] = "0123456789abcdef";
+    string retVal;
+    retVal.reserve(hash.size() * 2);
+    for(auto c : hash)
+    {
+        retVal += hexDigits[c >> 4];
+        retVal += hexDigits[c & 0xF];
+    }
+    return retVal;
+}
+
+string UploadStore::blobPath(StringPiece sha256, StringPiece filename)
+{
+    VLOG(2) << "Start " << __PRETTY_FUNCTION__;
+
+    string retVal;
+    retVal.reserve(sha256.size() + 12);
+    retVal.append(sha256.data(), 2);
+    retVal += '/';
+    retVal.append(sha256.data(), sha256.size());
+
+    // Only keep an extension that's plainly one, lowercased so the same
+    // file sent as .JPG and .jpg is stored once
+    const size_t maxExtension = 8;
+    auto dot = filename.rfind('.');
+    if(dot != StringPiece::npos && dot + 1 < filename.size() &&
+        filename.size() - dot - 1 <= maxExtension)
+    {
+        string extension(".");
+        for(auto c : filename.subpiece(dot + 1))
+        {
+            if(!isalnum(static_cast<unsigned char>(c)))
+            {
+                extension.clear();
+                break;
+            }
+            extension += tolower(static_cast<unsigned char>(c));
+        }
+        retVal += extension;
+    }
+    VLOG(3) << "Blob path: " << retVal;
+
+    VLOG(2) << "End " << __PRETTY_FUNCTION__;
+    return retVal;
+}
+
+StringPiece UploadStore::splitBlobPath(StringPiece path, StringPiece &rest)
+{
+    const size_t hashLength = 64;
+    StringPiece retVal;
+    if(path.size() >= hashLength + 3 && path[2] == '/' &&
+        path.subpiece(0, 2) == path.subpiece(3, 2))
+    {
+        auto hash = path.subpiece(3, hashLength);
+        bool isHex = true;
+        for(auto c : hash)
+            isHex = isHex && ((c >= '0' && c <= '9') || (c >= 'a' && c <= 'f'));
+        if(isHex)
+        {
+            retVal = hash;
+            rest = path.subpiece(3 + hashLength);
+        }
+    }
+    return retVal;
+}
+
+bool UploadStore::isExtension(StringPiece rest)
+{
+    if(rest.empty())
+        return true;
+    if(rest.size() < 2 || rest.front() != '.')
+        return false;
+
+    for(auto c : rest.subpiece(1))
+    {
+        if(!isalnum(static_cast<unsigned char>(c)))
+            return false;
+    }
+    return true;
+}
+
+StringPiece UploadStore::blobHash(StringPiece path)
+{
+    VLOG(2) << "Start " << __PRETTY_FUNCTION__;
+
+    StringPiece rest;
+    auto retVal = splitBlobPath(path, rest);
+    if(!isExtension(rest))
+        retVal.clear();
+
+    VLOG(2) << "End " << __PRETTY_FUNCTION__;
+    return retVal;
+}
+
+string UploadStore::variantPath(StringPiece path, unsigned int width)
+{
+    VLOG(2) << "Start " << __PRETTY_FUNCTION__;
+
+    auto slash = path.rfind('/');
+    auto dot = path.rfind('.');
+    if(dot == StringPiece::npos ||
+        (slash != StringPiece::npos && dot < slash))
+        dot = path.size();
+
+    string retVal(path.data(), dot);
+    retVal += ".w" + to_string(width);
+    retVal.append(path.data() + dot, path.size() - dot);
+    VLOG(3) << "Variant path: " << retVal;
+
+    VLOG(2) << "End " << __PRETTY_FUNCTION__;
+    return retVal;
+}
+
+bool UploadStore::isVariant(StringPiece path)
+{
+    VLOG(2) << "Start " << __PRETTY_FUNCTION__;
+
+    StringPiece rest;
+    bool retVal = false;
+    if(splitBlobPath(path, rest).size() && rest.removePrefix(".w"))
+    {
+        size_t digits = 0;
+        while(digits < rest.size() &&
+                isdigit(static_cast<unsigned char>(rest[digits])))
+            digits++;
+        retVal = digits && isExtension(rest.subpiece(digits));
+    }
+
+    VLOG(2) << "End " << __PRETTY_FUNCTION__;
+    return retVal;
+}
+
+boost::optional<string> UploadStore::store(DBConn &db,
+    const string &uploadDest, const string &tempFile, const string &sha256,
+    const string &filename, uint64_t size, const boost::optional<int> &userId)
+{
+    VLOG(2) << "Start " << __PRETTY_FUNCTION__;
+
+    // The first upload of a file decides where it's stored. Counting it
+    // before it's in place means a failed move leaves the count too high,
+    // which only keeps the file around longer than needed
+    auto path = db.addUploadBlob(sha256, blobPath(sha256, filename), size);
+    auto base = uploadDest;
+    if(base.size() && base.back() == '/')
+        base.pop_back();
+    auto storedName = base + "/" + path;
+    VLOG(3) << "Stored file name: " << storedName;
+
+    struct stat info;
+    if(stat(storedName.c_str(), &info) == 0)
+    {
+        LOG(INFO) << "Upload is the same as " << storedName;
+        if(unlink(tempFile.c_str()))
+        {
+            auto err = errno;
+            LOG(WARNING) << "Failed to remove " << tempFile << ": "
+                << strerror(err);
+        }
+        db.addUpload(path, filename, sha256, size, userId);
+
+        VLOG(2) << "End " << __PRETTY_FUNCTION__;
+        return path;
+    }
+
+    auto dir = base + "/" + path.substr(0, 2);
+    if(mkdir(dir.c_str(), 0755) && errno != EEXIST)
+    {
+        auto err = errno;
+        LOG(ERROR) << "Failed to create " << dir << ": " << strerror(err);
+
+        VLOG(2) << "End " << __PRETTY_FUNCTION__;
+        return boost::none;
+    }
+
+    // Both are under uploadDest, so the file appears whole or not at all
+    if(rename(tempFile.c_str(), storedName.c_str()))
+    {
+        auto err = errno;
+        LOG(ERROR) << "Failed to move " << tempFile << " to " << storedName
+            << ": " << strerror(err);
+
+        VLOG(2) << "End " << __PRETTY_FUNCTION__;
+        return boost::none;
+    }
+    LOG(INFO) << "Upload stored as " << storedName;
+    db.addUpload(path, filename, sha256, size, userId);
+
+    // Only done here, once the file is whole and in place. A file already
+    // in the store had its copies made when it was first stored
+    ImagePipeline::submit(uploadDest, path, sha256);
+
+    VLOG(2) << "End " << __PRETTY_FUNCTION__;
+    return path;
+}
+
+long UploadStore::backfill(DBConn &db, const string &uploadDest)
+{
+    VLOG(2) << "Start " << __PRETTY_FUNCTION__;
+
+    auto base = uploadDest;
+    if(base.size() && base.back() == '/')
+        base.pop_back();
+
+    long retVal = 0;
+    try
+    {
+        for(recursive_directory_iterator f(base), end; f != end; ++f)
+        {
+            // Hidden files are uploads still coming in
+            if(!is_regular_file(f->path()) ||
+                f->path().filename().string()[0] == '.')
+                continue;
+
+            auto path = f->path().string().substr(base.size() + 1);
+            if(isVariant(path))
+            {
+                VLOG(3) << "Skipping variant " << path;
+                continue;
+            }
+
+            try
+            {
+                if(db.indexExistingUpload(path, blobHash(path).str(),
+                    file_size(f->path())))
+                {
+                    LOG(INFO) << "Indexed " << path;
+                    retVal++;
+                }
+            }
+            catch(const DBConn::DBError &e)
+            {
+                // Most likely a stored file upload_blob doesn't know about
+                LOG(WARNING) << "Failed to index " << path << ": "
+                    << e.what();
+            }
+        }
+    }
+    catch(const filesystem_error &e)
+    {
+        LOG(ERROR) << "Exception encountered enumerating " << base << ": "
+            << e.what();
+        retVal = -1;
+    }
+
+    VLOG(2) << "End " << __PRETTY_FUNCTION__;
+    return retVal;
+}
+
+}
@@ -0,0 +1,262 @@
+/*
+ * Copyright 2017-present Keith Mendoza
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <glog/logging.h>
+
+#include "UrlCodec.h"
+
+#ifdef MIMEOGRAPHER_URLCODEC_X86
+#include <immintrin.h>
+#endif
+
+using namespace std;
+using namespace folly;
+
+namespace mimeographer
+{
+
+namespace
+{
+
+inline bool unreserved(unsigned char c)
+{
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') ||
+        (c >= '0' && c <= '9') || c == '-' || c == '.' || c == '_' ||
+        c == '~';
+}
+
+}
+
+const UrlCodec::Kernel UrlCodec::plainRun = UrlCodec::pickPlainRun();
+const UrlCodec::Kernel UrlCodec::unreservedRun =
+    UrlCodec::pickUnreservedRun();
+
+size_t UrlCodec::plainRunScalar(const char *data, size_t size)
+{
+    size_t i = 0;
+    while(i < size && data[i] != '%' && data[i] != '+')
+        i++;
+    return i;
+}
+
+size_t UrlCodec::unreservedRunScalar(const char *data, size_t size)
+{
+    size_t i = 0;
+    while(i < size && unreserved(data[i]))
+        i++;
+    return i;
+}
+
+#ifdef MIMEOGRAPHER_URLCODEC_X86
+
+// Byte compares are signed, so bytes >= 0x80 are negative and fall outside
+// every range below, which is what we want since they all need escaping
+
+__attribute__((target("sse2")))
+size_t UrlCodec::plainRunSse2(const char *data, size_t size)
+{
+    const __m128i percent = _mm_set1_epi8('%');
+    const __m128i plus = _mm_set1_epi8('+');
+
+    size_t i = 0;
+    for(; i + 16 <= size; i += 16)
+    {
+        auto block = _mm_loadu_si128(
+            reinterpret_cast<const __m128i *>(data + i));
+        unsigned mask = _mm_movemask_epi8(_mm_or_si128(
+            _mm_cmpeq_epi8(block, percent), _mm_cmpeq_epi8(block, plus)));
+        if(mask)
+            return i + __builtin_ctz(mask);
+    }
+
+    return i + plainRunScalar(data + i, size - i);
+}
+
+__attribute__((target("avx2")))
+size_t UrlCodec::plainRunAvx2(const char *data, size_t size)
+{
+    const __m256i percent = _mm256_set1_epi8('%');
+    const __m256i plus = _mm256_set1_epi8('+');
+
+    size_t i = 0;
+    for(; i + 32 <= size; i += 32)
+    {
+        auto block = _mm256_loadu_si256(
+            reinterpret_cast<const __m256i *>(data + i));
+        unsigned mask = _mm256_movemask_epi8(_mm256_or_si256(
+            _mm256_cmpeq_epi8(block, percent),
+            _mm256_cmpeq_epi8(block, plus)));
+        if(mask)
+            return i + __builtin_ctz(mask);
+    }
+
+    return i + plainRunSse2(data + i, size - i);
+}
+
+namespace
+{
+
+__attribute__((target("sse2")))
+inline __m128i inRange(__m128i block, char low, char high)
+{
+    return _mm_and_si128(_mm_cmpgt_epi8(block, _mm_set1_epi8(low - 1)),
+        _mm_cmpgt_epi8(_mm_set1_epi8(high + 1), block));
+}
+
+__attribute__((target("avx2")))
+inline __m256i inRange(__m256i block, char low, char high)
+{
+    return _mm256_and_si256(
+        _mm256_cmpgt_epi8(block, _mm256_set1_epi8(low - 1)),
+        _mm256_cmpgt_epi8(_mm256_set1_epi8(high + 1), block));
+}
+
+}
+
+__attribute__((target("sse2")))
+size_t UrlCodec::unreservedRunSse2(const char *data, size_t size)
+{
+    size_t i = 0;
+    for(; i + 16 <= size; i += 16)
+    {
+        auto block = _mm_loadu_si128(
+            reinterpret_cast<const __m128i *>(data + i));
+        auto ok = _mm_or_si128(
+            _mm_or_si128(inRange(block, 'a', 'z'), inRange(block, 'A', 'Z')),
+            _mm_or_si128(inRange(block, '0', '9'), inRange(block, '-', '.')));
+        ok = _mm_or_si128(ok, _mm_or_si128(
+            _mm_cmpeq_epi8(block, _mm_set1_epi8('_')),
+            _mm_cmpeq_epi8(block, _mm_set1_epi8('~'))));
+
+        unsigned mask = ~_mm_movemask_epi8(ok) & 0xFFFF;
+        if(mask)
+            return i + __builtin_ctz(mask);
+    }
+
+    return i + unreservedRunScalar(data + i, size - i);
+}
+
+__attribute__((target("avx2")))
+size_t UrlCodec::unreservedRunAvx2(const char *data, size_t size)
+{
+    size_t i = 0;
+    for(; i + 32 <= size; i += 32)
+    {
+        auto block = _mm256_loadu_si256(
+            reinterpret_cast<const __m256i *>(data + i));
+        auto ok = _mm256_or_si256(
+            _mm256_or_si256(inRange(block, 'a', 'z'),
+                inRange(block, 'A', 'Z')),
+            _mm256_or_si256(inRange(block, '0', '9'),
+                inRange(block, '-', '.')));
+        ok = _mm256_or_si256(ok, _mm256_or_si256(
+            _mm256_cmpeq_epi8(block, _mm256_set1_epi8('_')),
+            _mm256_cmpeq_epi8(block, _mm256_set1_epi8('~'))));
+
+        unsigned mask = ~static_cast<unsigned>(_mm256_movemask_epi8(ok));
+        if(mask)
+            return i + __builtin_ctz(mask);
+    }
+
+    return i + unreservedRunSse2(data + i, size - i);
+}
+
+#endif
+
+UrlCodec::Kernel UrlCodec::pickPlainRun()
+{
+#ifdef MIMEOGRAPHER_URLCODEC_X86
+    // Runs before main(), so the CPU info has to be set up by hand
+    __builtin_cpu_init();
+    if(__builtin_cpu_supports("avx2"))
+        return plainRunAvx2;
+    else if(__builtin_cpu_supports("sse2"))
+        return plainRunSse2;
+#endif
+    return plainRunScalar;
+}
+
+UrlCodec::Kernel UrlCodec::pickUnreservedRun()
+{
+#ifdef MIMEOGRAPHER_URLCODEC_X86
+    __builtin_cpu_init();
+    if(__builtin_cpu_supports("avx2"))
+        return unreservedRunAvx2;
+    else if(__builtin_cpu_supports("sse2"))
+        return unreservedRunSse2;
+#endif
+    return unreservedRunScalar;
+}
+
+bool UrlCodec::decode(StringPiece in, string &out, bool plusIsSpace)
+{
+    VLOG(2) << "Start " << __PRETTY_FUNCTION__;
+
+    out.reserve(out.size() + in.size());
+    while(!in.empty())
+    {
+        auto run = plainRun(in.data(), in.size());
+        out.append(in.data(), run);
+        in.advance(run);
+        if(in.empty())
+            break;
+
+        if(in.front() == '+')
+        {
+            out += plusIsSpace ? ' ' : '+';
+            in.advance(1);
+            continue;
+        }
+
+        int high = in.size() >= 3 ? hexValue(in[1]) : -1;
+        int low = in.size() >= 3 ? hexValue(in[2]) : -1;
+        if(high < 0 || low < 0)
+        {
+            VLOG(1) << "Malformed %-escape";
+            VLOG(2) << "End " << __PRETTY_FUNCTION__;
+            return false;
+        }
+        out += static_cast<char>(high << 4 | low);
+        in.advance(3);
+    }
+
+    VLOG(2) << "End " << __PRETTY_FUNCTION__;
+    return true;
+}
+
+void UrlCodec::encode(StringPiece in, string &out)
+{
+    VLOG(2) << "Start " << __PRETTY_FUNCTION__;
+
+    static const char hexDigits[] = "0123456789ABCDEF";
+    out.reserve(out.size() + in.size());
+    while(!in.empty())
+    {
+        auto run = unreservedRun(in.data(), in.size());
+        out.append(in.data(), run);
+        in.advance(run);
+        if(in.empty())
+            break;
+
+        auto c = static_cast<unsigned char>(in.front());
+        char escape[3] = { '%', hexDigits[c >> 4], hexDigits[c & 0xF] };
+        out.append(escape, 3);
+        in.advance(1);
+    }
+
+    VLOG(2) << "End " << __PRETTY_FUNCTION__;
+}
+
+}
@@ -0,0 +1,199 @@
+/*
+ * Copyright 2017-present Keith Mendoza
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <glog/logging.h>
+
+#include "UrlEncodedParser.h"
+#include "UrlCodec.h"
+
+using namespace std;
+using namespace folly;
+
+namespace mimeographer
+{
+
+void UrlEncodedParser::onIngress(unique_ptr<IOBuf> chain)
+{
+    VLOG(2) << "Start " << __PRETTY_FUNCTION__;
+
+    // Walk the chain in place rather than coalescing it
+    for(auto range : *chain)
+    {
+        if(failed)
+            break;
+        parse(StringPiece(reinterpret_cast<const char *>(range.data()),
+            range.size()));
+    }
+
+    VLOG(2) << "End " << __PRETTY_FUNCTION__;
+}
+
+void UrlEncodedParser::onIngressEOM()
+{
+    VLOG(2) << "Start " << __PRETTY_FUNCTION__;
+
+    if(failed)
+        VLOG(1) << "Parsing already stopped";
+    else if(pendingSize)
+    {
+        LOG(INFO) << "Form body ends in the middle of an escape";
+        fail(false);
+    }
+    else if(!endField())
+        fail(true);
+
+    VLOG(2) << "End " << __PRETTY_FUNCTION__;
+}
+
+void UrlEncodedParser::parse(StringPiece data)
+{
+    VLOG(2) << "Start " << __PRETTY_FUNCTION__;
+
+    if(failed)
+    {
+        VLOG(1) << "Parsing already stopped";
+        VLOG(2) << "End " << __PRETTY_FUNCTION__;
+        return;
+    }
+
+    bytesProcessed += data.size();
+    if(bytesProcessed > maxSize)
+    {
+        LOG(INFO) << "Form body is over " << maxSize << " bytes";
+        fail(true);
+
+        VLOG(2) << "End " << __PRETTY_FUNCTION__;
+        return;
+    }
+
+    static const StringPiece nameEnd("&=");
+    while(!data.empty())
+    {
+        // Finish off an escape the last chunk ended in
+        if(pendingSize)
+        {
+            while(pendingSize < sizeof(pending) && !data.empty())
+            {
+                pending[pendingSize++] = data.front();
+                data.advance(1);
+            }
+            if(pendingSize < sizeof(pending))
+                break;
+
+            pendingSize = 0;
+            if(!UrlCodec::decode(StringPiece(pending, sizeof(pending)),
+                inValue ? value : name))
+            {
+                LOG(INFO) << "Malformed escape in form body";
+                fail(false);
+                break;
+            }
+            continue;
+        }
+
+        // A '=' in a value is just part of the value
+        auto next = inValue ? data.find('&') : data.find_first_of(nameEnd);
+        if(next == StringPiece::npos)
+        {
+            if(!decodeInto(data, false))
+                fail(false);
+            break;
+        }
+
+        if(!decodeInto(data.subpiece(0, next), true))
+        {
+            fail(false);
+            break;
+        }
+
+        auto separator = data[next];
+        data.advance(next + 1);
+        if(separator == '=')
+            inValue = true;
+        else if(!endField())
+        {
+            fail(true);
+            break;
+        }
+    }
+
+    VLOG(2) << "End " << __PRETTY_FUNCTION__;
+}
+
+bool UrlEncodedParser::decodeInto(StringPiece data, bool complete)
+{
+    VLOG(2) << "Start " << __PRETTY_FUNCTION__;
+
+    // An escape cut off by the end of the chunk waits for the next one
+    size_t hold = 0;
+    if(!complete && data.size() >= 1 && data[data.size() - 1] == '%')
+        hold = 1;
+    else if(!complete && data.size() >= 2 && data[data.size() - 2] == '%')
+        hold = 2;
+    for(size_t i = data.size() - hold; i < data.size(); i++)
+        pending[pendingSize++] = data[i];
+
+    auto retVal = UrlCodec::decode(data.subpiece(0, data.size() - hold),
+        inValue ? value : name);
+    if(!retVal)
+        LOG(INFO) << "Malformed escape in form body";
+
+    VLOG(2) << "End " << __PRETTY_FUNCTION__;
+    return retVal;
+}
+
+bool UrlEncodedParser::endField()
+{
+    VLOG(2) << "Start " << __PRETTY_FUNCTION__;
+
+    bool retVal = true;
+    if(name.empty())
+        VLOG(1) << "Skipping field with no name";
+    else if(++paramCount > maxParams)
+    {
+        LOG(INFO) << "Form body has more than " << maxParams << " fields";
+        retVal = false;
+    }
+    else
+    {
+        VLOG(3) << "Form field " << name << ": " << value;
+        if(callback)
+            callback->onParam(name, value, bytesProcessed);
+    }
+
+    name.clear();
+    value.clear();
+    inValue = false;
+
+    VLOG(2) << "End " << __PRETTY_FUNCTION__;
+    return retVal;
+}
+
+void UrlEncodedParser::fail(bool limit)
+{
+    VLOG(2) << "Start " << __PRETTY_FUNCTION__;
+
+    failed = true;
+    overLimit = limit;
+    name.clear();
+    value.clear();
+    if(callback)
+        callback->onError();
+
+    VLOG(2) << "End " << __PRETTY_FUNCTION__;
+}
+
+}
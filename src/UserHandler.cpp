@@ -109,7 +109,7 @@ void UserHandler::buildLoginPage(const bool &showMismatch)
     VLOG(2) << "Start " << __PRETTY_FUNCTION__;
 
 	const static string html = 
-        "<form method=\"post\" action=\"/user/login\" enctype=\"multipart/form-data\" class=\"form-signin\" style=\"max-width:330px; margin:0 auto\">"
+        "<form method=\"post\" action=\"/user/login\" enctype=\"application/x-www-form-urlencoded\" class=\"form-signin\" style=\"max-width:330px; margin:0 auto\">"
         "<h2 class=\"form-signin-heading\">Please sign in</h2>"
         "<label for=\"inputEmail\" class=\"sr-only\">Email address</label>"
         "<input type=\"email\" name=\"login\" id=\"inputEmail\" class=\"form-control\" placeholder=\"Email address\" required autofocus>"
@@ -193,7 +193,7 @@ void UserHandler::buildChangePassPage(const bool &showMismatch)
 
 	const static string html = 
         "<form method=\"post\" action=\"/user/changepass\" "
-            "enctype=\"multipart/form-data\" class=\"form-signin\" "
+            "enctype=\"application/x-www-form-urlencoded\" class=\"form-signin\" "
             "style=\"max-width:330px; margin:0 auto\">\n"
         "<h2 class=\"form-signin-heading\">Password change</h2>\n"
         "<label for=\"oldPass\">Curent Password</label>\n"
@@ -309,7 +309,7 @@ void UserHandler::buildAddUserPage()
     VLOG(2) << "Start " << __PRETTY_FUNCTION__;
     const static string html = 
         "<form method=\"post\" action=\"/user/add\" "
-            "enctype=\"multipart/form-data\" class=\"form-signin\" "
+            "enctype=\"application/x-www-form-urlencoded\" class=\"form-signin\" "
             "style=\"max-width:330px; margin:0 auto\">\n"
         "<h2 class=\"form-signin-heading\">Add New User</h2>\n"
         "<label for=\"fullname\">Full name</label>\n"
@@ -364,11 +364,7 @@ void UserHandler::processRequest()
 {
     VLOG(2) << "Start " << __PRETTY_FUNCTION__;
 
-    auto path = getPath();
-    if(path.back() == '/')
-        path = path.substr(0,path.size()-1);
-
-    if(path == "/user/login")
+    if(route.route == Route::USER_LOGIN)
     {
         if(getMethod() == "POST")
         {
@@ -409,25 +405,25 @@ void UserHandler::processRequest()
         }
         
         LOG(INFO) << "User is logged-in";
-        if(path == "/user/logout")
-            processLogout();
-        if(path == "/user/changepass")
+        switch(route.route)
         {
+        case Route::USER_LOGOUT:
+            processLogout();
+            break;
+        case Route::USER_CHANGE_PASS:
             if(getMethod() == "GET")
                 buildChangePassPage();
             else if(getMethod() == "POST")
                 processChangePass();
-        }
-        else if(path == "/user/add")
-        {
+            break;
+        case Route::USER_ADD:
             if(getMethod() == "GET")
                 buildAddUserPage();
             else if(getMethod() == "POST")
                 processAddUser();
-        }
-        else
-        {
-            LOG(INFO) << path << "not handled";
+            break;
+        default:
+            LOG(INFO) << getPath() << " not handled";
 
             VLOG(2) << "End " <<  __PRETTY_FUNCTION__;
             throw HandlerError(404, "File not found");
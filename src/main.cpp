@@ -24,6 +24,9 @@
 
 #include <cmark.h>
 #include <json/json.h>
+#include <openssl/bio.h>
+#include <openssl/conf.h>
+#include <openssl/opensslv.h>
 
 #include "mm_version.h"
 #include "PrimaryHandler.h"
@@ -31,6 +34,16 @@
 #include "StaticHandler.h"
 #include "UserHandler.h"
 #include "SiteTemplates.h"
+#include "PageCache.h"
+#include "FdCache.h"
+#include "FileCache.h"
+#include "FileIOService.h"
+#include "HandlerPool.h"
+#include "ImagePipeline.h"
+#include "Precompressor.h"
+#include "Router.h"
+#include "UploadLimiter.h"
+#include "UploadStore.h"
 
 using namespace std;
 using namespace mimeographer;
@@ -46,6 +59,10 @@ DEFINE_int32(threads, 0, "Number of threads to listen on. Numbers <= 0 "
              "will use the number of cores on this machine.");
 DEFINE_string(config, "/etc/mimeographer/mimeographer.cfg", "Configuration file");
 DEFINE_bool(adduser, false, "Add a new user");
+DEFINE_string(precompress, "", "Write .gz copies of the text files under this "
+              "directory for StaticHandler to send, then exit");
+DEFINE_bool(indexuploads, false, "Add the files in uploadDest that aren't in "
+            "the upload index to it, then exit");
 
 namespace mimeographer 
 {
@@ -72,29 +89,42 @@ public:
     {
         VLOG(2) << "Start " << __PRETTY_FUNCTION__;
 
-        auto path = message->getPath();
+        auto match = Router::site().match(message->getPath());
         RequestHandler *ptr;
-        if(message->getPath().substr(0, 5) == "/edit")
+        switch(match.handler)
+        {
+        case RouteHandler::EDIT:
         {
             LOG(INFO) << "Processing edit";
-            ptr = new EditHandler(config);
+            auto edit = HandlerPool<EditHandler>::get(config);
+            edit->setRoute(match);
+            ptr = edit;
+            break;
         }
-        else if(message->getPath().substr(0, 8) == "/static/" ||
-            message->getPath().substr(0,9) == "/uploads/" ||
-            message->getPath() == "/favicon.ico")
+        case RouteHandler::STATIC:
         {
+            // Doesn't open a DB connection or look up the session
             LOG(INFO) << "Processing static file";
-            ptr = new StaticHandler(config);
+            auto file = HandlerPool<StaticHandler>::get(config);
+            file->setRoute(match);
+            ptr = file;
+            break;
         }
-        else if(message->getPath().substr(0, 5) == "/user")
+        case RouteHandler::USER:
         {
             LOG(INFO) << "Processing user";
-            ptr = new UserHandler(config);
+            auto user = HandlerPool<UserHandler>::get(config);
+            user->setRoute(match);
+            ptr = user;
+            break;
         }
-        else
+        default:
         {
             LOG(INFO) << "Processing with primary";
-            ptr = new PrimaryHandler(config);
+            auto primary = HandlerPool<PrimaryHandler>::get(config);
+            primary->setRoute(match);
+            ptr = primary;
+        }
         }
 
         VLOG(2) << "End " << __PRETTY_FUNCTION__;
@@ -102,6 +132,68 @@ public:
     }
 };
 
+////
+/// Have OpenSSL hand the record encryption of TLS connections to the
+/// kernel once the handshake is done. Connections whose cipher the kernel
+/// doesn't support stay on the OpenSSL path. Has to be called before the
+/// server creates its SSL contexts.
+/// \return true if kTLS is enabled
+////
+bool enableKernelTLS()
+{
+    VLOG(2) << "Start " << __PRETTY_FUNCTION__;
+
+#if OPENSSL_VERSION_NUMBER < 0x30000000L
+    LOG(WARNING) << "kTLS needs OpenSSL 3.0 or later. Built with "
+        << OPENSSL_VERSION_TEXT;
+    VLOG(2) << "End " << __PRETTY_FUNCTION__;
+    return false;
+#else
+    {
+        ifstream ulp("/proc/sys/net/ipv4/tcp_available_ulp");
+        string available;
+        getline(ulp, available);
+        VLOG(3) << "Available ULPs: " << available;
+        if((" " + available + " ").find(" tls ") == string::npos)
+        {
+            LOG(WARNING) << "Kernel tls module not loaded, kTLS not enabled";
+            VLOG(2) << "End " << __PRETTY_FUNCTION__;
+            return false;
+        }
+    }
+
+    // Same as putting "Options = KTLS" in the system_default section of
+    // openssl.cnf, without having to touch the system's config
+    static const char ktlsConf[] =
+        "openssl_conf = openssl_init\n"
+        "[openssl_init]\n"
+        "ssl_conf = ssl_module\n"
+        "[ssl_module]\n"
+        "system_default = mimeographer_tls\n"
+        "[mimeographer_tls]\n"
+        "Options = KTLS\n";
+
+    bool retVal = false;
+    auto bio = BIO_new_mem_buf(ktlsConf, -1);
+    auto conf = NCONF_new(nullptr);
+    long errLine;
+    if(!bio || !conf || NCONF_load_bio(conf, bio, &errLine) <= 0)
+        LOG(ERROR) << "Failed to parse kTLS OpenSSL config";
+    else if(CONF_modules_load(conf, nullptr, 0) <= 0)
+        LOG(ERROR) << "Failed to load kTLS OpenSSL config";
+    else
+    {
+        LOG(INFO) << "kTLS enabled";
+        retVal = true;
+    }
+    NCONF_free(conf);
+    BIO_free(bio);
+
+    VLOG(2) << "End " << __PRETTY_FUNCTION__;
+    return retVal;
+#endif
+}
+
 }
 
 int main(int argc, char* argv[]) 
@@ -151,6 +243,74 @@ int main(int argc, char* argv[])
         cfgRoot.get("hostName", "localhost").asString(),
         cfgRoot.get("staticBase", "/var/lib/mimeographer").asString()
     );
+    config.proxyCache = cfgRoot.get("proxyCache", false).asBool();
+    config.proxyMaxAge = cfgRoot.get("proxyMaxAge", 60).asUInt();
+    config.proxyStaleWhileRevalidate =
+        cfgRoot.get("proxyStaleWhileRevalidate", 300).asUInt();
+    config.compressionLevel = cfgRoot.get("compressionLevel", 6).asInt();
+    config.compressionMinSize =
+        cfgRoot.get("compressionMinSize", 1024).asUInt64();
+    config.pageCacheBytes =
+        cfgRoot.get("pageCacheBytes", 32 * 1024 * 1024).asUInt64();
+    config.fileCacheBytes =
+        cfgRoot.get("fileCacheBytes", 64 * 1024 * 1024).asUInt64();
+    config.fileCacheMaxEntry =
+        cfgRoot.get("fileCacheMaxEntry", 256 * 1024).asUInt64();
+    config.staticMaxAge = cfgRoot.get("staticMaxAge", 3600).asUInt();
+    config.uploadMaxAge = cfgRoot.get("uploadMaxAge", 31536000).asUInt();
+    config.uploadImmutable = cfgRoot.get("uploadImmutable", true).asBool();
+    config.ioUring = cfgRoot.get("ioUring", true).asBool();
+    config.ioRingEntries = cfgRoot.get("ioRingEntries", 256).asUInt();
+    config.fileIOThreads = cfgRoot.get("fileIOThreads", 4).asUInt();
+    config.fdCacheEntries = cfgRoot.get("fdCacheEntries", 1024).asUInt64();
+    config.handlerPoolSize = cfgRoot.get("handlerPoolSize", 4).asUInt64();
+    config.handlerPoolConnections =
+        cfgRoot.get("handlerPoolConnections", 16).asUInt64();
+    config.formMaxSize = cfgRoot.get("formMaxSize", 1024 * 1024).asUInt64();
+    config.formMaxParams = cfgRoot.get("formMaxParams", 1000).asUInt64();
+    config.uploadMaxSize = cfgRoot.get("uploadMaxSize",
+        64 * 1024 * 1024).asUInt64();
+    config.uploadMaxBuffered = cfgRoot.get("uploadMaxBuffered",
+        4 * 1024 * 1024).asUInt64();
+    config.uploadsPerUser = cfgRoot.get("uploadsPerUser", 2).asUInt();
+    config.uploadPageSize = cfgRoot.get("uploadPageSize", 48).asUInt64();
+    if(cfgRoot.isMember("imageVariantWidths"))
+    {
+        config.imageVariantWidths.clear();
+        for(auto &width : cfgRoot["imageVariantWidths"])
+            config.imageVariantWidths.push_back(width.asUInt());
+    }
+    config.imageThreads = cfgRoot.get("imageThreads", 2).asUInt();
+    config.imageQuality = cfgRoot.get("imageQuality", 80).asUInt();
+
+    if(FLAGS_precompress.size())
+    {
+        LOG(INFO) << "Running in precompress mode";
+        size_t threads = FLAGS_threads > 0 ? FLAGS_threads :
+            sysconf(_SC_NPROCESSORS_ONLN);
+
+        bool ok = Precompressor::run(FLAGS_precompress,
+            config.compressionLevel, threads);
+        cout << (ok ? "Sidecars written" : "Failed to write some sidecars")
+            << endl;
+        return ok ? 0 : 1;
+    }
+
+    if(FLAGS_indexuploads)
+    {
+        LOG(INFO) << "Running in index uploads mode";
+        DBConn db(config.dbUser, config.dbPass, config.dbHost, config.dbName,
+            config.dbPort);
+        auto added = UploadStore::backfill(db, config.uploadDest);
+        if(added < 0)
+        {
+            cout << "Failed to read " << config.uploadDest << endl;
+            return 1;
+        }
+
+        cout << added << " uploads added to the index" << endl;
+        return 0;
+    }
 
     if(FLAGS_adduser)
     {
@@ -212,6 +372,16 @@ int main(int argc, char* argv[])
     {
         LOG(FATAL) << "Error encountered loading site templates";
     }
+    PageCache::init(config);
+    FileCache::init(config);
+    FileIOService::init(config);
+    FdCache::init(config);
+    HandlerPoolBase::init(config);
+    UploadLimiter::init(config);
+    ImagePipeline::init(config);
+
+    if(cfgRoot.get("ktls", false).asBool())
+        config.ktls = enableKernelTLS();
 
     wangle::SSLContextConfig sslConfig;
     sslConfig.isDefault = true;
@@ -0,0 +1,111 @@
+/*
+ * Copyright 2017 Keith Mendoza
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <string>
+
+#include <folly/Benchmark.h>
+#include <folly/init/Init.h>
+
+#include "UrlCodec.h"
+#include "UrlCodecReference.h"
+
+using namespace std;
+using namespace folly;
+using namespace mimeographer;
+
+namespace
+{
+
+// A typical static file path: mostly plain bytes with the odd escape
+const string path("/static/uploads/2017/My%20Holiday%20Photos/"
+    "beach+sunset%2Bfriends_final-version.JPG");
+
+// A typical article title going into a link: mostly unreserved bytes
+const string title("Setting up PostgreSQL replication on Ubuntu 16.04 "
+    "(part 2) - WAL shipping & recovery.conf");
+
+// Long input where the vector kernels have room to run
+const string longPath(string(4096, 'a') + "%2F" + string(4096, 'b'));
+
+}
+
+BENCHMARK(decodeReference, n)
+{
+    for(unsigned int i = 0; i < n; i++)
+        doNotOptimizeAway(UrlCodecReference::decode(path));
+}
+
+BENCHMARK_RELATIVE(decodeUrlCodec, n)
+{
+    for(unsigned int i = 0; i < n; i++)
+    {
+        string out;
+        doNotOptimizeAway(UrlCodec::decode(path, out));
+        doNotOptimizeAway(out);
+    }
+}
+
+BENCHMARK_DRAW_LINE();
+
+BENCHMARK(decodeLongReference, n)
+{
+    for(unsigned int i = 0; i < n; i++)
+        doNotOptimizeAway(UrlCodecReference::decode(longPath));
+}
+
+BENCHMARK_RELATIVE(decodeLongUrlCodec, n)
+{
+    for(unsigned int i = 0; i < n; i++)
+    {
+        string out;
+        doNotOptimizeAway(UrlCodec::decode(longPath, out));
+        doNotOptimizeAway(out);
+    }
+}
+
+BENCHMARK_DRAW_LINE();
+
+BENCHMARK(encodeReference, n)
+{
+    for(unsigned int i = 0; i < n; i++)
+        doNotOptimizeAway(UrlCodecReference::encode(title));
+}
+
+BENCHMARK_RELATIVE(encodeUrlCodec, n)
+{
+    for(unsigned int i = 0; i < n; i++)
+        doNotOptimizeAway(UrlCodec::encode(title));
+}
+
+BENCHMARK_DRAW_LINE();
+
+BENCHMARK(encodeLongReference, n)
+{
+    for(unsigned int i = 0; i < n; i++)
+        doNotOptimizeAway(UrlCodecReference::encode(longPath));
+}
+
+BENCHMARK_RELATIVE(encodeLongUrlCodec, n)
+{
+    for(unsigned int i = 0; i < n; i++)
+        doNotOptimizeAway(UrlCodec::encode(longPath));
+}
+
+int main(int argc, char *argv[])
+{
+    folly::init(&argc, &argv);
+    runBenchmarks();
+    return 0;
+}
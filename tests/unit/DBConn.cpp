@@ -68,6 +68,18 @@ TEST_F(DBConnTest, getHeadlines)
     EXPECT_EQ(get<0>(testData[1]), 2);
     EXPECT_EQ(get<1>(testData[1]), string("Test 2"));
     EXPECT_EQ(get<2>(testData[1]), string("Start of 1st paragraph"));
+
+    // One page at a time, each after the last article of the one before
+    EXPECT_NO_THROW({ testData = testConn.getHeadlines(boost::none, 1); });
+    ASSERT_EQ(testData.size(), 1);
+    EXPECT_EQ(get<0>(testData[0]), 1);
+
+    EXPECT_NO_THROW({ testData = testConn.getHeadlines(1, 1); });
+    ASSERT_EQ(testData.size(), 1);
+    EXPECT_EQ(get<0>(testData[0]), 2);
+
+    EXPECT_NO_THROW({ testData = testConn.getHeadlines(2, 1); });
+    EXPECT_TRUE(testData.empty());
 }
 
 TEST_F(DBConnTest, getArticle)
@@ -96,6 +108,33 @@ TEST_F(DBConnTest, getArticle)
     });
 }
 
+TEST_F(DBConnTest, getArticleVersion)
+{
+    boost::optional<string> version;
+    EXPECT_NO_THROW({ version = testConn.getArticleVersion("1"); });
+    ASSERT_TRUE(version);
+    EXPECT_EQ(version->substr(0,2), "1:");
+
+    EXPECT_NO_THROW({ version = testConn.getArticleVersion("100"); });
+    EXPECT_FALSE(version);
+}
+
+TEST_F(DBConnTest, getLatestArticleVersion)
+{
+    boost::optional<string> version;
+    EXPECT_NO_THROW({ version = testConn.getLatestArticleVersion(); });
+    ASSERT_TRUE(version);
+    EXPECT_EQ(*version, *testConn.getArticleVersion("1"));
+}
+
+TEST_F(DBConnTest, getArchiveVersion)
+{
+    boost::optional<string> version;
+    EXPECT_NO_THROW({ version = testConn.getArchiveVersion(); });
+    ASSERT_TRUE(version);
+    EXPECT_EQ(version->substr(0,2), "2:");
+}
+
 TEST_F(DBConnTest, getUserInfo_email)
 {
     //Put things back to a good state before starting
@@ -205,4 +244,115 @@ TEST_F(DBConnTest, addUser)
     });
 }
 
+TEST_F(DBConnTest, addUploadBlob)
+{
+    const string hash =
+        "9f86d081884c7d659a2feaa0c55ad015a3bf4f1b2b0b822cd15d6c15b0f00a08";
+    ASSERT_NO_THROW({
+        testConn.execQuery("DELETE FROM upload WHERE sha256 = '" + hash + "'");
+        testConn.execQuery("DELETE FROM upload_blob WHERE sha256 = '"
+            + hash + "'");
+    });
+
+    string path;
+    EXPECT_NO_THROW({
+        path = testConn.addUploadBlob(hash, "9f/" + hash + ".jpg", 4);
+    });
+    EXPECT_EQ(path, "9f/" + hash + ".jpg");
+
+    // The same file under another name goes where the first one went
+    EXPECT_NO_THROW({
+        path = testConn.addUploadBlob(hash, "9f/" + hash + ".png", 4);
+    });
+    EXPECT_EQ(path, "9f/" + hash + ".jpg");
+}
+
+TEST_F(DBConnTest, uploadIndex)
+{
+    const string hash =
+        "60303ae22b998861bce3b28f33eec1be758a213c86c93c076dbe9f558c11c752";
+    const string path = "60/" + hash + ".png";
+    ASSERT_NO_THROW({
+        testConn.execQuery("DELETE FROM upload");
+        testConn.execQuery("DELETE FROM upload_blob WHERE sha256 = '"
+            + hash + "'");
+        testConn.addUploadBlob(hash, path, 4);
+    });
+
+    int first = 0, second = 0;
+    EXPECT_NO_THROW({
+        first = testConn.addUpload("legacy_upload.jpg", "upload.jpg", "", 10,
+            boost::none);
+        second = testConn.addUpload(path, "Image.PNG", hash, 4, testUserId);
+    });
+    EXPECT_LT(first, second);
+
+    // Already indexed, or not
+    EXPECT_FALSE(testConn.indexExistingUpload(path, hash, 4));
+    EXPECT_TRUE(testConn.indexExistingUpload("other_upload.gif", "", 7));
+
+    DBConn::UploadList uploads;
+    EXPECT_NO_THROW({ uploads = testConn.getUploads(boost::none, 2); });
+    ASSERT_EQ(uploads.size(), 2);
+    EXPECT_EQ(get<1>(uploads[0]), "other_upload.gif");
+    EXPECT_EQ(get<0>(uploads[1]), second);
+    EXPECT_EQ(get<1>(uploads[1]), path);
+
+    EXPECT_NO_THROW({ uploads = testConn.getUploads(second, 2); });
+    ASSERT_EQ(uploads.size(), 1);
+    EXPECT_EQ(get<0>(uploads[0]), first);
+}
+
+TEST_F(DBConnTest, imageVariants)
+{
+    const string hash =
+        "c3a9c1f0e1e4a3b5d1f4c2b89bb8a2a3e2f1a0c9d8e7f6a5b4c3d2e1f0a9b8c7";
+    const string path = "c3/" + hash + ".jpg";
+    ASSERT_NO_THROW({
+        testConn.execQuery("DELETE FROM upload");
+        testConn.execQuery("DELETE FROM upload_blob WHERE sha256 = '"
+            + hash + "'");
+        testConn.addUploadBlob(hash, path, 4);
+        testConn.addUpload(path, "photo.jpg", hash, 4, testUserId);
+    });
+
+    // Not read yet
+    DBConn::ImageVariantMap images;
+    EXPECT_NO_THROW({ images = testConn.getImageVariants({ hash }); });
+    EXPECT_TRUE(images.empty());
+
+    EXPECT_NO_THROW({ testConn.setUploadDimensions(hash, 4000, 3000); });
+    EXPECT_NO_THROW({ images = testConn.getImageVariants({ hash }); });
+    ASSERT_EQ(images.count(hash), 1);
+    auto image = &images[hash];
+    EXPECT_EQ(get<0>(*image), 4000);
+    EXPECT_EQ(get<1>(*image), 3000);
+    EXPECT_TRUE(get<2>(*image).empty());
+
+    const string small = "c3/" + hash + ".w480.jpg",
+        large = "c3/" + hash + ".w1920.jpg";
+    EXPECT_NO_THROW({
+        testConn.addUploadVariant(hash, 1920, 1440, large);
+        testConn.addUploadVariant(hash, 480, 360, small);
+    });
+    // Images without known sizes are left out
+    const string unknown =
+        "c300000000000000000000000000000000000000000000000000000000000000";
+    EXPECT_NO_THROW({
+        images = testConn.getImageVariants({ hash, unknown });
+    });
+    ASSERT_EQ(images.size(), 1);
+    image = &images[hash];
+    ASSERT_EQ(get<2>(*image).size(), 2);
+    EXPECT_EQ(get<0>(get<2>(*image)[0]), 480);
+    EXPECT_EQ(get<1>(get<2>(*image)[0]), small);
+    EXPECT_EQ(get<0>(get<2>(*image)[1]), 1920);
+
+    // The upload list shows the smallest one
+    DBConn::UploadList uploads;
+    EXPECT_NO_THROW({ uploads = testConn.getUploads(boost::none, 1); });
+    ASSERT_EQ(uploads.size(), 1);
+    EXPECT_EQ(get<2>(uploads[0]), small);
+}
+
 } //namespace mimeographer
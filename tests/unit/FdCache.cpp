@@ -0,0 +1,107 @@
+/*
+ * Copyright 2017 Keith Mendoza
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <chrono>
+#include <fstream>
+#include <string>
+#include <thread>
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "params.h"
+#include "FdCache.h"
+
+#include "gtest/gtest.h"
+
+using namespace std;
+
+namespace mimeographer
+{
+
+TEST(FdCacheTest, normalize)
+{
+    EXPECT_EQ(FdCache::normalize("/a/b/c"), "/a/b/c");
+    EXPECT_EQ(FdCache::normalize("/a//b/./c"), "/a/b/c");
+    EXPECT_EQ(FdCache::normalize("a/b/"), "a/b");
+    EXPECT_EQ(FdCache::normalize("/a/../b"), "");
+}
+
+TEST(FdCacheTest, openFile)
+{
+    const string dir = "/tmp/mimeographer_fdcache_test";
+    mkdir(dir.c_str(), 0755);
+    Config config(FLAGS_dbHost, FLAGS_dbUser, FLAGS_dbPass, FLAGS_dbName,
+            FLAGS_dbPort, dir, "localhost", dir);
+    config.fdCacheEntries = 2;
+    FdCache::init(config);
+    FdCache::clear();
+
+    const string fileName = dir + "/a.txt";
+    {
+        ofstream out(fileName, ios_base::out | ios_base::trunc);
+        out << "1234567890";
+    }
+
+    auto hits = FdCache::getHits();
+    auto misses = FdCache::getMisses();
+    auto first = FdCache::open(fileName);
+    EXPECT_EQ(first.info.st_size, 10);
+    EXPECT_EQ(FdCache::getMisses(), misses + 1);
+
+    // Same fd for the same file, however the path is spelled
+    auto second = FdCache::open(dir + "//./a.txt");
+    EXPECT_EQ(second.file, first.file);
+    EXPECT_EQ(FdCache::getHits(), hits + 1);
+
+    // A change to the file drops its entry
+    {
+        ofstream out(fileName, ios_base::out | ios_base::app);
+        out << "abc";
+    }
+    FdCache::Entry changed;
+    for(int i = 0; i < 100; i++)
+    {
+        changed = FdCache::open(fileName);
+        if(changed.file != first.file)
+            break;
+        this_thread::sleep_for(chrono::milliseconds(10));
+    }
+    EXPECT_NE(changed.file, first.file);
+    EXPECT_EQ(changed.info.st_size, 13);
+
+    // Least recently used goes first
+    for(auto name : { "b.txt", "c.txt" })
+    {
+        ofstream out(dir + "/" + name, ios_base::out | ios_base::trunc);
+        out << name;
+    }
+    // Let the creation events go by before caching
+    this_thread::sleep_for(chrono::milliseconds(100));
+    auto b = FdCache::open(dir + "/b.txt");
+    FdCache::open(dir + "/c.txt");
+    EXPECT_NE(FdCache::open(dir + "/a.txt").file, changed.file);
+    EXPECT_NE(FdCache::open(dir + "/b.txt").file, b.file);
+
+    EXPECT_THROW(FdCache::open(dir + "/missing.txt"), system_error);
+
+    FdCache::clear();
+    for(auto name : { "a.txt", "b.txt", "c.txt" })
+        unlink((dir + "/" + name).c_str());
+    rmdir(dir.c_str());
+}
+
+} // namespace mimeographer
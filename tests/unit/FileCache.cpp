@@ -0,0 +1,81 @@
+/*
+ * Copyright 2017 Keith Mendoza
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <fstream>
+#include <string>
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "params.h"
+#include "FileCache.h"
+
+#include "gtest/gtest.h"
+
+using namespace std;
+
+namespace mimeographer
+{
+
+TEST(FileCacheTest, evict)
+{
+    Config config(FLAGS_dbHost, FLAGS_dbUser, FLAGS_dbPass, FLAGS_dbName,
+            FLAGS_dbPort, "/tmp", "localhost", FLAGS_staticBase);
+    config.fileCacheBytes = 20;
+    config.fileCacheMaxEntry = 10;
+    FileCache::init(config);
+
+    EXPECT_TRUE(FileCache::cacheable(10));
+    EXPECT_FALSE(FileCache::cacheable(11));
+
+    const string fileName = "/tmp/mimeographer_filecache_test";
+    {
+        ofstream out(fileName, ios_base::out | ios_base::trunc);
+        out << "1234567890";
+    }
+    struct stat info;
+    ASSERT_EQ(stat(fileName.c_str(), &info), 0);
+
+    FileCache::store(fileName, info, "text/plain", "1234567890");
+    auto file = FileCache::find(fileName, info);
+    ASSERT_TRUE(file);
+    EXPECT_EQ(*file->content, "1234567890");
+    EXPECT_EQ(file->mimeType, "text/plain");
+
+    // Content that doesn't match the stat info isn't stored
+    FileCache::store("/tmp/other", info, "text/plain", "123");
+    EXPECT_FALSE(FileCache::find("/tmp/other", info));
+
+    // Changing the file invalidates the cached copy
+    auto changed = info;
+    changed.st_mtim.tv_sec++;
+    EXPECT_FALSE(FileCache::find(fileName, changed));
+    EXPECT_FALSE(FileCache::find(fileName, info));
+    EXPECT_EQ(FileCache::cacheBytes, 0);
+
+    // Least recently used goes first
+    FileCache::store("/tmp/a", info, "text/plain", "aaaaaaaaaa");
+    FileCache::store("/tmp/b", info, "text/plain", "bbbbbbbbbb");
+    EXPECT_TRUE(FileCache::find("/tmp/a", info));
+    FileCache::store("/tmp/c", info, "text/plain", "cccccccccc");
+    EXPECT_FALSE(FileCache::find("/tmp/b", info));
+    EXPECT_TRUE(FileCache::find("/tmp/a", info));
+    EXPECT_TRUE(FileCache::find("/tmp/c", info));
+
+    unlink(fileName.c_str());
+}
+
+} // namespace
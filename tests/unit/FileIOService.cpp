@@ -0,0 +1,136 @@
+/*
+ * Copyright 2017 Keith Mendoza
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <string>
+
+#include <folly/File.h>
+#include <folly/io/async/EventBase.h>
+
+#include "params.h"
+#include "FileIOService.h"
+
+#include "gtest/gtest.h"
+
+using namespace std;
+using namespace folly;
+
+namespace mimeographer
+{
+
+TEST(FileIOServiceTest, readWrite)
+{
+    const string fileName = "/tmp/mimeographer_fileio_test";
+
+    // Thread pool, then io_uring if the kernel has it
+    for(auto useRing : { false, true })
+    {
+        Config config(FLAGS_dbHost, FLAGS_dbUser, FLAGS_dbPass, FLAGS_dbName,
+            FLAGS_dbPort, "/tmp", "localhost", FLAGS_staticBase);
+        config.ioUring = useRing;
+        FileIOService::init(config);
+
+        EventBase evb;
+        FileIOService service(evb);
+        if(!useRing)
+        {
+            EXPECT_FALSE(service.usingRing());
+        }
+
+        File file(fileName, O_RDWR | O_CREAT | O_TRUNC);
+
+        int writeErr = -1;
+        auto data = IOBuf::copyBuffer("hello ");
+        data->prependChain(IOBuf::copyBuffer("world"));
+        service.write(file.fd(), move(data), 0, [&](int err)
+            {
+                EXPECT_TRUE(evb.isInEventBaseThread());
+                writeErr = err;
+                evb.terminateLoopSoon();
+            });
+        evb.loopForever();
+        EXPECT_EQ(writeErr, 0);
+
+        int readErr = -1;
+        string readData;
+        service.read(file.fd(), 100, 6, [&](unique_ptr<IOBuf> buf, int err)
+            {
+                EXPECT_TRUE(evb.isInEventBaseThread());
+                readErr = err;
+                readData.assign((const char *)buf->data(), buf->length());
+                evb.terminateLoopSoon();
+            });
+        evb.loopForever();
+        EXPECT_EQ(readErr, 0);
+        EXPECT_EQ(readData, "world");
+
+        // Errors are passed back instead of thrown
+        service.read(-1, 10, 0, [&](unique_ptr<IOBuf> buf, int err)
+            {
+                readErr = err;
+                EXPECT_EQ(buf->length(), 0);
+                evb.terminateLoopSoon();
+            });
+        evb.loopForever();
+        EXPECT_EQ(readErr, EBADF);
+    }
+
+    unlink(fileName.c_str());
+}
+
+TEST(FileIOServiceTest, readLength)
+{
+    const string fileName = "/tmp/mimeographer_fileio_length_test";
+    {
+        File file(fileName, O_WRONLY | O_CREAT | O_TRUNC);
+        ASSERT_EQ(write(file.fd(), "hello world", 11), 11);
+    }
+
+    for(auto useRing : { false, true })
+    {
+        Config config(FLAGS_dbHost, FLAGS_dbUser, FLAGS_dbPass, FLAGS_dbName,
+            FLAGS_dbPort, "/tmp", "localhost", FLAGS_staticBase);
+        config.ioUring = useRing;
+        FileIOService::init(config);
+
+        EventBase evb;
+        FileIOService service(evb);
+        File file(fileName, O_RDONLY);
+
+        // IOBuf::create() rounds the capacity up, and none of the extra
+        // room may be filled past the length asked for
+        int readErr = -1;
+        string readData;
+        size_t capacity = 0;
+        service.read(file.fd(), 3, 2, [&](unique_ptr<IOBuf> buf, int err)
+            {
+                readErr = err;
+                capacity = buf->capacity();
+                readData.assign((const char *)buf->data(), buf->length());
+                evb.terminateLoopSoon();
+            });
+        evb.loopForever();
+        EXPECT_EQ(readErr, 0);
+        EXPECT_GT(capacity, 3);
+        EXPECT_EQ(readData, "llo");
+    }
+
+    unlink(fileName.c_str());
+}
+
+} // namespace mimeographer
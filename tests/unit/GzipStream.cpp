@@ -0,0 +1,84 @@
+/*
+ * Copyright 2017 Keith Mendoza
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <string>
+
+#include <zlib.h>
+
+#include "GzipStream.h"
+
+#include "gtest/gtest.h"
+
+using namespace std;
+using namespace folly;
+
+namespace mimeographer
+{
+
+static string gunzip(const string &data)
+{
+    z_stream stream = {};
+    inflateInit2(&stream, 15 + 16);
+    stream.next_in = (unsigned char *)data.data();
+    stream.avail_in = data.size();
+
+    string retVal;
+    unsigned char buf[256];
+    int rslt;
+    do
+    {
+        stream.next_out = buf;
+        stream.avail_out = sizeof(buf);
+        rslt = inflate(&stream, Z_NO_FLUSH);
+        retVal.append((const char *)buf, sizeof(buf) - stream.avail_out);
+    } while(rslt == Z_OK);
+    inflateEnd(&stream);
+
+    EXPECT_EQ(rslt, Z_STREAM_END);
+    return retVal;
+}
+
+static string toString(const IOBuf &buf)
+{
+    string retVal;
+    for(auto range : buf)
+        retVal.append((const char *)range.data(), range.size());
+    return retVal;
+}
+
+TEST(GzipStreamTest, compress)
+{
+    const string piece1 = "<html><body>";
+    const string piece2(100000, 'x');
+    const string piece3 = "</body></html>";
+
+    GzipStream gzip(6);
+    string compressed;
+    EXPECT_NO_THROW({
+        compressed += toString(*gzip.compress(*IOBuf::copyBuffer(piece1), false));
+        auto chain = IOBuf::copyBuffer(piece2.substr(0, 50000));
+        chain->prependChain(IOBuf::copyBuffer(piece2.substr(50000)));
+        compressed += toString(*gzip.compress(*chain, false));
+        compressed += toString(*gzip.compress(*IOBuf::copyBuffer(piece3), true));
+    });
+
+    EXPECT_LT(compressed.size(), piece2.size());
+    EXPECT_EQ(gunzip(compressed), piece1 + piece2 + piece3);
+
+    EXPECT_THROW(gzip.compress(*IOBuf::copyBuffer(piece1), true), logic_error);
+}
+
+} // namespace
@@ -87,19 +87,6 @@ TEST_F(HandlerBaseTest, getPostParam)
     EXPECT_EQ(param->localFilename, string("localversion"));
 }
 
-TEST_F(HandlerBaseTest, parseCookies)
-{
-    HandlerBaseObj obj(config);
-    obj.parseCookies("cookie1=asdfasdf; b=bbbb");
-    EXPECT_EQ(obj.cookieJar.size(), 2);
-    EXPECT_NO_THROW( {
-        EXPECT_EQ(obj.cookieJar.at("cookie1"), "asdfasdf");
-    });
-    EXPECT_NO_THROW( {
-        EXPECT_EQ(obj.cookieJar.at("b"), "bbbb");
-    });
-}
-
 TEST_F(HandlerBaseTest, makeMenuButtons)
 {
     HandlerBaseObj obj(config);
@@ -122,4 +109,76 @@ TEST_F(HandlerBaseTest, makeMenuButtons)
     }
 }
 
+TEST_F(HandlerBaseTest, acceptsGzip)
+{
+    EXPECT_TRUE(HandlerBase::acceptsGzip("gzip"));
+    EXPECT_TRUE(HandlerBase::acceptsGzip("gzip, deflate, br"));
+    EXPECT_TRUE(HandlerBase::acceptsGzip("br;q=1.0, GZIP;q=0.5"));
+    EXPECT_TRUE(HandlerBase::acceptsGzip("x-gzip"));
+    EXPECT_FALSE(HandlerBase::acceptsGzip(""));
+    EXPECT_FALSE(HandlerBase::acceptsGzip("deflate, br"));
+    EXPECT_FALSE(HandlerBase::acceptsGzip("gzip;q=0"));
+    EXPECT_FALSE(HandlerBase::acceptsGzip("gzip; q=0.000"));
+}
+
+TEST_F(HandlerBaseTest, htmlEscape)
+{
+    EXPECT_EQ(HandlerBase::htmlEscape("plain/text.jpg"), "plain/text.jpg");
+    EXPECT_EQ(HandlerBase::htmlEscape("<a href=\"x\">'&'</a>"),
+        "&lt;a href=&quot;x&quot;&gt;&#39;&amp;&#39;&lt;/a&gt;");
+    EXPECT_EQ(HandlerBase::htmlEscape(""), "");
+}
+
+TEST_F(HandlerBaseTest, reset)
+{
+    HandlerBaseObj obj(config);
+    obj.addCookie("session", "asdfasdf");
+    obj.postParams["a"] = { HandlerBase::PostParamType::VALUE, "field 1", "", "" };
+    obj.prependResponse("Some page");
+    obj.session.initSession();
+    obj.etag = "\"abc\"";
+    obj.headersSent = true;
+    obj.route.route = Route::ARTICLE;
+
+    EXPECT_TRUE(obj.reset());
+    EXPECT_TRUE(obj.cookieJar.empty());
+    EXPECT_TRUE(obj.postParams.empty());
+    EXPECT_FALSE(obj.handlerResponse);
+    EXPECT_EQ(obj.session.getUUID(), "");
+    EXPECT_FALSE(obj.session.userAuthenticated());
+    EXPECT_EQ(obj.etag, "");
+    EXPECT_FALSE(obj.headersSent);
+    EXPECT_EQ(obj.route.route, Route::NOT_FOUND);
+    EXPECT_EQ(obj.arena.getAllocated(), 0u);
+}
+
+TEST_F(HandlerBaseTest, refuseFiles)
+{
+    HandlerBaseObj obj(config);
+    obj.pbCallback.refuseFiles();
+
+    // Fields around the file part still come through
+    obj.pbCallback.onParam("username", "someone", 10);
+    EXPECT_EQ(obj.pbCallback.onFileStart("upload", "file.txt",
+        make_unique<proxygen::HTTPMessage>(), 20), 0);
+    EXPECT_EQ(obj.pbCallback.onFileData(IOBuf::copyBuffer("file data"), 30),
+        0);
+    obj.pbCallback.onFileEnd(true, 40);
+    obj.pbCallback.onParam("password", "secret", 50);
+
+    EXPECT_EQ(obj.postParams.size(), 2u);
+    EXPECT_EQ(obj.getPostParam("username")->value, "someone");
+    EXPECT_EQ(obj.getPostParam("password")->value, "secret");
+    EXPECT_FALSE(obj.getPostParam("upload"));
+    EXPECT_FALSE(obj.pbCallback.isOverLimit());
+
+    // Still held to the upload size limit
+    config.uploadMaxSize = 4;
+    EXPECT_EQ(obj.pbCallback.onFileStart("upload", "file.txt",
+        make_unique<proxygen::HTTPMessage>(), 60), 0);
+    EXPECT_EQ(obj.pbCallback.onFileData(IOBuf::copyBuffer("file data"), 70),
+        -1);
+    EXPECT_TRUE(obj.pbCallback.isOverLimit());
+}
+
 } // namespace mimeographer
@@ -0,0 +1,128 @@
+/*
+ * Copyright 2017 Keith Mendoza
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "HandlerPool.h"
+
+#include "gtest/gtest.h"
+
+using namespace std;
+
+namespace mimeographer
+{
+
+class PooledObj
+{
+public:
+    static int constructed, destroyed;
+    bool reusable = true;
+    int requests = 0;
+
+    PooledObj(const Config &) { constructed++; }
+    ~PooledObj() { destroyed++; }
+
+    bool reset() noexcept
+    {
+        requests = 0;
+        return reusable;
+    }
+};
+
+int PooledObj::constructed = 0;
+int PooledObj::destroyed = 0;
+
+// Stands in for a handler with a database connection
+class ConnectedObj
+{
+public:
+    ConnectedObj(const Config &) {}
+    bool reset() noexcept { return true; }
+};
+
+template <>
+struct PoolHoldsConnection<ConnectedObj> : std::true_type {};
+
+TEST(HandlerPoolTest, getRelease)
+{
+    Config config("", "", "", "", 0, "/tmp", "localhost", "/tmp");
+    config.handlerPoolSize = 1;
+    HandlerPoolBase::init(config);
+
+    auto first = HandlerPool<PooledObj>::get(config);
+    EXPECT_EQ(1, PooledObj::constructed);
+    first->requests = 5;
+    HandlerPool<PooledObj>::release(first);
+    EXPECT_EQ(1u, HandlerPool<PooledObj>::getFreeCount());
+    EXPECT_EQ(0, PooledObj::destroyed);
+
+    // Comes back reset
+    auto second = HandlerPool<PooledObj>::get(config);
+    EXPECT_EQ(first, second);
+    EXPECT_EQ(0, second->requests);
+    EXPECT_EQ(1, PooledObj::constructed);
+    EXPECT_EQ(0u, HandlerPool<PooledObj>::getFreeCount());
+
+    // Only room for one idle object
+    auto third = HandlerPool<PooledObj>::get(config);
+    EXPECT_EQ(2, PooledObj::constructed);
+    HandlerPool<PooledObj>::release(second);
+    HandlerPool<PooledObj>::release(third);
+    EXPECT_EQ(1u, HandlerPool<PooledObj>::getFreeCount());
+    EXPECT_EQ(1, PooledObj::destroyed);
+
+    // Objects that can't be reset aren't kept
+    HandlerPool<PooledObj>::clear();
+    EXPECT_EQ(2, PooledObj::destroyed);
+    auto broken = HandlerPool<PooledObj>::get(config);
+    broken->reusable = false;
+    HandlerPool<PooledObj>::release(broken);
+    EXPECT_EQ(0u, HandlerPool<PooledObj>::getFreeCount());
+    EXPECT_EQ(3, PooledObj::destroyed);
+
+    config.handlerPoolSize = 0;
+    HandlerPoolBase::init(config);
+}
+
+TEST(HandlerPoolTest, connectionLimit)
+{
+    Config config("", "", "", "", 0, "/tmp", "localhost", "/tmp");
+    config.handlerPoolSize = 4;
+    config.handlerPoolConnections = 1;
+    HandlerPoolBase::init(config);
+
+    // Only one idle connection in all, however many a thread could keep
+    auto first = HandlerPool<ConnectedObj>::get(config);
+    auto second = HandlerPool<ConnectedObj>::get(config);
+    HandlerPool<ConnectedObj>::release(first);
+    HandlerPool<ConnectedObj>::release(second);
+    EXPECT_EQ(1u, HandlerPool<ConnectedObj>::getFreeCount());
+
+    // Reusing the idle one makes room again
+    first = HandlerPool<ConnectedObj>::get(config);
+    HandlerPool<ConnectedObj>::release(first);
+    EXPECT_EQ(1u, HandlerPool<ConnectedObj>::getFreeCount());
+
+    // Handlers without a connection don't count against it
+    auto plain = HandlerPool<PooledObj>::get(config);
+    HandlerPool<PooledObj>::release(plain);
+    EXPECT_EQ(1u, HandlerPool<PooledObj>::getFreeCount());
+
+    HandlerPool<ConnectedObj>::clear();
+    HandlerPool<PooledObj>::clear();
+    config.handlerPoolSize = 0;
+    config.handlerPoolConnections = 0;
+    HandlerPoolBase::init(config);
+}
+
+} // namespace mimeographer
@@ -0,0 +1,49 @@
+/*
+ * Copyright 2017 Keith Mendoza
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <string>
+
+#include "HeaderUtil.h"
+
+#include "gtest/gtest.h"
+
+using namespace std;
+
+namespace mimeographer
+{
+
+TEST(HeaderUtilTest, etagMatches)
+{
+    const string etag = "\"abc123\"";
+    EXPECT_TRUE(HeaderUtil::etagMatches(etag, etag));
+    EXPECT_TRUE(HeaderUtil::etagMatches("W/" + etag, etag));
+    EXPECT_TRUE(HeaderUtil::etagMatches("\"xyz\", " + etag, etag));
+    EXPECT_TRUE(HeaderUtil::etagMatches("*", etag));
+    EXPECT_FALSE(HeaderUtil::etagMatches("", etag));
+    EXPECT_FALSE(HeaderUtil::etagMatches("\"xyz\"", etag));
+    EXPECT_FALSE(HeaderUtil::etagMatches("abc123", etag));
+}
+
+TEST(HeaderUtilTest, acceptsCoding)
+{
+    EXPECT_TRUE(HeaderUtil::acceptsCoding("gzip, deflate, br", "br"));
+    EXPECT_TRUE(HeaderUtil::acceptsCoding("GZIP;q=0.5", "gzip"));
+    EXPECT_FALSE(HeaderUtil::acceptsCoding("gzip, deflate", "br"));
+    EXPECT_FALSE(HeaderUtil::acceptsCoding("br;q=0, gzip", "br"));
+    EXPECT_FALSE(HeaderUtil::acceptsCoding("", "br"));
+}
+
+} // namespace mimeographer
@@ -0,0 +1,37 @@
+/*
+ * Copyright 2017 Keith Mendoza
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "ImagePipeline.h"
+
+#include "gtest/gtest.h"
+
+namespace mimeographer
+{
+
+TEST(ImagePipelineTest, isImage)
+{
+    EXPECT_TRUE(ImagePipeline::isImage("9f/photo.jpg"));
+    EXPECT_TRUE(ImagePipeline::isImage("9f/photo.JPEG"));
+    EXPECT_TRUE(ImagePipeline::isImage("photo.png"));
+    EXPECT_TRUE(ImagePipeline::isImage("photo.webp"));
+
+    EXPECT_FALSE(ImagePipeline::isImage("animation.gif"));
+    EXPECT_FALSE(ImagePipeline::isImage("drawing.svg"));
+    EXPECT_FALSE(ImagePipeline::isImage("jpg"));
+    EXPECT_FALSE(ImagePipeline::isImage("photo."));
+}
+
+} // namespace mimeographer
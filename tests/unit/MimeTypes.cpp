@@ -0,0 +1,68 @@
+/*
+ * Copyright 2017 Keith Mendoza
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <cstring>
+#include <string>
+
+#include "MimeTypes.h"
+
+#include "gtest/gtest.h"
+
+using namespace std;
+
+namespace mimeographer
+{
+
+TEST(MimeTypesTest, table)
+{
+    EXPECT_TRUE(MimeTypes::sorted());
+    for(size_t i = 0; i < MimeTypes::tableSize; i++)
+    {
+        EXPECT_LE(strlen(MimeTypes::table[i].extension),
+            MimeTypes::maxExtension);
+    }
+}
+
+TEST(MimeTypesTest, find)
+{
+    EXPECT_STREQ(MimeTypes::find("/static/site.css"), "text/css");
+    EXPECT_STREQ(MimeTypes::find("/static/app.js"), "text/javascript");
+    EXPECT_STREQ(MimeTypes::find("/static/fonts/a.woff2"), "font/woff2");
+    EXPECT_STREQ(MimeTypes::find("index.html"), "text/html");
+    EXPECT_STREQ(MimeTypes::find("photo.webp"), "image/webp");
+    EXPECT_STREQ(MimeTypes::find("site.webmanifest"),
+        "application/manifest+json");
+
+    // Case doesn't matter
+    EXPECT_STREQ(MimeTypes::find("/uploads/IMG_0001.PNG"), "image/png");
+    EXPECT_STREQ(MimeTypes::find("photo.JpEg"), "image/jpeg");
+
+    // Only the last extension of the last path component counts
+    EXPECT_STREQ(MimeTypes::find("archive.png.zip"), "application/zip");
+    EXPECT_STREQ(MimeTypes::find("dir.png/file"), MimeTypes::defaultType);
+
+    EXPECT_STREQ(MimeTypes::find("README"), MimeTypes::defaultType);
+    EXPECT_STREQ(MimeTypes::find("file."), MimeTypes::defaultType);
+    EXPECT_STREQ(MimeTypes::find("file.unknown"), MimeTypes::defaultType);
+    EXPECT_STREQ(MimeTypes::find("file.webmanifestx"), MimeTypes::defaultType);
+    EXPECT_STREQ(MimeTypes::find(""), MimeTypes::defaultType);
+
+    // Doesn't need a null terminated string
+    const char *name = "style.cssXYZ";
+    EXPECT_STREQ(MimeTypes::find(name, 9), "text/css");
+}
+
+} // namespace mimeographer
@@ -0,0 +1,65 @@
+/*
+ * Copyright 2017 Keith Mendoza
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <string>
+
+#include "params.h"
+#include "PageCache.h"
+
+#include "gtest/gtest.h"
+
+using namespace std;
+
+namespace mimeographer
+{
+
+TEST(PageCacheTest, evict)
+{
+    Config config(FLAGS_dbHost, FLAGS_dbUser, FLAGS_dbPass, FLAGS_dbName,
+            FLAGS_dbPort, "/tmp", "localhost", FLAGS_staticBase);
+    config.pageCacheBytes = 30;
+    PageCache::init(config);
+
+    PageCache::store("a", { make_shared<const string>(10, 'a'), nullptr });
+    PageCache::store("b", { make_shared<const string>(10, 'b'),
+        make_shared<const string>(5, 'B') });
+    EXPECT_EQ(PageCache::cacheBytes, 25);
+
+    auto page = PageCache::find("a");
+    ASSERT_TRUE(page);
+    EXPECT_EQ(*page->plain, string(10, 'a'));
+    EXPECT_FALSE(page->gzip);
+
+    // "a" was just used, so "b" goes first
+    PageCache::store("c", { make_shared<const string>(10, 'c'), nullptr });
+    EXPECT_FALSE(PageCache::find("b"));
+    EXPECT_TRUE(PageCache::find("a"));
+    EXPECT_TRUE(PageCache::find("c"));
+    EXPECT_EQ(PageCache::cacheBytes, 20);
+
+    // Too big to ever fit
+    PageCache::store("d", { make_shared<const string>(31, 'd'), nullptr });
+    EXPECT_FALSE(PageCache::find("d"));
+
+    // Evicted pages stay valid while something is still sending them
+    auto buf = PageCache::toIOBuf(PageCache::find("c")->plain);
+    config.pageCacheBytes = 0;
+    PageCache::init(config);
+    EXPECT_FALSE(PageCache::find("c"));
+    EXPECT_EQ(string((const char *)buf->data(), buf->length()), string(10, 'c'));
+}
+
+} // namespace
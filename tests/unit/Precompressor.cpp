@@ -0,0 +1,126 @@
+/*
+ * Copyright 2017 Keith Mendoza
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <fstream>
+#include <sstream>
+#include <string>
+
+#include <ctime>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "Precompressor.h"
+
+#include "gtest/gtest.h"
+
+using namespace std;
+
+namespace mimeographer
+{
+
+static string readAll(const string &fileName)
+{
+    ifstream in(fileName, ifstream::binary);
+    ostringstream buf;
+    buf << in.rdbuf();
+    return buf.str();
+}
+
+TEST(PrecompressorTest, compressible)
+{
+    EXPECT_TRUE(Precompressor::compressible("/static/site.css"));
+    EXPECT_TRUE(Precompressor::compressible("/static/app.min.JS"));
+    EXPECT_TRUE(Precompressor::compressible("logo.svg"));
+    EXPECT_FALSE(Precompressor::compressible("photo.jpg"));
+    EXPECT_FALSE(Precompressor::compressible("site.css.gz"));
+    EXPECT_FALSE(Precompressor::compressible("README"));
+}
+
+TEST(PrecompressorTest, isFresh)
+{
+    struct stat sidecar = {}, source = {};
+    source.st_mtim = { 100, 500 };
+
+    sidecar.st_mtim = { 101, 0 };
+    EXPECT_TRUE(Precompressor::isFresh(sidecar, source));
+    sidecar.st_mtim = { 100, 501 };
+    EXPECT_TRUE(Precompressor::isFresh(sidecar, source));
+
+    // Same second, but written before the source changed
+    sidecar.st_mtim = { 100, 499 };
+    EXPECT_FALSE(Precompressor::isFresh(sidecar, source));
+    sidecar.st_mtim = { 100, 500 };
+    EXPECT_FALSE(Precompressor::isFresh(sidecar, source));
+    sidecar.st_mtim = { 99, 900 };
+    EXPECT_FALSE(Precompressor::isFresh(sidecar, source));
+}
+
+TEST(PrecompressorTest, writeGzip)
+{
+    const string fileName = "/tmp/mimeographer_precompress_test.css";
+    const string sidecar = fileName + ".gz";
+    unlink(sidecar.c_str());
+    {
+        ofstream out(fileName, ios_base::out | ios_base::trunc);
+        for(int i = 0; i < 100; i++)
+            out << "body { margin: 0; padding: 0; }\n";
+    }
+
+    // File times only move on with the kernel's clock tick, so the source
+    // is dated back to be sure the sidecar comes out newer
+    struct timespec times[2] = { { 0, UTIME_OMIT }, { time(nullptr) - 10, 0 } };
+    ASSERT_EQ(utimensat(AT_FDCWD, fileName.c_str(), times, 0), 0);
+
+    ASSERT_TRUE(Precompressor::writeGzip(fileName, 9));
+    auto compressed = readAll(sidecar);
+    ASSERT_GT(compressed.size(), 2);
+    EXPECT_LT(compressed.size(), readAll(fileName).size());
+    EXPECT_EQ((unsigned char)compressed[0], 0x1f);
+    EXPECT_EQ((unsigned char)compressed[1], 0x8b);
+
+    // An up to date sidecar is left alone
+    struct stat before, after;
+    ASSERT_EQ(stat(sidecar.c_str(), &before), 0);
+    ASSERT_TRUE(Precompressor::writeGzip(fileName, 9));
+    ASSERT_EQ(stat(sidecar.c_str(), &after), 0);
+    EXPECT_EQ(before.st_ino, after.st_ino);
+
+    // One modified at the same time as the source is rewritten
+    struct stat source;
+    ASSERT_EQ(stat(fileName.c_str(), &source), 0);
+    times[1] = source.st_mtim;
+    ASSERT_EQ(utimensat(AT_FDCWD, sidecar.c_str(), times, 0), 0);
+    ASSERT_TRUE(Precompressor::writeGzip(fileName, 9));
+    ASSERT_EQ(stat(sidecar.c_str(), &after), 0);
+    EXPECT_NE(before.st_ino, after.st_ino);
+
+    // Nothing written when it doesn't get smaller
+    unlink(sidecar.c_str());
+    {
+        ofstream out(fileName, ios_base::out | ios_base::trunc);
+        out << "a";
+    }
+    ASSERT_TRUE(Precompressor::writeGzip(fileName, 9));
+    EXPECT_NE(stat(sidecar.c_str(), &after), 0);
+
+    EXPECT_FALSE(Precompressor::writeGzip("/tmp/no/such/file.css", 9));
+
+    unlink(fileName.c_str());
+}
+
+} // namespace mimeographer
@@ -160,6 +160,43 @@ TEST_F(PrimaryHandlerTest, renderArticle_image)
     );
     EXPECT_TRUE(isEq(expectVal, obj.handlerResponse));
 }
+
+TEST_F(PrimaryHandlerTest, renderArticle_imageVariants)
+{
+    const string hash =
+        "5e8a1c2d3b4f60718293a4b5c6d7e8f90a1b2c3d4e5f60718293a4b5c6d7e8f9";
+    const string path = "5e/" + hash + ".jpg";
+    IOBufEqual isEq;
+    PrimaryHandler obj(config);
+    ASSERT_NO_THROW({
+        obj.db.addUploadBlob(hash, path, 4);
+        obj.db.setUploadDimensions(hash, 4000, 3000);
+        obj.db.addUploadVariant(hash, 480, 360, "5e/" + hash + ".w480.jpg");
+        obj.db.addUploadVariant(hash, 1920, 1440,
+            "5e/" + hash + ".w1920.jpg");
+    });
+
+    // Uploads the pipeline hasn't seen are left as they are
+    const string unknown =
+        "5e00000000000000000000000000000000000000000000000000000000000000";
+    unique_ptr<IOBuf> expectVal(move(IOBuf::copyBuffer(
+        "<p><img class=\"mx-auto d-block img-fluid\" src=\"/uploads/" + path
+            + "\" srcset=\"/uploads/5e/" + hash + ".w480.jpg 480w, "
+            "/uploads/5e/" + hash + ".w1920.jpg 1920w, "
+            "/uploads/" + path + " 4000w\" "
+            "sizes=\"(max-width: 4000px) 100vw, 4000px\" "
+            "width=\"4000\" height=\"3000\" alt=\"photo\" /> "
+        "<img class=\"mx-auto d-block\" src=\"/uploads/5e/" + unknown
+            + ".jpg\" alt=\"\" /></p>\n"
+    )));
+
+    obj.renderArticle(
+        "![photo](/uploads/" + path + ")\r\n"
+        "![](/uploads/5e/" + unknown + ".jpg)"
+    );
+    EXPECT_TRUE(isEq(expectVal, obj.handlerResponse))
+        << "handlerResponse value: " << obj.handlerResponse->data();
+}
     
 TEST_F(PrimaryHandlerTest, renderArticle_codeblock)
 {
@@ -0,0 +1,110 @@
+/*
+ * Copyright 2017 Keith Mendoza
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <cstdint>
+#include <string>
+
+#include "RequestArena.h"
+
+#include "gtest/gtest.h"
+
+using namespace std;
+
+namespace mimeographer
+{
+
+TEST(RequestArenaTest, allocate)
+{
+    RequestArena arena;
+    auto a = static_cast<char *>(arena.allocate(3, 1));
+    auto b = static_cast<char *>(arena.allocate(8, 8));
+    EXPECT_EQ(0u, reinterpret_cast<uintptr_t>(b) % 8);
+    EXPECT_GE(b, a + 3);
+    EXPECT_EQ(11u, arena.getAllocated());
+
+    // Still in the inline block
+    EXPECT_EQ(nullptr, arena.blocks);
+    EXPECT_GE(a, arena.inlineBlock);
+    EXPECT_LT(b, arena.inlineBlock + RequestArena::inlineSize);
+
+    // Spill over into a heap block
+    arena.allocate(1000, 1);
+    arena.allocate(1000, 1);
+    EXPECT_EQ(nullptr, arena.blocks);
+    arena.allocate(1000, 1);
+    ASSERT_NE(nullptr, arena.blocks);
+    EXPECT_EQ(RequestArena::minBlockSize, arena.blocks->size);
+    EXPECT_EQ(RequestArena::minBlockSize * 2, arena.nextBlockSize);
+}
+
+TEST(RequestArenaTest, largeAllocation)
+{
+    RequestArena arena;
+    arena.allocate(16, 1);
+    auto pos = arena.pos;
+
+    // Gets its own block and leaves the current one alone
+    auto big = arena.allocate(RequestArena::minBlockSize, 16);
+    EXPECT_NE(nullptr, big);
+    ASSERT_NE(nullptr, arena.blocks);
+    EXPECT_GE(arena.blocks->size, RequestArena::minBlockSize);
+    EXPECT_EQ(pos, arena.pos);
+    EXPECT_EQ(RequestArena::minBlockSize, arena.nextBlockSize);
+}
+
+TEST(RequestArenaTest, reset)
+{
+    RequestArena arena;
+    for(int i = 0; i < 4; i++)
+        arena.allocate(1000, 1);
+    auto block = arena.current;
+    ASSERT_NE(nullptr, block);
+
+    arena.reset();
+    EXPECT_EQ(0u, arena.getAllocated());
+    EXPECT_EQ(nullptr, arena.blocks);
+    EXPECT_EQ(block, arena.spare);
+    EXPECT_EQ(arena.inlineBlock, arena.pos);
+
+    // The spare block is used again once the inline block is full
+    for(int i = 0; i < 3; i++)
+        arena.allocate(1000, 1);
+    EXPECT_EQ(block, arena.blocks);
+    EXPECT_EQ(nullptr, arena.spare);
+}
+
+TEST(RequestArenaTest, containers)
+{
+    RequestArena arena;
+    ArenaMap<ArenaString, ArenaString> map{ArenaAllocator<char>(arena)};
+
+    const string key = "a key that is too long for the small string buffer";
+    findOrInsert(map, key) = "value";
+    EXPECT_EQ(1u, map.size());
+    EXPECT_EQ(ArenaAllocator<char>(arena), map.begin()->first.get_allocator());
+    EXPECT_EQ(ArenaAllocator<char>(arena), map.begin()->second.get_allocator());
+    EXPECT_GE(arena.getAllocated(), key.size());
+
+    findOrInsert(map, key) = "other";
+    EXPECT_EQ(1u, map.size());
+    EXPECT_EQ("other", map.find(key)->second);
+    EXPECT_EQ(map.end(), map.find(string("missing")));
+
+    // Not tied to an arena, so it uses the heap
+    ArenaString heap("x");
+    EXPECT_NE(ArenaAllocator<char>(arena), heap.get_allocator());
+}
+
+} // namespace mimeographer
@@ -0,0 +1,75 @@
+/*
+ * Copyright 2017 Keith Mendoza
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <string>
+
+#include "RequestContext.h"
+
+#include "gtest/gtest.h"
+
+using namespace std;
+using namespace folly;
+
+namespace mimeographer
+{
+
+TEST(RequestContextTest, parseCookies)
+{
+    RequestContext::Fields fields;
+    const string header = "cookie1=asdfasdf; b=bbbb;token=YWJj==; "
+        "quoted=\"q v\"; novalue; =noname";
+    RequestContext::parseCookies(header, fields);
+    ASSERT_EQ(fields.size(), 4);
+    EXPECT_EQ(fields[0].first, "cookie1");
+    EXPECT_EQ(fields[0].second, "asdfasdf");
+    EXPECT_EQ(fields[1].first, "b");
+    EXPECT_EQ(fields[1].second, "bbbb");
+    EXPECT_EQ(fields[2].first, "token");
+    EXPECT_EQ(fields[2].second, "YWJj==");
+    EXPECT_EQ(fields[3].first, "quoted");
+    EXPECT_EQ(fields[3].second, "q v");
+
+    // Views into the header, not copies
+    EXPECT_EQ(fields[0].second.data(), header.data() + 8);
+
+    RequestContext::parseCookies("", fields);
+    RequestContext::parseCookies(" ; ;", fields);
+    EXPECT_EQ(fields.size(), 4);
+
+    auto found = RequestContext::find(fields, "b");
+    ASSERT_TRUE(found);
+    EXPECT_EQ(*found, "bbbb");
+    EXPECT_FALSE(RequestContext::find(fields, "novalue"));
+}
+
+TEST(RequestContextTest, parseQuery)
+{
+    RequestContext::Fields fields;
+    RequestContext::parseQuery("a=1&b=&c&&d=x%20y=z", fields);
+    ASSERT_EQ(fields.size(), 4);
+    EXPECT_EQ(fields[0].first, "a");
+    EXPECT_EQ(fields[0].second, "1");
+    EXPECT_EQ(fields[1].first, "b");
+    EXPECT_TRUE(fields[1].second.empty());
+    EXPECT_EQ(fields[2].first, "c");
+    EXPECT_TRUE(fields[2].second.empty());
+    EXPECT_EQ(fields[3].first, "d");
+    EXPECT_EQ(fields[3].second, "x%20y=z");
+
+    RequestContext::parseQuery("", fields);
+    EXPECT_EQ(fields.size(), 4);
+}
+
+} // namespace mimeographer
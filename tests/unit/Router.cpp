@@ -0,0 +1,151 @@
+/*
+ * Copyright 2017 Keith Mendoza
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <stdexcept>
+#include <string>
+
+#include "Router.h"
+
+#include "gtest/gtest.h"
+
+using namespace std;
+
+namespace mimeographer
+{
+
+TEST(RouterTest, parseInt)
+{
+    int64_t value = -1;
+    EXPECT_TRUE(Router::parseInt("0", value));
+    EXPECT_EQ(0, value);
+    EXPECT_TRUE(Router::parseInt("1234", value));
+    EXPECT_EQ(1234, value);
+    EXPECT_FALSE(Router::parseInt("", value));
+    EXPECT_FALSE(Router::parseInt("12a", value));
+    EXPECT_FALSE(Router::parseInt("-1", value));
+    EXPECT_FALSE(Router::parseInt("99999999999999999999", value));
+    EXPECT_EQ(1234, value);
+}
+
+TEST(RouterTest, match)
+{
+    const Router &router = Router::site();
+
+    string path = "/";
+    EXPECT_EQ(Route::FRONT_PAGE, router.match(path).route);
+
+    path = "/archives/";
+    EXPECT_EQ(Route::ARCHIVES, router.match(path).route);
+
+    path = "/article/42";
+    auto match = router.match(path);
+    EXPECT_EQ(Route::ARTICLE, match.route);
+    EXPECT_EQ(RouteHandler::PRIMARY, match.handler);
+    ASSERT_TRUE(match.param("id"));
+    EXPECT_EQ("42", match.param("id")->str());
+    ASSERT_TRUE(match.intParam("id"));
+    EXPECT_EQ(42, *match.intParam("id"));
+    EXPECT_FALSE(match.param("path"));
+
+    path = "/article/abc";
+    match = router.match(path);
+    EXPECT_EQ(Route::NOT_FOUND, match.route);
+    EXPECT_EQ(RouteHandler::PRIMARY, match.handler);
+    EXPECT_EQ(0u, match.paramCount);
+
+    path = "/edit/article";
+    EXPECT_EQ(Route::EDIT_ARTICLE_LIST, router.match(path).route);
+
+    path = "/edit/article/7";
+    match = router.match(path);
+    EXPECT_EQ(Route::EDIT_ARTICLE, match.route);
+    EXPECT_EQ(7, *match.intParam("id"));
+
+    // Falls back to the /edit catch-all once the int capture fails
+    path = "/edit/article/new";
+    match = router.match(path);
+    EXPECT_EQ(Route::EDIT_UNKNOWN, match.route);
+    EXPECT_EQ(RouteHandler::EDIT, match.handler);
+    EXPECT_EQ("article/new", match.param("path")->str());
+    EXPECT_EQ(1u, match.paramCount);
+
+    path = "/user/login/";
+    EXPECT_EQ(Route::USER_LOGIN, router.match(path).route);
+
+    path = "/static/css/site.css";
+    match = router.match(path);
+    EXPECT_EQ(Route::STATIC_FILE, match.route);
+    EXPECT_EQ(RouteHandler::STATIC, match.handler);
+    EXPECT_EQ("css/site.css", match.param("path")->str());
+
+    path = "/static/";
+    EXPECT_EQ(Route::NOT_FOUND, router.match(path).route);
+
+    path = "/favicon.ico";
+    EXPECT_EQ(Route::FAVICON, router.match(path).route);
+
+    path = "/editor";
+    EXPECT_EQ(Route::NOT_FOUND, router.match(path).route);
+
+    path = "//";
+    EXPECT_EQ(Route::NOT_FOUND, router.match(path).route);
+}
+
+TEST(RouterTest, captures)
+{
+    Router router({
+        { "/a/{x}/{n:int}", Route::ARTICLE, RouteHandler::PRIMARY },
+        { "/a/{x}/list", Route::ARCHIVES, RouteHandler::PRIMARY }
+    });
+
+    string path = "/a/foo/12";
+    auto match = router.match(path);
+    EXPECT_EQ(Route::ARTICLE, match.route);
+    EXPECT_EQ("foo", match.param("x")->str());
+    EXPECT_EQ(12, *match.intParam("n"));
+
+    path = "/a/foo/list";
+    match = router.match(path);
+    EXPECT_EQ(Route::ARCHIVES, match.route);
+    EXPECT_EQ("foo", match.param("x")->str());
+    EXPECT_EQ(1u, match.paramCount);
+
+    path = "/a/foo";
+    EXPECT_EQ(Route::NOT_FOUND, router.match(path).route);
+}
+
+TEST(RouterTest, badPattern)
+{
+    EXPECT_THROW(Router({ { "article", Route::ARTICLE,
+        RouteHandler::PRIMARY } }), invalid_argument);
+    EXPECT_THROW(Router({ { "/a//b", Route::ARTICLE,
+        RouteHandler::PRIMARY } }), invalid_argument);
+    EXPECT_THROW(Router({ { "/a/{:int}", Route::ARTICLE,
+        RouteHandler::PRIMARY } }), invalid_argument);
+    EXPECT_THROW(Router({ { "/a/{id:float}", Route::ARTICLE,
+        RouteHandler::PRIMARY } }), invalid_argument);
+    EXPECT_THROW(Router({ { "/a/{rest:*}/b", Route::ARTICLE,
+        RouteHandler::PRIMARY } }), invalid_argument);
+    EXPECT_THROW(Router({
+        { "/a/{id:int}", Route::ARTICLE, RouteHandler::PRIMARY },
+        { "/a/{num:int}/b", Route::ARCHIVES, RouteHandler::PRIMARY }
+    }), invalid_argument);
+    EXPECT_THROW(Router({
+        { "/a", Route::ARTICLE, RouteHandler::PRIMARY },
+        { "/a/", Route::ARCHIVES, RouteHandler::PRIMARY }
+    }), invalid_argument);
+}
+
+} // namespace mimeographer
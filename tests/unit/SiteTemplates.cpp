@@ -48,6 +48,29 @@ TEST(SiteTemplatesTest, init)
         SiteTemplates::templateItems.at("navclose");
         SiteTemplates::templateItems.at("contentopen");
     });
+
+    auto version = SiteTemplates::getVersion();
+    EXPECT_FALSE(version.empty());
+    SiteTemplates::init(config);
+    EXPECT_EQ(SiteTemplates::getVersion(), version);
+}
+
+TEST(SiteTemplatesTest, buildPageHeader)
+{
+    Config config(FLAGS_dbHost, FLAGS_dbUser, FLAGS_dbPass, FLAGS_dbName,
+            FLAGS_dbPort, "/tmp", "localhost", FLAGS_staticBase);
+    SiteTemplates::init(config);
+
+    auto common = SiteTemplates::getTemplate("header") +
+        SiteTemplates::getTemplate("navbase");
+    auto close = SiteTemplates::getTemplate("navclose") +
+        SiteTemplates::getTemplate("contentopen");
+
+    EXPECT_EQ(SiteTemplates::buildPageHeader(false),
+        common + SiteTemplates::getTemplate("login") + close);
+    EXPECT_EQ(SiteTemplates::buildPageHeader(true),
+        common + SiteTemplates::getTemplate("editnav") +
+        SiteTemplates::getTemplate("usernav") + close);
 }
 
 } // namespace
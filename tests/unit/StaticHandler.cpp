@@ -13,6 +13,13 @@
  * See the License for the specific language governing permissions and
  * limitations under the License.
  */
+#include <ctime>
+#include <fstream>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
 #include "gtest/gtest.h"
 
 #include "params.h"
@@ -20,6 +27,7 @@
 #include "StaticHandler.h"
 
 using namespace std;
+using namespace proxygen;
 
 namespace mimeographer
 {
@@ -33,7 +41,128 @@ TEST(StaticHandlerTest, parsePath)
         EXPECT_EQ(obj.parsePath("asdf+ddd%20yyy%23"), string("asdf ddd yyy#"));
     });
 
+    EXPECT_EQ(obj.parsePath("%41b%2fc"), string("Ab/c"));
+    EXPECT_EQ(obj.parsePath(""), string(""));
+
     EXPECT_THROW({ obj.parsePath("asdf%2R"); }, HandlerError);
+    EXPECT_THROW({ obj.parsePath("asdf%2"); }, HandlerError);
+
+    // Nothing outside the directory, however it's spelled
+    EXPECT_THROW({ obj.parsePath("../etc/passwd"); }, HandlerError);
+    EXPECT_THROW({ obj.parsePath("css/../../etc/passwd"); }, HandlerError);
+    EXPECT_THROW({ obj.parsePath("%2e%2e/etc/passwd"); }, HandlerError);
+    EXPECT_THROW({ obj.parsePath("css%2f%2E%2E%2f..%2fx"); }, HandlerError);
+    EXPECT_THROW({ obj.parsePath(".."); }, HandlerError);
+    EXPECT_THROW({ obj.parsePath("a.png%00.txt"); }, HandlerError);
+    EXPECT_EQ(obj.parsePath("a..b/..c/d.."), string("a..b/..c/d.."));
+}
+
+TEST(StaticHandlerTest, parseRange)
+{
+    typedef StaticHandler::ByteRanges ByteRanges;
+
+    EXPECT_EQ(*StaticHandler::parseRange("bytes=0-99", 1000),
+        ByteRanges({ { 0, 100 } }));
+    EXPECT_EQ(*StaticHandler::parseRange("bytes=900-", 1000),
+        ByteRanges({ { 900, 100 } }));
+    EXPECT_EQ(*StaticHandler::parseRange("bytes=-100", 1000),
+        ByteRanges({ { 900, 100 } }));
+    EXPECT_EQ(*StaticHandler::parseRange("bytes=-2000", 1000),
+        ByteRanges({ { 0, 1000 } }));
+    EXPECT_EQ(*StaticHandler::parseRange("bytes=990-2000", 1000),
+        ByteRanges({ { 990, 10 } }));
+    EXPECT_EQ(*StaticHandler::parseRange("bytes=0-0, 10-19 ,-1", 1000),
+        ByteRanges({ { 0, 1 }, { 10, 10 }, { 999, 1 } }));
+
+    // Unsatisfiable ranges are dropped
+    EXPECT_EQ(*StaticHandler::parseRange("bytes=1000-", 1000), ByteRanges());
+    EXPECT_EQ(*StaticHandler::parseRange("bytes=-0", 1000), ByteRanges());
+    EXPECT_EQ(*StaticHandler::parseRange("bytes=5-9,2000-", 1000),
+        ByteRanges({ { 5, 5 } }));
+
+    // Malformed headers are ignored
+    EXPECT_FALSE(StaticHandler::parseRange("items=0-1", 1000));
+    EXPECT_FALSE(StaticHandler::parseRange("bytes=9-5", 1000));
+    EXPECT_FALSE(StaticHandler::parseRange("bytes=a-5", 1000));
+    EXPECT_FALSE(StaticHandler::parseRange("bytes=5", 1000));
+    EXPECT_FALSE(StaticHandler::parseRange("bytes=-", 1000));
+    EXPECT_FALSE(StaticHandler::parseRange(
+        "bytes=0-0,1-1,2-2,3-3,4-4,5-5,6-6,7-7,8-8,9-9,10-10,11-11,12-12,"
+        "13-13,14-14,15-15,16-16", 1000));
+}
+
+TEST(StaticHandlerTest, notModified)
+{
+    Config config(FLAGS_dbHost, FLAGS_dbUser, FLAGS_dbPass, FLAGS_dbName,
+            FLAGS_dbPort, "/tmp", "localhost", "/tmp");
+    StaticHandler obj(config);
+    obj.fileInfo_ = {};
+    obj.fileInfo_.st_mtim.tv_sec = 1500000000;
+    obj.etag_ = "\"abc\"";
+
+    HTTPMessage msg;
+    EXPECT_FALSE(obj.notModified(msg));
+
+    msg.getHeaders().set(HTTP_HEADER_IF_MODIFIED_SINCE,
+        StaticHandler::httpDate(1500000000));
+    EXPECT_TRUE(obj.notModified(msg));
+    msg.getHeaders().set(HTTP_HEADER_IF_MODIFIED_SINCE,
+        StaticHandler::httpDate(1499999999));
+    EXPECT_FALSE(obj.notModified(msg));
+    msg.getHeaders().set(HTTP_HEADER_IF_MODIFIED_SINCE, "yesterday");
+    EXPECT_FALSE(obj.notModified(msg));
+
+    // If-None-Match wins over If-Modified-Since
+    msg.getHeaders().set(HTTP_HEADER_IF_MODIFIED_SINCE,
+        StaticHandler::httpDate(1500000000));
+    msg.getHeaders().set(HTTP_HEADER_IF_NONE_MATCH, "\"xyz\"");
+    EXPECT_FALSE(obj.notModified(msg));
+    msg.getHeaders().set(HTTP_HEADER_IF_NONE_MATCH, "\"xyz\", \"abc\"");
+    EXPECT_TRUE(obj.notModified(msg));
+}
+
+TEST(StaticHandlerTest, findSidecar)
+{
+    Config config(FLAGS_dbHost, FLAGS_dbUser, FLAGS_dbPass, FLAGS_dbName,
+            FLAGS_dbPort, "/tmp", "localhost", "/tmp");
+    const string fileName = "/tmp/mimeographer_sidecar_test.css";
+    {
+        ofstream out(fileName, ios_base::out | ios_base::trunc);
+        out << "body { margin: 0; }";
+        ofstream gz(fileName + ".gz", ios_base::out | ios_base::trunc);
+        gz << "compressed";
+    }
+
+    // File times only move on with the kernel's clock tick, so the source
+    // is dated back to be sure the sidecar is newer
+    struct timespec times[2] = { { 0, UTIME_OMIT }, { time(nullptr) - 10, 0 } };
+    ASSERT_EQ(utimensat(AT_FDCWD, fileName.c_str(), times, 0), 0);
+
+    StaticHandler obj(config);
+    obj.fileName = fileName;
+    ASSERT_EQ(stat(fileName.c_str(), &obj.fileInfo_), 0);
+
+    obj.findSidecar("br, deflate");
+    EXPECT_EQ(obj.fileName, fileName);
+    EXPECT_EQ(obj.contentEncoding_, "");
+
+    obj.findSidecar("gzip, deflate, br");
+    EXPECT_EQ(obj.fileName, fileName + ".gz");
+    EXPECT_EQ(obj.contentEncoding_, "gzip");
+    EXPECT_EQ(obj.fileInfo_.st_size, 10);
+
+    // Not used when it isn't strictly newer than the source
+    obj.fileName = fileName;
+    obj.contentEncoding_.clear();
+    ASSERT_EQ(stat(fileName.c_str(), &obj.fileInfo_), 0);
+    times[1] = obj.fileInfo_.st_mtim;
+    ASSERT_EQ(utimensat(AT_FDCWD, (fileName + ".gz").c_str(), times, 0), 0);
+    obj.findSidecar("gzip");
+    EXPECT_EQ(obj.fileName, fileName);
+    EXPECT_EQ(obj.contentEncoding_, "");
+
+    unlink((fileName + ".gz").c_str());
+    unlink(fileName.c_str());
 }
 
 } // namespace
@@ -0,0 +1,58 @@
+/*
+ * Copyright 2017 Keith Mendoza
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "UploadLimiter.h"
+
+#include "gtest/gtest.h"
+
+using namespace std;
+
+namespace mimeographer
+{
+
+TEST(UploadLimiterTest, acquire)
+{
+    Config config("", "", "", "", 0, "", "", "");
+    config.uploadsPerUser = 2;
+    UploadLimiter::init(config);
+
+    EXPECT_TRUE(UploadLimiter::acquire(1));
+    EXPECT_TRUE(UploadLimiter::acquire(1));
+    EXPECT_FALSE(UploadLimiter::acquire(1));
+
+    // Other users have their own slots
+    EXPECT_TRUE(UploadLimiter::acquire(2));
+
+    UploadLimiter::release(1);
+    EXPECT_TRUE(UploadLimiter::acquire(1));
+
+    UploadLimiter::release(1);
+    UploadLimiter::release(1);
+    UploadLimiter::release(2);
+    EXPECT_TRUE(UploadLimiter::active.empty());
+
+    // A stray release doesn't go negative
+    UploadLimiter::release(3);
+    EXPECT_TRUE(UploadLimiter::active.empty());
+
+    // Nor does a refused one leave an entry behind
+    config.uploadsPerUser = 0;
+    UploadLimiter::init(config);
+    EXPECT_FALSE(UploadLimiter::acquire(4));
+    EXPECT_TRUE(UploadLimiter::active.empty());
+}
+
+} // namespace mimeographer
@@ -0,0 +1,88 @@
+/*
+ * Copyright 2017 Keith Mendoza
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <string>
+
+#include "UploadStore.h"
+
+#include "gtest/gtest.h"
+
+using namespace std;
+using namespace folly;
+
+namespace mimeographer
+{
+
+namespace
+{
+
+const string hash =
+    "9f86d081884c7d659a2feaa0c55ad015a3bf4f1b2b0b822cd15d6c15b0f00a08";
+
+}
+
+TEST(UploadStoreTest, hex)
+{
+    const unsigned char data[] = { 0x00, 0x9f, 0xa0, 0xff };
+    EXPECT_EQ(UploadStore::hex(ByteRange(data, sizeof(data))), "009fa0ff");
+}
+
+TEST(UploadStoreTest, blobPath)
+{
+    EXPECT_EQ(UploadStore::blobPath(hash, "photo.JPG"), "9f/" + hash + ".jpg");
+    EXPECT_EQ(UploadStore::blobPath(hash, "archive.tar.gz"),
+        "9f/" + hash + ".gz");
+    EXPECT_EQ(UploadStore::blobPath(hash, "noextension"), "9f/" + hash);
+    EXPECT_EQ(UploadStore::blobPath(hash, "trailing."), "9f/" + hash);
+    EXPECT_EQ(UploadStore::blobPath(hash, "bad.j/pg"), "9f/" + hash);
+    EXPECT_EQ(UploadStore::blobPath(hash, "long.extension1"), "9f/" + hash);
+}
+
+TEST(UploadStoreTest, blobHash)
+{
+    EXPECT_EQ(UploadStore::blobHash("9f/" + hash + ".jpg"), hash);
+    EXPECT_EQ(UploadStore::blobHash("9f/" + hash), hash);
+
+    // Old UUID-named uploads and anything else aren't stored files
+    EXPECT_TRUE(UploadStore::blobHash(
+        "b06953ed-62e3-486c-af0f-7eb08df357f5_military.jpeg").empty());
+    EXPECT_TRUE(UploadStore::blobHash("00/" + hash + ".jpg").empty());
+    EXPECT_TRUE(UploadStore::blobHash("9f/" + hash + "x.jpg").empty());
+    EXPECT_TRUE(UploadStore::blobHash("9f/" + hash + ".jpg/x").empty());
+    string upper = hash;
+    upper[10] = 'A';
+    EXPECT_TRUE(UploadStore::blobHash("9f/" + upper).empty());
+
+    // Downscaled copies don't share the original's ETag
+    EXPECT_TRUE(UploadStore::blobHash("9f/" + hash + ".w480.jpg").empty());
+}
+
+TEST(UploadStoreTest, variantPath)
+{
+    EXPECT_EQ(UploadStore::variantPath("9f/" + hash + ".jpg", 480),
+        "9f/" + hash + ".w480.jpg");
+    EXPECT_EQ(UploadStore::variantPath("9f/" + hash, 1920),
+        "9f/" + hash + ".w1920");
+
+    EXPECT_TRUE(UploadStore::isVariant("9f/" + hash + ".w480.jpg"));
+    EXPECT_TRUE(UploadStore::isVariant("9f/" + hash + ".w1920"));
+    EXPECT_FALSE(UploadStore::isVariant("9f/" + hash + ".jpg"));
+    EXPECT_FALSE(UploadStore::isVariant("9f/" + hash + ".w.jpg"));
+    EXPECT_FALSE(UploadStore::isVariant("9f/" + hash + ".w480x.jpg"));
+    EXPECT_FALSE(UploadStore::isVariant("legacy_upload.w480.jpg"));
+}
+
+} // namespace mimeographer
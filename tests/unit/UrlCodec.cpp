@@ -0,0 +1,186 @@
+/*
+ * Copyright 2017 Keith Mendoza
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <random>
+#include <stdexcept>
+#include <string>
+
+#include "UrlCodec.h"
+#include "UrlCodecReference.h"
+
+#include "gtest/gtest.h"
+
+using namespace std;
+
+namespace mimeographer
+{
+
+namespace
+{
+
+string randomString(mt19937 &rng, const string &alphabet, size_t maxLength)
+{
+    uniform_int_distribution<size_t> length(0, maxLength);
+    uniform_int_distribution<size_t> pick(0, alphabet.size() - 1);
+    string retVal;
+    for(auto i = length(rng); i > 0; i--)
+        retVal += alphabet[pick(rng)];
+    return retVal;
+}
+
+}
+
+TEST(UrlCodecTest, hexValue)
+{
+    EXPECT_EQ(UrlCodec::hexValue('0'), 0);
+    EXPECT_EQ(UrlCodec::hexValue('9'), 9);
+    EXPECT_EQ(UrlCodec::hexValue('a'), 10);
+    EXPECT_EQ(UrlCodec::hexValue('F'), 15);
+    EXPECT_EQ(UrlCodec::hexValue('g'), -1);
+    EXPECT_EQ(UrlCodec::hexValue('%'), -1);
+}
+
+TEST(UrlCodecTest, decode)
+{
+    string out;
+    EXPECT_TRUE(UrlCodec::decode("asdf+ddd%20yyy%23", out));
+    EXPECT_EQ(out, "asdf ddd yyy#");
+
+    out.clear();
+    EXPECT_TRUE(UrlCodec::decode("a+b%2b", out, false));
+    EXPECT_EQ(out, "a+b+");
+
+    // Appends
+    EXPECT_TRUE(UrlCodec::decode("%41", out));
+    EXPECT_EQ(out, "a+b+A");
+
+    out.clear();
+    EXPECT_TRUE(UrlCodec::decode("", out));
+    EXPECT_EQ(out, "");
+
+    EXPECT_FALSE(UrlCodec::decode("%", out));
+    EXPECT_FALSE(UrlCodec::decode("abc%2", out));
+    EXPECT_FALSE(UrlCodec::decode("%2R", out));
+    EXPECT_FALSE(UrlCodec::decode("%+1", out));
+}
+
+TEST(UrlCodecTest, encode)
+{
+    EXPECT_EQ(UrlCodec::encode(" "), "%20");
+    EXPECT_EQ(UrlCodec::encode("Hello"), "Hello");
+    EXPECT_EQ(UrlCodec::encode("/blah %"), "%2Fblah%20%25");
+    EXPECT_EQ(UrlCodec::encode("a-b.c_d~e"), "a-b.c_d~e");
+    EXPECT_EQ(UrlCodec::encode(string("\x00\xff", 2)), "%00%FF");
+
+    string out = "x=";
+    UrlCodec::encode("1 2", out);
+    EXPECT_EQ(out, "x=1%202");
+}
+
+// Every kernel has to agree with the scalar one at every length and
+// alignment, with the interesting byte anywhere in the block
+TEST(UrlCodecTest, kernels)
+{
+    mt19937 rng(20171);
+    string alphabet = "abcXYZ019-._~%+/ \x7f";
+    alphabet += "\x80\xff";
+
+    vector<UrlCodec::Kernel> plain = { UrlCodec::plainRun };
+    vector<UrlCodec::Kernel> unreserved = { UrlCodec::unreservedRun };
+#ifdef MIMEOGRAPHER_URLCODEC_X86
+    plain.push_back(UrlCodec::plainRunSse2);
+    unreserved.push_back(UrlCodec::unreservedRunSse2);
+    if(__builtin_cpu_supports("avx2"))
+    {
+        plain.push_back(UrlCodec::plainRunAvx2);
+        unreserved.push_back(UrlCodec::unreservedRunAvx2);
+    }
+#endif
+
+    for(int i = 0; i < 5000; i++)
+    {
+        // Mostly clean input so the vector loops run for a while
+        auto str = randomString(rng, "abcdefXYZ0189-._~", 100) +
+            randomString(rng, alphabet, 40);
+        auto offset = i % 7;
+        str = string(offset, 'a') + str;
+        auto data = str.data() + offset;
+        auto size = str.size() - offset;
+
+        auto expected = UrlCodec::plainRunScalar(data, size);
+        for(auto kernel : plain)
+            ASSERT_EQ(kernel(data, size), expected) << str;
+
+        expected = UrlCodec::unreservedRunScalar(data, size);
+        for(auto kernel : unreserved)
+            ASSERT_EQ(kernel(data, size), expected) << str;
+    }
+}
+
+TEST(UrlCodecTest, encodeMatchesReference)
+{
+    mt19937 rng(42);
+    string alphabet;
+    for(int c = 0; c < 256; c++)
+        alphabet += static_cast<char>(c);
+
+    for(int i = 0; i < 2000; i++)
+    {
+        auto str = randomString(rng, alphabet, 200);
+        ASSERT_EQ(UrlCodec::encode(str), UrlCodecReference::encode(str));
+
+        str = randomString(rng, "abcdefghijklmnopqrstuvwxyz-_", 200);
+        ASSERT_EQ(UrlCodec::encode(str), UrlCodecReference::encode(str));
+    }
+}
+
+TEST(UrlCodecTest, decodeMatchesReference)
+{
+    mt19937 rng(7);
+
+    const string alphabet = "abcdefgABCDEFG0123456789/._~%%%+";
+    for(int i = 0; i < 5000; i++)
+    {
+        // std::stoi would take the sign in "%+1", where UrlCodec doesn't
+        auto str = randomString(rng, alphabet, 120);
+        for(size_t pos = str.find("%+"); pos != string::npos;
+            pos = str.find("%+", pos))
+            str[pos + 1] = '0';
+        string expected;
+        bool valid = true;
+        try
+        {
+            expected = UrlCodecReference::decode(str);
+        }
+        catch(const logic_error &)
+        {
+            valid = false;
+        }
+
+        string out;
+        ASSERT_EQ(UrlCodec::decode(str, out), valid) << str;
+        if(valid)
+        {
+            ASSERT_EQ(out, expected) << str;
+        }
+
+        // Round trip
+        out.clear();
+        ASSERT_TRUE(UrlCodec::decode(UrlCodec::encode(str), out, false));
+        ASSERT_EQ(out, str);
+    }
+}
+
+} // namespace mimeographer
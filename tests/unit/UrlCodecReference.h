@@ -0,0 +1,84 @@
+/*
+ * Copyright 2017 Keith Mendoza
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#pragma once
+
+#include <cctype>
+#include <iomanip>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+
+namespace mimeographer
+{
+
+////
+/// The URL codec functions as they were before UrlCodec, for checking
+/// UrlCodec gives the same results and for benchmarking against
+////
+struct UrlCodecReference
+{
+    // DBConn::urlEncode
+    static std::string encode(const std::string &str)
+    {
+        std::ostringstream buf;
+        buf.fill('0');
+        buf << std::hex;
+
+        for(unsigned char ch : str)
+        {
+            if(isalnum(ch) || ch == '-' || ch == '.' || ch ==  '_' || ch == '~')
+                buf << ch;
+            else
+                buf << '%' << std::uppercase << std::setw(2) << int(ch)
+                    << std::nouppercase;
+        }
+
+        return buf.str();
+    }
+
+    // StaticHandler::parsePath, with a bounds check added for a trailing %
+    // and std::invalid_argument instead of HandlerError
+    static std::string decode(const std::string &path)
+    {
+        std::string retVal;
+        for(auto p = path.begin(); p != path.end(); p++)
+        {
+            if(*p == '+')
+                retVal += ' ';
+            else if(*p == '%')
+            {
+                if(path.end() - p < 3)
+                    throw std::invalid_argument("Truncated escape");
+                p++;
+                std::string tmp;
+                tmp += *p;
+                p++;
+                tmp += *p;
+                size_t pos;
+                char chr = std::stoi(tmp, &pos, 16);
+                if(pos != 2)
+                    throw std::invalid_argument("Failed to convert " + tmp);
+                retVal += chr;
+            }
+            else
+                retVal += *p;
+        }
+
+        return retVal;
+    }
+};
+
+}
@@ -0,0 +1,166 @@
+/*
+ * Copyright 2017 Keith Mendoza
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "UrlEncodedParser.h"
+
+#include "gtest/gtest.h"
+
+using namespace std;
+using namespace folly;
+
+namespace mimeographer
+{
+
+namespace
+{
+
+class Collector : public UrlEncodedParser::Callback
+{
+public:
+    vector<pair<string, string>> params;
+    int errors = 0;
+
+    void onParam(const string &name, const string &value,
+        uint64_t bytesProcessed) override
+    {
+        params.emplace_back(name, value);
+    }
+
+    void onError() override
+    {
+        errors++;
+    }
+};
+
+}
+
+TEST(UrlEncodedParserTest, parse)
+{
+    Collector collector;
+    UrlEncodedParser parser(1024, 16);
+    parser.setCallback(&collector);
+    parser.parse("login=user%40example.com&password=a+b%3Dc=d&&flag&=x&"
+        "empty=");
+    parser.onIngressEOM();
+
+    EXPECT_EQ(collector.errors, 0);
+    ASSERT_EQ(collector.params.size(), 4);
+    EXPECT_EQ(collector.params[0].first, "login");
+    EXPECT_EQ(collector.params[0].second, "user@example.com");
+    EXPECT_EQ(collector.params[1].first, "password");
+    EXPECT_EQ(collector.params[1].second, "a b=c=d");
+    EXPECT_EQ(collector.params[2].first, "flag");
+    EXPECT_TRUE(collector.params[2].second.empty());
+    EXPECT_EQ(collector.params[3].first, "empty");
+    EXPECT_TRUE(collector.params[3].second.empty());
+}
+
+TEST(UrlEncodedParserTest, splitChunks)
+{
+    const string body = "csrf=0123%2Dabcd&content=%23+Title%0A%0Ab%C3%A9&x=1";
+
+    // Every way of cutting the body in two gives the same fields
+    for(size_t i = 0; i <= body.size(); i++)
+    {
+        Collector collector;
+        UrlEncodedParser parser(1024, 16);
+        parser.setCallback(&collector);
+        parser.parse(StringPiece(body).subpiece(0, i));
+        parser.parse(StringPiece(body).subpiece(i));
+        parser.onIngressEOM();
+
+        SCOPED_TRACE(i);
+        EXPECT_EQ(collector.errors, 0);
+        ASSERT_EQ(collector.params.size(), 3);
+        EXPECT_EQ(collector.params[0].second, "0123-abcd");
+        EXPECT_EQ(collector.params[1].first, "content");
+        EXPECT_EQ(collector.params[1].second, "# Title\n\nb\xC3\xA9");
+        EXPECT_EQ(collector.params[2].second, "1");
+    }
+
+    // One byte at a time
+    Collector collector;
+    UrlEncodedParser parser(1024, 16);
+    parser.setCallback(&collector);
+    for(auto c : body)
+        parser.parse(StringPiece(&c, 1));
+    parser.onIngressEOM();
+    EXPECT_EQ(collector.errors, 0);
+    ASSERT_EQ(collector.params.size(), 3);
+    EXPECT_EQ(collector.params[1].second, "# Title\n\nb\xC3\xA9");
+}
+
+TEST(UrlEncodedParserTest, malformed)
+{
+    for(auto body : { "a=%zz", "a=%4&b=1", "a%=1", "a=1%" })
+    {
+        Collector collector;
+        UrlEncodedParser parser(1024, 16);
+        parser.setCallback(&collector);
+        parser.parse(body);
+        parser.onIngressEOM();
+
+        SCOPED_TRACE(body);
+        EXPECT_EQ(collector.errors, 1);
+        EXPECT_TRUE(parser.hasFailed());
+        EXPECT_FALSE(parser.isOverLimit());
+    }
+
+    // Nothing more is parsed after an error
+    Collector collector;
+    UrlEncodedParser parser(1024, 16);
+    parser.setCallback(&collector);
+    parser.parse("a=1&b=%z");
+    parser.parse("z&c=2");
+    parser.onIngressEOM();
+    EXPECT_EQ(collector.errors, 1);
+    ASSERT_EQ(collector.params.size(), 1);
+    EXPECT_EQ(collector.params[0].first, "a");
+}
+
+TEST(UrlEncodedParserTest, limits)
+{
+    {
+        Collector collector;
+        UrlEncodedParser parser(10, 16);
+        parser.setCallback(&collector);
+        parser.parse("a=12345");
+        parser.parse("678");
+        EXPECT_FALSE(parser.hasFailed());
+        parser.parse("9");
+        parser.onIngressEOM();
+        EXPECT_EQ(collector.errors, 1);
+        EXPECT_TRUE(parser.isOverLimit());
+        EXPECT_TRUE(collector.params.empty());
+    }
+
+    {
+        Collector collector;
+        UrlEncodedParser parser(1024, 2);
+        parser.setCallback(&collector);
+        parser.parse("a=1&b=2&c=3");
+        parser.onIngressEOM();
+        EXPECT_EQ(collector.errors, 1);
+        EXPECT_TRUE(parser.isOverLimit());
+        EXPECT_EQ(collector.params.size(), 2);
+    }
+}
+
+} // namespace mimeographer
@@ -82,7 +82,7 @@ TEST_F(UserHandlerTest, authenticateLogin)
 TEST_F(UserHandlerTest, buildLoginPage)
 {
     auto form =
-        "<form method=\"post\" action=\"/user/login\" enctype=\"multipart/form-data\" class=\"form-signin\" style=\"max-width:330px; margin:0 auto\">"
+        "<form method=\"post\" action=\"/user/login\" enctype=\"application/x-www-form-urlencoded\" class=\"form-signin\" style=\"max-width:330px; margin:0 auto\">"
         "<h2 class=\"form-signin-heading\">Please sign in</h2>"
         "<label for=\"inputEmail\" class=\"sr-only\">Email address</label>"
         "<input type=\"email\" name=\"login\" id=\"inputEmail\" class=\"form-control\" placeholder=\"Email address\" required autofocus>"
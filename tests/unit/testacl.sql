@@ -6,4 +6,4 @@ GRANT TRUNCATE
     ON session, user_session
     TO mimeographer_unittest;
 
-GRANT DELETE ON users TO mimeographer_unittest;
+GRANT DELETE ON users, upload_blob, upload TO mimeographer_unittest;